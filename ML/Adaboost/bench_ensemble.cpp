@@ -0,0 +1,118 @@
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <thread>
+#include <vector>
+#include <Eigen/Dense>
+#include "stump_ensemble.hpp"
+
+using namespace Eigen;
+// g++ -O3 -march=native -std=c++17 bench_ensemble.cpp -o bench_ensemble -I /usr/include/eigen3
+// ./bench_ensemble [rows] [features] [clients] [learners_per_client]
+//
+// Merges random client ensembles the way the server does and scores a batch
+// with the original per-row loop over every learner and with the compiled
+// StumpEnsemble, unpruned (same predictions) and pruned to shrinking budgets
+// (agreement with the unpruned ensemble). Then scores on thread pools.
+
+// The original server scoring: every learner for every row
+double predict_adaboost(const MatrixXd& data, const std::vector<WeakLearner>& learners, int sample_index) {
+    double prediction = 0.0;
+    for (const auto& learner : learners) {
+        double stump_prediction = (data(sample_index, learner.feature_index) <= learner.threshold) ? 1 : -1;
+        prediction += learner.alpha * stump_prediction;
+    }
+    return prediction >= 0 ? 1 : -1;
+}
+
+template <typename Fn>
+double seconds(Fn&& fn) {
+    auto start = std::chrono::steady_clock::now();
+    fn();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+double agreement(const std::vector<double>& a, const std::vector<double>& b) {
+    size_t same = 0;
+    for (size_t i = 0; i < a.size(); ++i) same += a[i] == b[i];
+    return double(same) / a.size();
+}
+
+int main(int argc, char** argv) {
+    int rows = argc > 1 ? std::stoi(argv[1]) : 100000;
+    int features = argc > 2 ? std::stoi(argv[2]) : 50;
+    int clients = argc > 3 ? std::stoi(argv[3]) : 20;
+    int per_client = argc > 4 ? std::stoi(argv[4]) : 200;
+
+    // Client stumps favour a few features and thresholds on a coarse grid, so
+    // clients boosting on similar data pick many of the same stumps
+    std::mt19937_64 rng(17);
+    std::normal_distribution<double> normal(0.0, 1.0);
+    std::geometric_distribution<int> feature_pick(0.1);
+    std::uniform_real_distribution<double> alpha_pick(0.05, 1.0);
+    EnsembleBuilder builder;
+    std::vector<WeakLearner> all_learners;  // Every client's learners, rescaled as the builder does
+    for (int c = 0; c < clients; ++c) {
+        std::vector<WeakLearner> learners;
+        double total = 0.0;
+        for (int l = 0; l < per_client; ++l) {
+            WeakLearner learner{feature_pick(rng) % features, std::round(normal(rng) * 8.0) / 8.0, alpha_pick(rng)};
+            // Clients mostly agree on the direction of each feature's effect
+            if ((learner.feature_index % 2 == 1) != (rng() % 5 == 0)) learner.alpha = -learner.alpha;
+            total += std::abs(learner.alpha);
+            learners.push_back(learner);
+        }
+        double samples = 1000.0 + double(rng() % 9000);
+        builder.add(learners, samples);
+        for (WeakLearner learner : learners) {
+            learner.alpha *= samples / total;
+            all_learners.push_back(learner);
+        }
+    }
+    MatrixXd X = MatrixXd::NullaryExpr(rows, features, [&]() { return normal(rng); });
+
+    std::cout << "[INFO] " << rows << " rows x " << features << " features, " << clients << " clients x "
+              << per_client << " learners = " << all_learners.size() << " stumps, " << builder.stumps()
+              << " after merging" << std::endl;
+    std::cout << std::fixed << std::setprecision(4);
+
+    std::vector<double> expected(rows);
+    double naive = seconds([&]() {
+        for (int i = 0; i < rows; ++i) expected[i] = predict_adaboost(X, all_learners, i);
+    });
+    std::cout << std::setw(16) << "per-row loop" << std::setw(10) << naive << " s" << std::endl;
+
+    std::vector<double> full;
+    bool same = false;
+    for (size_t budget : {size_t(0), size_t(256), size_t(64), size_t(16)}) {
+        StumpEnsemble ensemble;
+        double compile = seconds([&]() { ensemble = StumpEnsemble(builder.select(budget)); });
+        std::vector<double> predictions;
+        double t = seconds([&]() { predictions = ensemble.predict(X); });
+        if (budget == 0) {
+            full = predictions;
+            same = agreement(predictions, expected) == 1.0;
+        }
+        std::cout << std::setw(9) << ensemble.stumps() << " stumps" << std::setw(10) << t << " s   compile "
+                  << compile << " s   speedup " << std::setprecision(0) << std::setw(5) << naive / t << "x   "
+                  << std::setprecision(4) << "agreement " << agreement(predictions, full) << std::endl;
+    }
+    std::cout << "  unpruned predictions " << (same ? "match" : "DIFFER FROM") << " the per-row loop" << std::endl;
+
+    StumpEnsemble ensemble(builder.select());
+    VectorXd reference = ensemble.score(X);
+    unsigned max_threads = std::max(4u, std::thread::hardware_concurrency());
+    std::cout << "\n[INFO] Scoring on thread pools (" << std::thread::hardware_concurrency() << " hardware threads)"
+              << std::endl;
+    for (unsigned threads = 1; threads <= max_threads; threads *= 2) {
+        ThreadPool pool(threads);
+        VectorXd scores;
+        double t = seconds([&]() { scores = ensemble.score(X, &pool); });
+        std::cout << std::setw(9) << threads << std::setw(10) << t << " s   "
+                  << (scores == reference ? "same scores" : "SCORES DIFFER") << std::endl;
+    }
+    return same ? 0 : 1;
+}
@@ -0,0 +1,159 @@
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <random>
+#include <thread>
+#include <vector>
+#include <Eigen/Dense>
+#include "stump_learner.hpp"
+
+using namespace Eigen;
+// g++ -O3 -march=native -std=c++17 bench_stump.cpp -o bench_stump -I /usr/include/eigen3
+// ./bench_stump [baseline_rows] [rows] [features] [rounds]
+//
+// Runs boosting rounds with the original stump search (every row value of every
+// feature, one prediction vector per candidate) and with StumpLearner on the
+// same data, comparing time and weighted error per round. Then boosts on a
+// large dataset with thread pools of growing size, checking that every pool
+// size picks the same stumps.
+
+// The original search: positive polarity only, O(rows^2 * features)
+WeakLearner train_weak_learner(const MatrixXd& data, const VectorXd& labels, const VectorXd& weights) {
+    int n_samples = data.rows();
+    int n_features = data.cols();
+    WeakLearner best_learner = {0, 0, 0};
+    double best_error = std::numeric_limits<double>::max();
+    for (int feature_index = 0; feature_index < n_features; ++feature_index) {
+        for (int i = 0; i < n_samples; ++i) {
+            double threshold = data(i, feature_index);
+            VectorXd predictions = (data.col(feature_index).array() <= threshold).cast<double>() * 2 - 1;
+            double weighted_error = (weights.array() * (predictions.array() != labels.array()).cast<double>()).sum();
+            if (weighted_error < best_error) {
+                best_error = weighted_error;
+                best_learner = {feature_index, threshold, 0};
+            }
+        }
+    }
+    best_learner.alpha = 0.5 * std::log((1 - best_error) / (best_error + 1e-10));
+    return best_learner;
+}
+
+double weighted_error(const MatrixXd& data, const VectorXd& labels, const VectorXd& weights, const WeakLearner& learner) {
+    ArrayXd predictions = (data.col(learner.feature_index).array() <= learner.threshold).cast<double>() * 2 - 1;
+    if (learner.alpha < 0) predictions = -predictions;
+    return (weights.array() * (predictions != labels.array()).cast<double>()).sum();
+}
+
+void update_weights(const MatrixXd& data, const VectorXd& labels, const WeakLearner& learner, VectorXd& weights) {
+    VectorXd predictions = (data.col(learner.feature_index).array() <= learner.threshold).cast<double>() * 2 - 1;
+    weights.array() *= (-learner.alpha * labels.array() * predictions.array()).exp();
+    weights /= weights.sum();
+}
+
+// Labels from a noisy rule over a few features; the first feature is coarsely
+// quantized so thresholds see long runs of equal values
+void make_data(int rows, int features, std::mt19937_64& rng, MatrixXd& X, VectorXd& y) {
+    std::normal_distribution<double> normal(0.0, 1.0);
+    X = MatrixXd::NullaryExpr(rows, features, [&]() { return normal(rng); });
+    X.col(0) = (X.col(0) * 4.0).array().round() / 4.0;
+    y.resize(rows);
+    for (int i = 0; i < rows; ++i) {
+        double score = X(i, 0) - 0.5 * X(i, 1) + 0.7 * std::abs(X(i, 2)) - 0.5 + 0.5 * normal(rng);
+        y(i) = score >= 0 ? 1.0 : -1.0;
+    }
+}
+
+template <typename Fn>
+double seconds(Fn&& fn) {
+    auto start = std::chrono::steady_clock::now();
+    fn();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+std::vector<WeakLearner> boost_stumps(const MatrixXd& X, const VectorXd& y, int rounds, ThreadPool* pool,
+                                      double& sort_seconds) {
+    std::vector<WeakLearner> learners;
+    VectorXd weights = VectorXd::Ones(X.rows()) / X.rows();
+    std::unique_ptr<StumpLearner> stumps;
+    sort_seconds = seconds([&]() { stumps = std::make_unique<StumpLearner>(X, y, pool); });
+    for (int t = 0; t < rounds; ++t) {
+        learners.push_back(stumps->train(weights));
+        update_weights(X, y, learners.back(), weights);
+    }
+    return learners;
+}
+
+bool same_stumps(const std::vector<WeakLearner>& a, const std::vector<WeakLearner>& b) {
+    if (a.size() != b.size()) return false;
+    for (size_t i = 0; i < a.size(); ++i) {
+        if (a[i].feature_index != b[i].feature_index || a[i].threshold != b[i].threshold || a[i].alpha != b[i].alpha) {
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    int baseline_rows = argc > 1 ? std::stoi(argv[1]) : 2000;
+    int rows = argc > 2 ? std::stoi(argv[2]) : 200000;
+    int features = argc > 3 ? std::stoi(argv[3]) : 200;
+    int rounds = argc > 4 ? std::stoi(argv[4]) : 100;
+
+    std::mt19937_64 rng(11);
+    std::cout << std::fixed << std::setprecision(4);
+
+    // Same rounds with both searches: the presorted one also considers the
+    // reversed polarity, so its error is never higher
+    MatrixXd X;
+    VectorXd y;
+    make_data(baseline_rows, 8, rng, X, y);
+    const int baseline_rounds = 10;
+    VectorXd weights = VectorXd::Ones(X.rows()) / X.rows();
+    StumpLearner stumps(X, y);
+    double exhaustive_seconds = 0.0, presorted_seconds = 0.0;
+    bool never_worse = true;
+    for (int t = 0; t < baseline_rounds; ++t) {
+        WeakLearner exhaustive, presorted;
+        exhaustive_seconds += seconds([&]() { exhaustive = train_weak_learner(X, y, weights); });
+        presorted_seconds += seconds([&]() { presorted = stumps.train(weights); });
+        never_worse &= weighted_error(X, y, weights, presorted) <= weighted_error(X, y, weights, exhaustive) + 1e-12;
+        update_weights(X, y, presorted, weights);
+    }
+    std::cout << "[INFO] " << baseline_rounds << " rounds, " << baseline_rows << " rows x 8 features" << std::endl;
+    std::cout << "  exhaustive " << exhaustive_seconds << " s   presorted " << presorted_seconds << " s   speedup "
+              << std::setprecision(0) << exhaustive_seconds / presorted_seconds << "x   "
+              << (never_worse ? "error never higher" : "ERROR HIGHER") << std::setprecision(4) << std::endl;
+
+    // Boosting at scale on pools of growing size
+    make_data(rows, features, rng, X, y);
+    std::cout << "\n[INFO] " << rounds << " rounds, " << rows << " rows x " << features << " features ("
+              << std::thread::hardware_concurrency() << " hardware threads)" << std::endl;
+    double sort_seconds = 0.0;
+    std::vector<WeakLearner> reference;
+    double serial = seconds([&]() { reference = boost_stumps(X, y, rounds, nullptr, sort_seconds); });
+    std::cout << std::setw(9) << "serial" << std::setw(10) << serial << " s   (sort " << sort_seconds << " s, "
+              << (serial - sort_seconds) / rounds * 1e3 << " ms/round)" << std::endl;
+    bool deterministic = true;
+    unsigned max_threads = std::max(4u, std::thread::hardware_concurrency());
+    for (unsigned threads = 1; threads <= max_threads; threads *= 2) {
+        ThreadPool pool(threads);
+        std::vector<WeakLearner> learners;
+        double t = seconds([&]() { learners = boost_stumps(X, y, rounds, &pool, sort_seconds); });
+        bool same = same_stumps(learners, reference);
+        deterministic &= same;
+        std::cout << std::setw(9) << threads << std::setw(10) << t << " s   speedup " << std::setprecision(2)
+                  << serial / t << "x   " << (same ? "same stumps" : "STUMPS DIFFER") << std::setprecision(4)
+                  << std::endl;
+    }
+
+    ArrayXd score = ArrayXd::Zero(rows);
+    for (const WeakLearner& learner : reference) {
+        score += learner.alpha * ((X.col(learner.feature_index).array() <= learner.threshold).cast<double>() * 2 - 1);
+    }
+    std::cout << "  training accuracy " << ((score >= 0).cast<double>() * 2 - 1 == y.array()).cast<double>().mean()
+              << std::endl;
+    return never_worse && deterministic ? 0 : 1;
+}
@@ -3,52 +3,26 @@
 #include <random>
 #include <boost/asio.hpp>
 #include <Eigen/Dense>
+#include "../common/perf_counters.hpp"
+#include "../common/trace.hpp"
+#include "../common/wire_protocol.hpp"
+#include "stump_learner.hpp"  // Presorted stump search
 
 using namespace Eigen;
 using boost::asio::ip::tcp;
 
-// Structure to represent a weak learner (decision stump)
-struct WeakLearner {
-    int feature_index;
-    double threshold;
-    double alpha; // Weight of the weak learner in the ensemble
-};
-
-// Train a weak learner (decision stump)
-WeakLearner train_weak_learner(const MatrixXd& data, const VectorXd& labels, const VectorXd& weights) {
-    int n_samples = data.rows();
-    int n_features = data.cols();
-    WeakLearner best_learner = {0, 0, 0};
-    double best_error = std::numeric_limits<double>::max();
-
-    // Loop over each feature to find the best threshold
-    for (int feature_index = 0; feature_index < n_features; ++feature_index) {
-        for (int i = 0; i < n_samples; ++i) {
-            double threshold = data(i, feature_index);
-            VectorXd predictions = (data.col(feature_index).array() <= threshold).cast<double>() * 2 - 1;
-
-            // Compute weighted error
-            double weighted_error = (weights.array() * (predictions.array() != labels.array()).cast<double>()).sum();
-
-            if (weighted_error < best_error) {
-                best_error = weighted_error;
-                best_learner = {feature_index, threshold, 0};
-            }
-        }
-    }
-
-    // Calculate the alpha (weight of the weak learner)
-    best_learner.alpha = 0.5 * std::log((1 - best_error) / (best_error + 1e-10));
-    return best_learner;
-}
-
-// Train AdaBoost on local data
-std::vector<WeakLearner> train_adaboost(const MatrixXd& data, const VectorXd& labels, int num_learners) {
+// Train AdaBoost on local data. The features are sorted once for all rounds,
+// and each round's stump search runs over the features on the pool
+std::vector<WeakLearner> train_adaboost(const MatrixXd& data, const VectorXd& labels, int num_learners,
+                                        ThreadPool* pool = nullptr) {
+    TRACE_SCOPE("train_adaboost");
+    PERF_SCOPE("train_adaboost");
     std::vector<WeakLearner> learners;
     VectorXd weights = VectorXd::Ones(data.rows()) / data.rows(); // Initialize weights
+    StumpLearner stumps(data, labels, pool);
 
     for (int t = 0; t < num_learners; ++t) {
-        WeakLearner learner = train_weak_learner(data, labels, weights);
+        WeakLearner learner = stumps.train(weights);
         learners.push_back(learner);
 
         // Update sample weights
@@ -62,6 +36,7 @@ std::vector<WeakLearner> train_adaboost(const MatrixXd& data, const VectorXd& la
 
 // Serialize weak learners
 std::vector<double> serialize_learners(const std::vector<WeakLearner>& learners) {
+    TRACE_SCOPE("serialize");
     std::vector<double> serialized;
     for (const auto& learner : learners) {
         serialized.push_back(learner.feature_index);
@@ -76,6 +51,8 @@ int main() {
     tcp::socket socket(io_service);
     tcp::resolver resolver(io_service);
     boost::asio::connect(socket, resolver.resolve({"127.0.0.1", "8080"}));
+    TRACE_PROCESS("Adaboost client", trace_client_id(socket.local_endpoint()));
+    TRACE_ROUND(0);
 
     // Load local data
     MatrixXd data(4, 2); // Example data (4 samples, 2 features)
@@ -87,17 +64,16 @@ int main() {
     labels << 1, 1, -1, -1;
 
     // Train AdaBoost on local data
-    std::vector<WeakLearner> learners = train_adaboost(data, labels, 5);
+    ThreadPool pool;
+    std::vector<WeakLearner> learners = train_adaboost(data, labels, 5, &pool);
 
     // Serialize the learners
     std::vector<double> serialized_learners = serialize_learners(learners);
 
-    // Send the number of learners to the server
+    // Send the learners as one frame: 3 values (feature_index, threshold, alpha) per learner
     int num_learners = learners.size();
-    boost::asio::write(socket, boost::asio::buffer(&num_learners, sizeof(int)));
-
-    // Send the serialized learners to the server
-    boost::asio::write(socket, boost::asio::buffer(serialized_learners.data(), serialized_learners.size() * sizeof(double)));
+    write_frame(socket, frame_header(MessageType::Ensemble, 0, 3, num_learners, data.rows()),
+                boost::asio::buffer(serialized_learners));
 
     std::cout << "AdaBoost model has been sent to the server.\n";
 
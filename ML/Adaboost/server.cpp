@@ -1,30 +1,42 @@
 #include <iostream>
 #include <vector>
+#include <cmath>
+#include <limits>
 #include <thread>
+#include <utility>
 #include <boost/asio.hpp>
 #include <mutex>
 #include <Eigen/Dense>
-#include <map>
+#include "../common/async_server.hpp"
+#include "../common/perf_counters.hpp"
+#include "../common/trace.hpp"
+#include "../common/wire_protocol.hpp"
+#include "../common/atomic_snapshot.hpp"
+#include "../common/thread_pool.hpp"
+#include "stump_ensemble.hpp"
 
 using namespace Eigen;
 using boost::asio::ip::tcp;
 
-// Structure to represent a weak learner (decision stump)
-struct WeakLearner {
-    int feature_index;
-    double threshold;
-    double alpha; // Weight of the weak learner in the ensemble
-};
-
 std::mutex model_mutex;
-std::vector<WeakLearner> aggregated_learners; // Store all weak learners from clients
+EnsembleBuilder ensemble_builder;  // Merged stumps of all clients, guarded by model_mutex
+size_t learners_received = 0;
+size_t stump_budget = 1024;        // Stumps kept in the compiled ensemble
+
+// Pruned, compiled ensemble, swapped in atomically after every client
+AtomicSnapshot<StumpEnsemble> ensemble;
+ThreadPool prediction_pool;  // Scores snapshots off the session threads
 
 // Deserialize weak learners
 std::vector<WeakLearner> deserialize_learners(const std::vector<double>& serialized_learners, int num_learners) {
     std::vector<WeakLearner> learners;
     for (int i = 0; i < num_learners; ++i) {
+        double feature = serialized_learners[3 * i];
+        if (!(feature >= 0 && feature <= std::numeric_limits<int>::max()) || feature != std::floor(feature)) {
+            throw std::runtime_error("Invalid feature index in ensemble payload");
+        }
         WeakLearner learner;
-        learner.feature_index = serialized_learners[3 * i];
+        learner.feature_index = int(feature);
         learner.threshold = serialized_learners[3 * i + 1];
         learner.alpha = serialized_learners[3 * i + 2];
         learners.push_back(learner);
@@ -32,77 +44,85 @@ std::vector<WeakLearner> deserialize_learners(const std::vector<double>& seriali
     return learners;
 }
 
-// Predict using AdaBoost ensemble
-double predict_adaboost(const MatrixXd& data, const std::vector<WeakLearner>& learners, int sample_index) {
-    double prediction = 0.0;
-    for (const auto& learner : learners) {
-        double stump_prediction = (data(sample_index, learner.feature_index) <= learner.threshold) ? 1 : -1;
-        prediction += learner.alpha * stump_prediction;
+// Function to perform predictions on a published ensemble
+void perform_predictions(const StumpEnsemble& model) {
+    TRACE_SCOPE("predict");
+    PERF_SCOPE("predict");
+    MatrixXd test_data(4, 2);  // Example test data
+    test_data << 1, 2,
+                 2, 1,
+                 3, 4,
+                 4, 3;
+
+    std::vector<double> predictions = model.predict(test_data, &prediction_pool);
+
+    std::cout << "Predictions for test data (" << model.stumps() << " stumps):\n";
+    for (size_t i = 0; i < predictions.size(); ++i) {
+        std::cout << "Sample " << i << ": " << predictions[i] << std::endl;
     }
-    return prediction >= 0 ? 1 : -1;
 }
 
 // Handle client function: Deserialize and store weak learners from the client
-void handle_client(tcp::socket socket) {
+awaitable<void> handle_client(tcp::socket socket) {
     try {
+        TRACE_CLIENT(client, socket.remote_endpoint());
         std::cout << "[DEBUG] Handling new client connection.\n";
 
-        // Read the number of learners from the client
-        int num_learners;
-        boost::asio::read(socket, boost::asio::buffer(&num_learners, sizeof(int)));
-
-        // Read the serialized learners
-        std::vector<double> serialized_learners(num_learners * 3); // Each learner has 3 components (feature_index, threshold, alpha)
-        boost::asio::read(socket, boost::asio::buffer(serialized_learners.data(), serialized_learners.size() * sizeof(double)));
-
-        // Deserialize the learners
-        std::vector<WeakLearner> learners = deserialize_learners(serialized_learners, num_learners);
-
-        // Lock and aggregate the weak learners
-        {
-            std::lock_guard<std::mutex> lock(model_mutex);
-            aggregated_learners.insert(aggregated_learners.end(), learners.begin(), learners.end());
+        while (true) {
+            // Each ensemble is one frame with a column of (feature_index, threshold, alpha) per learner
+            std::optional<FrameHeader> header = co_await async_read_frame_header(socket);
+            if (!header) break;
+            expect_frame(*header, MessageType::Ensemble);
+            if (header->rows != 3) throw std::runtime_error("Each weak learner must have 3 components");
+            int num_learners = header->cols;
+
+            // Read the serialized learners
+            std::vector<double> serialized_learners(size_t(num_learners) * 3);
+            co_await async_read_frame_payload(socket, *header, asio::buffer(serialized_learners));
+
+            // Deserialize the learners
+            std::vector<WeakLearner> learners = deserialize_learners(serialized_learners, num_learners);
+
+            // Lock and merge the weak learners, each client weighted by its
+            // sample count, then compile and publish the pruned ensemble
+            std::shared_ptr<const StumpEnsemble> model;
+            bool ready;
+            {
+                TRACE_SCOPE_TAGGED("merge_ensemble", header->round, client);
+                PERF_SCOPE("merge_ensemble");
+                std::lock_guard<std::mutex> lock(model_mutex);
+                ensemble_builder.add(learners, double(std::max<uint64_t>(header->samples, 1)));
+                learners_received += learners.size();
+                model = std::make_shared<const StumpEnsemble>(ensemble_builder.select(stump_budget));
+                ensemble.store(model);
+                ready = learners_received >= 5;  // Example condition to start predictions
+            }
+
+            // Run the predictions on the pool once enough models have arrived
+            if (ready) prediction_pool.submit([model]() { perform_predictions(*model); });
+
+            std::cout << "[DEBUG] Received and stored " << num_learners << " weak learners from a client.\n";
         }
 
-        std::cout << "[DEBUG] Received and stored weak learners from a client.\n";
-
     } catch (std::exception& e) {
         std::cerr << "Error: " << e.what() << "\n";
     }
 }
 
-// Function to perform predictions
-void perform_predictions() {
-    if (aggregated_learners.size() >= 5) {  // Example condition to start predictions
-        MatrixXd test_data(4, 2);  // Example test data
-        test_data << 1, 2,
-                     2, 1,
-                     3, 4,
-                     4, 3;
-
-        std::cout << "Predictions for test data:\n";
-        for (int i = 0; i < test_data.rows(); ++i) {
-            double prediction = predict_adaboost(test_data, aggregated_learners, i);
-            std::cout << "Sample " << i << ": " << prediction << std::endl;
-        }
-    }
-}
-
-int main() {
-    boost::asio::io_service io_service;
-    tcp::acceptor acceptor(io_service, tcp::endpoint(tcp::v4(), 8080));
-
-    std::cout << "Server is running on port 8080...\n";
+// Usage: ./server [stump_budget]
+int main(int argc, char** argv) {
+    try {
+        if (argc > 1) stump_budget = std::stoul(argv[1]);
+        TRACE_PROCESS("Adaboost server", -1);
 
-    while (true) {
-        tcp::socket socket(io_service);
-        acceptor.accept(socket);
+        // Sessions run as coroutines on a fixed thread pool, one strand per connection
+        AsyncServer server(8080, handle_client);
 
-        // Handle each client in a separate thread
-        std::thread(handle_client, std::move(socket)).detach();
+        std::cout << "Server is running on port 8080...\n";
 
-        // After handling clients, call the prediction function if conditions are met
-        perform_predictions();
+        server.run();
+    } catch (std::exception& e) {
+        std::cerr << "Error: " << e.what() << "\n";
     }
 
     return 0;
@@ -0,0 +1,211 @@
+#pragma once
+
+// Server-side AdaBoost ensemble: merging client stumps and batched scoring.
+//
+// EnsembleBuilder accumulates the stumps of every client. Stumps that share
+// (feature, threshold) make the same prediction for every row, so they merge
+// exactly into one stump with the sum of their alphas. Each client's alphas
+// are rescaled on arrival so that its whole ensemble carries a vote
+// proportional to its sample count, instead of to however many rounds it
+// boosted. select() prunes the merged set to a budget by keeping the stumps
+// with the largest |alpha|; the full merged set is kept, so later clients still
+// merge exactly.
+//
+// StumpEnsemble compiles a selection for scoring. A stump (t, alpha) adds
+// +alpha when x <= t and -alpha otherwise, so all stumps of one feature,
+// sorted by threshold, contribute
+//
+//     2 * (sum of alpha over thresholds >= x) - (sum of all their alphas)
+//
+// which is one table lookup at lower_bound(x). A row's score is one binary
+// search per feature instead of a pass over every stump. score() runs the
+// searches for a block of rows column by column; with AVX2 four rows search
+// in lockstep using gathers and their table values are accumulated in one
+// vector. Blocks of rows are spread over a ThreadPool when one is given.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <map>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+#include <Eigen/Dense>
+#include "../common/thread_pool.hpp"
+#include "stump_learner.hpp"  // WeakLearner
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+class EnsembleBuilder {
+public:
+    // Add one client's stumps, rescaled to a total |alpha| of `weight`
+    void add(const std::vector<WeakLearner>& learners, double weight) {
+        double total = 0.0;
+        for (const WeakLearner& learner : learners) {
+            if (learner.feature_index < 0 || !std::isfinite(learner.threshold) || !std::isfinite(learner.alpha)) {
+                throw std::runtime_error("Invalid weak learner in ensemble payload");
+            }
+            total += std::abs(learner.alpha);
+        }
+        ++clients_;
+        if (total == 0.0) return;
+        for (const WeakLearner& learner : learners) {
+            alphas_[{learner.feature_index, learner.threshold}] += learner.alpha * (weight / total);
+        }
+    }
+
+    size_t clients() const { return clients_; }
+    size_t stumps() const { return alphas_.size(); }
+
+    // The merged stumps with the largest |alpha|, at most `budget` of them
+    // (0 keeps all); ties keep the lower (feature, threshold)
+    std::vector<WeakLearner> select(size_t budget = 0) const {
+        std::vector<WeakLearner> stumps;
+        for (const auto& [key, alpha] : alphas_) {
+            if (alpha != 0.0) stumps.push_back({key.first, key.second, alpha});
+        }
+        if (budget == 0 || stumps.size() <= budget) return stumps;
+        std::stable_sort(stumps.begin(), stumps.end(), [](const WeakLearner& a, const WeakLearner& b) {
+            return std::abs(a.alpha) > std::abs(b.alpha);
+        });
+        stumps.resize(budget);
+        return stumps;
+    }
+
+private:
+    std::map<std::pair<int, double>, double> alphas_;  // Merged alpha per (feature, threshold)
+    size_t clients_ = 0;
+};
+
+class StumpEnsemble {
+public:
+    // Rows scored together; their scores stay in L1 while every table is applied
+    static const Eigen::Index BLOCK_ROWS = 1024;
+
+    StumpEnsemble() = default;
+
+    // Stumps may repeat (feature, threshold); they are merged
+    explicit StumpEnsemble(const std::vector<WeakLearner>& learners) {
+        std::map<int, std::map<double, double>> by_feature;
+        for (const WeakLearner& learner : learners) {
+            if (learner.feature_index < 0) throw std::invalid_argument("Invalid feature index in stump");
+            by_feature[learner.feature_index][learner.threshold] += learner.alpha;
+        }
+        for (const auto& [feature, stumps] : by_feature) {
+            Table table{feature, int32_t(thresholds_.size()), int32_t(stumps.size()), int32_t(values_.size())};
+            double total = 0.0;
+            for (const auto& [threshold, alpha] : stumps) {
+                thresholds_.push_back(threshold);
+                total += alpha;
+            }
+            // values[j] for x with lower_bound j: 2 * (alphas from j on) - total
+            values_.resize(values_.size() + stumps.size() + 1);
+            double* values = &values_[table.values];
+            double suffix = 0.0;
+            values[stumps.size()] = -total;
+            auto it = stumps.rbegin();
+            for (size_t j = stumps.size(); j-- > 0; ++it) {
+                suffix += it->second;
+                values[j] = 2.0 * suffix - total;
+            }
+            tables_.push_back(table);
+            stumps_ += stumps.size();
+            max_feature_ = std::max(max_feature_, feature);
+        }
+    }
+
+    size_t stumps() const { return stumps_; }
+
+    // Weighted vote sum(alpha * stump(x)) of every row of X
+    Eigen::VectorXd score(const Eigen::MatrixXd& X, ThreadPool* pool = nullptr) const {
+        if (max_feature_ >= X.cols()) throw std::invalid_argument("Rows have fewer features than the ensemble uses");
+        Eigen::VectorXd scores = Eigen::VectorXd::Zero(X.rows());
+        if (pool && X.rows() > BLOCK_ROWS) {
+            TaskGroup blocks(*pool);
+            for (Eigen::Index begin = 0; begin < X.rows(); begin += BLOCK_ROWS) {
+                blocks.run([&, begin]() { score_block(X, begin, std::min(X.rows(), begin + BLOCK_ROWS), scores.data()); });
+            }
+            blocks.wait();
+        } else {
+            for (Eigen::Index begin = 0; begin < X.rows(); begin += BLOCK_ROWS) {
+                score_block(X, begin, std::min(X.rows(), begin + BLOCK_ROWS), scores.data());
+            }
+        }
+        return scores;
+    }
+
+    // Class of every row of X: 1 for a non-negative score, otherwise -1
+    std::vector<double> predict(const Eigen::MatrixXd& X, ThreadPool* pool = nullptr) const {
+        Eigen::VectorXd scores = score(X, pool);
+        std::vector<double> predictions(X.rows());
+        for (Eigen::Index i = 0; i < X.rows(); ++i) predictions[i] = scores(i) >= 0 ? 1 : -1;
+        return predictions;
+    }
+
+private:
+    struct Table {
+        int32_t feature;
+        int32_t begin;   // First threshold in thresholds_, ascending
+        int32_t count;
+        int32_t values;  // First of count + 1 entries in values_
+    };
+
+    void score_block(const Eigen::MatrixXd& X, Eigen::Index begin, Eigen::Index end, double* scores) const {
+        for (const Table& table : tables_) {
+            const double* thresholds = &thresholds_[table.begin];
+            const double* values = &values_[table.values];
+            const double* x = X.col(table.feature).data();
+            Eigen::Index i = begin;
+
+#if defined(__AVX2__)
+            const __m256i low_halves = _mm256_setr_epi32(0, 2, 4, 6, 0, 0, 0, 0);
+            const __m128i nan_position = _mm_set1_epi32(table.count);
+            // 64-bit lane mask of a compare as 32-bit lanes
+            auto narrow = [&](__m256d mask) {
+                return _mm256_castsi256_si128(_mm256_permutevar8x32_epi32(_mm256_castpd_si256(mask), low_halves));
+            };
+            for (; i + 4 <= end; i += 4) {
+                __m256d xs = _mm256_loadu_pd(x + i);
+                // Branchless lower_bound: the same halving steps for all four rows
+                __m128i position = _mm_setzero_si128();
+                int32_t n = table.count;
+                while (n > 1) {
+                    int32_t half = n / 2;
+                    __m128i probe = _mm_add_epi32(position, _mm_set1_epi32(half - 1));
+                    __m256d below = _mm256_cmp_pd(_mm256_i32gather_pd(thresholds, probe, 8), xs, _CMP_LT_OQ);
+                    position = _mm_add_epi32(position, _mm_and_si128(narrow(below), _mm_set1_epi32(half)));
+                    n -= half;
+                }
+                __m256d below = _mm256_cmp_pd(_mm256_i32gather_pd(thresholds, position, 8), xs, _CMP_LT_OQ);
+                position = _mm_sub_epi32(position, narrow(below));
+                // NaN is above every threshold
+                position = _mm_blendv_epi8(position, nan_position, narrow(_mm256_cmp_pd(xs, xs, _CMP_UNORD_Q)));
+                __m256d sum = _mm256_add_pd(_mm256_loadu_pd(scores + i), _mm256_i32gather_pd(values, position, 8));
+                _mm256_storeu_pd(scores + i, sum);
+            }
+#endif
+
+            for (; i < end; ++i) scores[i] += values[lower_bound(thresholds, table.count, x[i])];
+        }
+    }
+
+    // Number of thresholds below x, without the unpredictable branch per halving step
+    static int32_t lower_bound(const double* thresholds, int32_t count, double x) {
+        if (std::isnan(x)) return count;
+        const double* base = thresholds;
+        int32_t n = count;
+        while (n > 1) {
+            int32_t half = n / 2;
+            base = base[half - 1] < x ? base + half : base;
+            n -= half;
+        }
+        return int32_t(base - thresholds) + (*base < x);
+    }
+
+    std::vector<Table> tables_;       // One per feature with stumps, by feature
+    std::vector<double> thresholds_;
+    std::vector<double> values_;
+    size_t stumps_ = 0;
+    int max_feature_ = -1;
+};
@@ -0,0 +1,206 @@
+#pragma once
+
+// Decision stump search over presorted features.
+//
+// Every feature is sorted once per dataset; the sorted row order is kept for
+// all boosting rounds. With sorted values, the stump "x <= threshold -> +1,
+// else -1" at the k-th smallest value has weighted error
+//
+//     err(k) = P - s(k),   s(k) = sum of w_i * y_i over the k smallest rows
+//
+// where P is the weight of the +1 rows, and the reversed stump (-1 at or below
+// the threshold) has error W - err(k). One prefix sum over the round's w * y
+// in sorted order therefore scores every threshold of both polarities: the
+// largest s(k) is the best stump and the smallest the best reversed one. Only
+// positions at the end of a run of equal values are thresholds, which is
+// marked in the top bit of the stored row index.
+//
+// With AVX2 the sweep gathers four w * y values at a time and scans them in
+// registers; features are spread over a ThreadPool when one is given. The
+// chosen stump does not depend on the number of threads.
+//
+// The order takes 4 bytes per value: 160 MB for 200k rows x 200 features.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+#include <Eigen/Dense>
+#include "../common/thread_pool.hpp"
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+// Structure to represent a weak learner (decision stump). It predicts
+// sign(alpha) for x <= threshold and -sign(alpha) above it, so a stump of
+// reversed polarity is sent as a negative alpha
+struct WeakLearner {
+    int feature_index;
+    double threshold;
+    double alpha; // Weight of the weak learner in the ensemble
+};
+
+class StumpLearner {
+public:
+    StumpLearner(const Eigen::MatrixXd& data, const Eigen::VectorXd& labels, ThreadPool* pool = nullptr)
+        : data_(data), labels_(labels), pool_(pool), order_(size_t(data.rows()) * data.cols()) {
+        if (labels.size() != data.rows()) throw std::invalid_argument("Labels do not match the data");
+        if (data.rows() == 0 || data.cols() == 0) throw std::invalid_argument("Cannot train a stump without data");
+        if (uint64_t(data.rows()) > LAST_OF_RUN) throw std::invalid_argument("Too many rows for a stump learner");
+        // (value, row) pairs sort contiguously, and equal values by row
+        for_each_feature([&](Eigen::Index f) {
+            std::vector<std::pair<double, uint32_t>> sorted(data_.rows());
+            for (Eigen::Index i = 0; i < data_.rows(); ++i) sorted[i] = {data_(i, f), uint32_t(i)};
+            std::sort(sorted.begin(), sorted.end());
+            uint32_t* order = &order_[size_t(f) * data_.rows()];
+            for (Eigen::Index k = 0; k < data_.rows(); ++k) {
+                bool last = k + 1 == data_.rows() || sorted[k].first != sorted[k + 1].first;
+                order[k] = sorted[k].second | (last ? LAST_OF_RUN : 0u);
+            }
+        });
+    }
+
+    // Best stump of either polarity for sample weights that sum to 1
+    WeakLearner train(const Eigen::VectorXd& weights) const {
+        if (weights.size() != data_.rows()) throw std::invalid_argument("Weights do not match the data");
+        Eigen::VectorXd signed_weights = (labels_.array() > 0).select(weights, -weights);
+        const double positive = (labels_.array() > 0).select(weights, 0.0).sum();
+        const double total = weights.sum();
+
+        std::vector<Sweep> sweeps(data_.cols());
+        for_each_feature([&](Eigen::Index f) { sweeps[f] = sweep(f, signed_weights.data()); });
+
+        // Lowest error; ties go to the lower feature and the stump before its reversal
+        double best_error = std::numeric_limits<double>::max();
+        WeakLearner best = {0, 0.0, 0.0};
+        double polarity = 1.0;
+        for (Eigen::Index f = 0; f < data_.cols(); ++f) {
+            const Sweep& s = sweeps[f];
+            double error = positive - s.max;
+            if (error < best_error) {
+                best_error = error;
+                best = {int(f), threshold(f, s.max_at), 0.0};
+                polarity = 1.0;
+            }
+            error = total - positive + s.min;
+            if (error < best_error) {
+                best_error = error;
+                best = {int(f), threshold(f, s.min_at), 0.0};
+                polarity = -1.0;
+            }
+        }
+
+        // Calculate the alpha (weight of the weak learner)
+        best_error = std::max(best_error, 0.0);
+        best.alpha = polarity * 0.5 * std::log((1 - best_error) / (best_error + 1e-10));
+        return best;
+    }
+
+private:
+    static const uint32_t LAST_OF_RUN = 0x80000000u;
+    static const uint32_t ROW_MASK = 0x7fffffffu;
+
+    // Extremes of the prefix sums s(k) over the threshold positions of a feature
+    struct Sweep {
+        double max = -std::numeric_limits<double>::infinity();
+        double min = std::numeric_limits<double>::infinity();
+        Eigen::Index max_at = 0;
+        Eigen::Index min_at = 0;
+    };
+
+    template <typename Fn>
+    void for_each_feature(Fn&& fn) const {
+        if (pool_ && data_.cols() > 1) {
+            TaskGroup features(*pool_);
+            for (Eigen::Index f = 0; f < data_.cols(); ++f) features.run([&fn, f]() { fn(f); });
+            features.wait();
+        } else {
+            for (Eigen::Index f = 0; f < data_.cols(); ++f) fn(f);
+        }
+    }
+
+    double threshold(Eigen::Index feature, Eigen::Index position) const {
+        return data_(order_[size_t(feature) * data_.rows() + position] & ROW_MASK, feature);
+    }
+
+    // The first position with the extreme value wins, as in a sequential scan
+    Sweep sweep(Eigen::Index feature, const double* signed_weights) const {
+        const uint32_t* order = &order_[size_t(feature) * data_.rows()];
+        const Eigen::Index n = data_.rows();
+        Sweep result;
+        double sum = 0.0;
+        Eigen::Index k = 0;
+
+#if defined(__AVX2__)
+        const __m128i row_mask = _mm_set1_epi32(int(ROW_MASK));
+        const __m256d zero = _mm256_setzero_pd();
+        const __m256d none_max = _mm256_set1_pd(-std::numeric_limits<double>::infinity());
+        const __m256d none_min = _mm256_set1_pd(std::numeric_limits<double>::infinity());
+        __m256d carry = zero;
+        __m256d best_max = none_max, best_min = none_min;
+        __m256d max_at = zero, min_at = zero;
+        __m256d position = _mm256_set_pd(3.0, 2.0, 1.0, 0.0);
+        const __m256d step = _mm256_set1_pd(4.0);
+        for (; k + 4 <= n; k += 4) {
+            __m128i packed = _mm_loadu_si128(reinterpret_cast<const __m128i*>(order + k));
+            // Run ends have the sign bit set; widen it to a 64-bit lane mask
+            __m256d last = _mm256_castsi256_pd(_mm256_cvtepi32_epi64(_mm_srai_epi32(packed, 31)));
+            __m256d v = _mm256_i32gather_pd(signed_weights, _mm_and_si128(packed, row_mask), 8);
+
+            // Inclusive prefix sum of the four lanes, then the running total
+            v = _mm256_add_pd(v, _mm256_blend_pd(_mm256_permute4x64_pd(v, _MM_SHUFFLE(2, 1, 0, 0)), zero, 0x1));
+            v = _mm256_add_pd(v, _mm256_blend_pd(_mm256_permute4x64_pd(v, _MM_SHUFFLE(1, 0, 0, 0)), zero, 0x3));
+            v = _mm256_add_pd(v, carry);
+            carry = _mm256_permute4x64_pd(v, _MM_SHUFFLE(3, 3, 3, 3));
+
+            __m256d higher = _mm256_and_pd(last, _mm256_cmp_pd(v, best_max, _CMP_GT_OQ));
+            best_max = _mm256_blendv_pd(best_max, v, higher);
+            max_at = _mm256_blendv_pd(max_at, position, higher);
+            __m256d lower = _mm256_and_pd(last, _mm256_cmp_pd(v, best_min, _CMP_LT_OQ));
+            best_min = _mm256_blendv_pd(best_min, v, lower);
+            min_at = _mm256_blendv_pd(min_at, position, lower);
+            position = _mm256_add_pd(position, step);
+        }
+        alignas(32) double lanes[4][4];
+        _mm256_store_pd(lanes[0], best_max);
+        _mm256_store_pd(lanes[1], max_at);
+        _mm256_store_pd(lanes[2], best_min);
+        _mm256_store_pd(lanes[3], min_at);
+        for (int lane = 0; lane < 4; ++lane) {
+            Eigen::Index at = Eigen::Index(lanes[1][lane]);
+            if (lanes[0][lane] > result.max || (lanes[0][lane] == result.max && at < result.max_at)) {
+                result.max = lanes[0][lane];
+                result.max_at = at;
+            }
+            at = Eigen::Index(lanes[3][lane]);
+            if (lanes[2][lane] < result.min || (lanes[2][lane] == result.min && at < result.min_at)) {
+                result.min = lanes[2][lane];
+                result.min_at = at;
+            }
+        }
+        sum = _mm256_cvtsd_f64(carry);
+#endif
+
+        for (; k < n; ++k) {
+            sum += signed_weights[order[k] & ROW_MASK];
+            if (!(order[k] & LAST_OF_RUN)) continue;
+            if (sum > result.max) {
+                result.max = sum;
+                result.max_at = k;
+            }
+            if (sum < result.min) {
+                result.min = sum;
+                result.min_at = k;
+            }
+        }
+        return result;
+    }
+
+    const Eigen::MatrixXd& data_;
+    const Eigen::VectorXd& labels_;
+    ThreadPool* pool_;
+    std::vector<uint32_t> order_;  // Rows of each feature by ascending value, LAST_OF_RUN flagged
+};
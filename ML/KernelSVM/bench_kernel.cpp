@@ -0,0 +1,82 @@
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <Eigen/Dense>
+#include "rbf_kernel_engine.hpp"
+
+using namespace Eigen;
+// g++ -O3 -march=native -std=c++17 bench_kernel.cpp -o bench_kernel -I /usr/include/eigen3
+// ./bench_kernel [rows] [features] [samples_per_epoch]
+
+// The original per-sample update: two rbf_kernel() calls per (sample, support) pair
+void epoch_baseline(const MatrixXd& data, const VectorXd& labels, VectorXd& weights,
+                    double learning_rate, double gamma, int samples) {
+    VectorXd gradient = VectorXd::Zero(weights.size());
+    for (int i = 0; i < samples; ++i) {
+        VectorXd xi = data.row(i);
+        double yi = labels(i);
+        double kernel_output = 0.0;
+        for (int j = 0; j < weights.size(); ++j) {
+            kernel_output += rbf_kernel(xi, data.row(j), gamma) * weights(j);
+        }
+        if (yi * kernel_output < 1) {
+            for (int j = 0; j < weights.size(); ++j) {
+                gradient(j) += -yi * rbf_kernel(data.row(j), xi, gamma);
+            }
+        }
+        weights -= learning_rate * gradient;
+    }
+}
+
+// The same update with one cached kernel row per sample
+void epoch_engine(RbfKernelEngine& engine, const VectorXd& labels, VectorXd& weights,
+                  double learning_rate, int samples) {
+    VectorXd gradient = VectorXd::Zero(weights.size());
+    for (int i = 0; i < samples; ++i) {
+        auto kernel_row = engine.kernel_row(i);
+        double yi = labels(i);
+        if (yi * kernel_row.dot(weights) < 1) {
+            gradient.noalias() -= yi * kernel_row;
+        }
+        weights.noalias() -= learning_rate * gradient;
+    }
+}
+
+template <typename Fn>
+double seconds(Fn&& fn) {
+    auto start = std::chrono::steady_clock::now();
+    fn();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char** argv) {
+    int rows = argc > 1 ? std::stoi(argv[1]) : 20000;
+    int features = argc > 2 ? std::stoi(argv[2]) : 200;
+    int samples = argc > 3 ? std::stoi(argv[3]) : 100;
+    double gamma = 1.0 / features;
+    double learning_rate = 0.01;
+
+    MatrixXd data = MatrixXd::Random(rows, features);
+    VectorXd labels = (data.col(0).array() > 0).cast<double>() * 2 - 1;
+    VectorXd initial = VectorXd::Random(rows) * 0.01;
+
+    std::cout << "[INFO] " << rows << " rows x " << features << " features, "
+              << samples << " samples per epoch" << std::endl;
+
+    VectorXd w_baseline = initial;
+    double t_baseline = seconds([&]() { epoch_baseline(data, labels, w_baseline, learning_rate, gamma, samples); });
+
+    RbfKernelEngine engine(data, gamma, 100);
+    VectorXd w_cold = initial;
+    double t_cold = seconds([&]() { epoch_engine(engine, labels, w_cold, learning_rate, samples); });
+    VectorXd w_warm = initial;
+    double t_warm = seconds([&]() { epoch_engine(engine, labels, w_warm, learning_rate, samples); });
+
+    std::cout << std::setprecision(4);
+    std::cout << "baseline rbf_kernel loop : " << t_baseline * 1e3 << " ms" << std::endl;
+    std::cout << "engine (cold cache)      : " << t_cold * 1e3 << " ms, " << t_baseline / t_cold << "x" << std::endl;
+    std::cout << "engine (warm cache)      : " << t_warm * 1e3 << " ms, " << t_baseline / t_warm << "x" << std::endl;
+    std::cout << "max |w_baseline - w_engine| = " << (w_baseline - w_cold).cwiseAbs().maxCoeff() << std::endl;
+    return 0;
+}
@@ -0,0 +1,94 @@
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <string>
+#include <sys/stat.h>
+#include <Eigen/Dense>
+#include "data_loader.cpp"           // Original getline/stringstream loader
+#include "../common/binary_dataset.hpp"  // mmap + from_chars loader, binary cache
+
+using namespace Eigen;
+// g++ -O3 -std=c++17 bench_loader.cpp -o bench_loader -I /usr/include/eigen3 -lpthread
+// ./bench_loader [train.csv] [repetitions]
+
+// Time a callable and return the best wall-clock time in seconds
+template <typename Fn>
+double best_of(int repetitions, Fn&& fn) {
+    double best = 1e300;
+    for (int r = 0; r < repetitions; ++r) {
+        auto start = std::chrono::steady_clock::now();
+        fn();
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        best = std::min(best, elapsed.count());
+    }
+    return best;
+}
+
+int main(int argc, char** argv) {
+    std::string filename = argc > 1 ? argv[1] : "train.csv";
+    int repetitions = argc > 2 ? std::stoi(argv[2]) : 3;
+
+    struct stat st;
+    if (stat(filename.c_str(), &st) != 0) {
+        std::cerr << "[ERROR] Could not stat file: " << filename << std::endl;
+        return 1;
+    }
+    double megabytes = st.st_size / (1024.0 * 1024.0);
+    std::cout << "[INFO] Benchmarking " << filename << " (" << std::fixed << std::setprecision(1)
+              << megabytes << " MB), best of " << repetitions << std::endl;
+
+    // Baseline: load_data followed by the element-wise copy the client used to do
+    double checksum_old = 0.0;
+    double t_old = best_of(repetitions, [&]() {
+        std::vector<std::vector<float>> features;
+        std::vector<int> labels;
+        load_data(filename, features, labels);
+
+        MatrixXd local_data(features.size(), features[0].size());
+        for (size_t i = 0; i < features.size(); ++i) {
+            for (size_t j = 0; j < features[i].size(); ++j) {
+                local_data(i, j) = features[i][j];
+            }
+        }
+        checksum_old = local_data.sum();
+    });
+
+    // New loader: parsed straight into the buffer that Eigen maps
+    double checksum_new = 0.0;
+    double t_new = best_of(repetitions, [&]() {
+        CsvDataset<double> dataset = load_csv_mmap<double>(filename);
+        checksum_new = dataset.matrix().sum();
+    });
+
+    double t_new_float = best_of(repetitions, [&]() {
+        CsvDataset<float> dataset = load_csv_mmap<float>(filename);
+        checksum_new += 0.0 * dataset.matrix().sum();
+    });
+
+    // Binary cache: map the file and touch every feature once
+    std::string cache_path = filename + ".bench.bin";
+    {
+        CsvDataset<double> dataset = load_csv_mmap<double>(filename);
+        write_binary_dataset<double>(cache_path, dataset.matrix(), dataset.label_vector());
+    }
+    double t_cache = best_of(repetitions, [&]() {
+        MappedDataset cached(cache_path);
+        checksum_new += 0.0 * cached.features<double>().sum();
+    });
+    std::remove(cache_path.c_str());
+
+    std::cout << std::setprecision(3);
+    std::cout << "load_data + MatrixXd copy : " << t_old << " s, " << megabytes / t_old << " MB/s" << std::endl;
+    std::cout << "load_csv_mmap<double>     : " << t_new << " s, " << megabytes / t_new << " MB/s" << std::endl;
+    std::cout << "load_csv_mmap<float>      : " << t_new_float << " s, " << megabytes / t_new_float << " MB/s" << std::endl;
+    std::cout << "MappedDataset (warm cache): " << t_cache * 1e3 << " ms" << std::endl;
+    std::cout << "Speedup (double)          : " << t_old / t_new << "x" << std::endl;
+
+    // float -> double rounding in the old path means the sums only agree approximately
+    if (std::abs(checksum_old - checksum_new) > 1e-3 * std::max(1.0, std::abs(checksum_old))) {
+        std::cerr << "[ERROR] Checksums differ: " << checksum_old << " vs " << checksum_new << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -3,58 +3,218 @@
 #include <vector>
 #include <algorithm>
 #include <random>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
 #include <boost/asio.hpp>
 #include <Eigen/Dense>
-#include "data_loader.cpp"  // Include the data loader
+#include <sys/stat.h>
+#include "../common/binary_dataset.hpp"  // mmap CSV loader + binary dataset cache
+#include "../common/data_source.hpp"     // Batched, bounded-memory row sources
+#include "rbf_kernel_engine.hpp"         // GEMM-based Gram blocks with an LRU tile cache
+#include "kernel_approximation.hpp"      // Random Fourier / Nystrom feature maps
+#include "../common/wire_protocol.hpp"     // Framed messages with checksums
+#include "../common/update_codec.hpp"      // fp16 / int8 / top-k update compression
+#include "../common/perf_counters.hpp"     // Hardware counters, built with -DFEDML_PERF
+#include "../common/trace.hpp"             // Phase spans, built with -DFEDML_TRACE
 
 using namespace Eigen;
 using boost::asio::ip::tcp;
-// g++ client_updated.cpp -o client  -I /usr/include/eigen3
+// g++ -O2 client_updated.cpp -o client  -I /usr/include/eigen3 -lpthread
 
 const int MAX_EPOCHS = 3;       // Maximum number of epochs
 const double EPSILON = 1e-5;      // Tolerance for convergence
 const int TRAIN_BATCH_SIZE = 100; // Batch size for incremental training
-const int NETWORK_BATCH_SIZE = 100; // Batch size for network transmission
+const int STREAM_BATCH_SIZE = 4096; // Rows per batch read from the data source
+const int KERNEL_TILE_ROWS = 100;   // Samples per cached block of kernel rows
+const size_t KERNEL_CACHE_BYTES = size_t(512) << 20;  // Budget for cached kernel rows
+const uint64_t FEATURE_MAP_SEED = 42;    // Shared by all clients so their feature spaces agree
+const double APPROX_LAMBDA = 1e-4;       // L2 penalty of the linear SVM in feature space
 
-double rbf_kernel(const VectorXd& x1, const VectorXd& x2, double gamma = 0.1) {
-    return std::exp(-gamma * (x1 - x2).squaredNorm());
-}
-
-double compute_loss(const MatrixXd& data, const VectorXd& labels, 
-                    const VectorXd& weights, double gamma) {
+double compute_loss(RbfKernelEngine& engine, const Ref<const VectorXd>& labels, const VectorXd& weights) {
     double loss = 0.0;
-    int n_samples = data.rows();
-
-    for (int i = 0; i < n_samples; ++i) {
-        VectorXd xi = data.row(i);
-        double yi = labels(i);
-        double prediction = 0.0;
+    int n_samples = engine.rows();
 
-        for (int j = 0; j < n_samples; ++j) {
-            prediction += rbf_kernel(xi, data.row(j), gamma) * weights(j);
+    // Predictions for a whole tile of samples at once: K_tile^T * w
+    for (int first = 0; first < n_samples; first += engine.tile_rows()) {
+        VectorXd predictions = engine.tile(first / engine.tile_rows()).transpose() * weights;
+        for (int i = 0; i < predictions.size(); ++i) {
+            loss += std::max(0.0, 1 - labels(first + i) * predictions(i));
         }
-        loss += std::max(0.0, 1 - yi * prediction);
     }
     return loss / n_samples;
 }
 
-void send_in_batches(tcp::socket& socket, const VectorXd& data) {
-    int total_size = data.size();
-    std::cout << "[INFO] Sending data in batches of size: " << NETWORK_BATCH_SIZE << std::endl;
+// Full-duplex model stream to the server. Updates go out as codec-encoded
+// deltas against the newest global model received, tagged with its version.
+// A background I/O thread writes them and keeps reading model broadcasts
+// ahead, so training continues while the previous update is in flight; send()
+// only waits for the previous write, never for a reply. finish() ends the
+// stream explicitly and drains the models still on their way.
+class ModelChannel {
+public:
+    ModelChannel(const tcp::endpoint& server, const CodecOptions& options, Index model_size)
+        : socket_(io_context_), work_(boost::asio::make_work_guard(io_context_)), encoder_(options),
+          reference_(VectorXd::Zero(model_size)), incoming_(model_size) {
+        socket_.connect(server);
+        TRACE_PROCESS("KernelSVM client", trace_client_id(socket_.local_endpoint()));
+        read_header();
+        io_thread_ = std::thread([this]() { io_context_.run(); });
+    }
+
+    ~ModelChannel() {
+        boost::asio::post(io_context_, [this]() {
+            boost::system::error_code ignored;
+            socket_.close(ignored);
+        });
+        work_.reset();
+        io_thread_.join();
+    }
 
-    for (int i = 0; i < total_size; i += NETWORK_BATCH_SIZE) {
-        int batch_size = std::min(NETWORK_BATCH_SIZE, total_size - i);
-        std::cout << "[DEBUG] Sending batch " << (i / NETWORK_BATCH_SIZE) + 1 
-                  << " of size: " << batch_size << std::endl;
+    void send(const VectorXd& weights) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        // The encoder's buffers belong to the previous update until it is written
+        {
+            TRACE_SCOPE("wait_write");
+            idle_.wait(lock, [this]() { return !writing_ || error_; });
+        }
+        if (error_) std::rethrow_exception(error_);
+        delta_ = weights - reference_;
+        int version = reference_version_;
+        writing_ = true;
+        lock.unlock();
+
+        // Later spans belong to training against this model version
+        TRACE_ROUND(version);
+        {
+            TRACE_SCOPE("encode");
+            PERF_SCOPE("encode");
+            payload_ = encoder_.encode(delta_);
+        }
+        out_header_ = update_frame_header(version, weights.size(), 0.0, encoder_.codec(), true);
+        seal_frame_header(out_header_, payload_);
+        boost::asio::post(io_context_, [this]() { write(); });
+        std::cout << "[INFO] Sent " << codec_name(encoder_.codec()) << " update of size " << weights.size()
+                  << " against model version " << version << ": " << payload_.size() << " bytes ("
+                  << weights.size() * sizeof(double) << " raw)" << std::endl;
+    }
 
-        boost::asio::write(socket, boost::asio::buffer(data.data() + i, batch_size * sizeof(double)));
+    // Send end of stream after the last update and wait for the server's
+    void finish() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        idle_.wait(lock, [this]() { return !writing_ || error_; });
+        if (error_) std::rethrow_exception(error_);
+        payload_ = boost::asio::const_buffer();
+        out_header_ = frame_header(MessageType::EndOfStream, 0, 0, 0);
+        seal_frame_header(out_header_, payload_);
+        writing_ = true;
+        boost::asio::post(io_context_, [this]() { write(); });
+
+        idle_.wait(lock, [this]() { return ended_ || error_; });
+        if (error_) std::rethrow_exception(error_);
+        std::cout << "[INFO] Stream ended; " << models_received_ << " global models received, last version "
+                  << reference_version_ << "." << std::endl;
+    }
+
+private:
+    // Handlers below run on the I/O thread, which owns the socket
+
+    void write() {
+        boost::asio::async_write(socket_, frame_buffers(out_header_, payload_),
+                                 [this](const boost::system::error_code& error, size_t) {
+                                     if (error) return fail(error);
+                                     std::lock_guard<std::mutex> lock(mutex_);
+                                     writing_ = false;
+                                     idle_.notify_all();
+                                 });
+    }
+
+    void read_header() {
+        boost::asio::async_read(socket_, boost::asio::buffer(&in_header_, sizeof(in_header_)),
+                                [this](const boost::system::error_code& error, size_t) {
+                                    if (error) return fail(error);
+                                    try {
+                                        validate_frame_header(in_header_);
+                                        if (in_header_.message_type() == MessageType::EndOfStream) {
+                                            expect_frame(in_header_, MessageType::EndOfStream);
+                                            std::lock_guard<std::mutex> lock(mutex_);
+                                            ended_ = true;
+                                            idle_.notify_all();
+                                            return;
+                                        }
+                                        expect_frame(in_header_, MessageType::GlobalModel);
+                                        check_frame_payload(in_header_, frame_buffer(incoming_));
+                                    } catch (const std::exception&) {
+                                        return fail(std::current_exception());
+                                    }
+                                    read_model();
+                                });
+    }
+
+    void read_model() {
+        boost::asio::async_read(socket_, frame_buffer(incoming_), [this](const boost::system::error_code& error, size_t) {
+            if (error) return fail(error);
+            try {
+                verify_frame_payload(in_header_, frame_buffer(incoming_));
+            } catch (const std::exception&) {
+                return fail(std::current_exception());
+            }
+            {
+                // The next delta is taken against this model
+                std::lock_guard<std::mutex> lock(mutex_);
+                reference_.swap(incoming_);
+                reference_version_ = in_header_.round;
+                ++models_received_;
+            }
+            read_header();
+        });
+    }
+
+    void fail(const boost::system::error_code& error) {
+        fail(std::make_exception_ptr(boost::system::system_error(error)));
+    }
+
+    void fail(std::exception_ptr error) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!error_) error_ = error;
+        boost::system::error_code ignored;
+        socket_.close(ignored);
+        idle_.notify_all();
     }
-}
 
-bool train_incrementally(const MatrixXd& data, const VectorXd& labels, 
-                         VectorXd& weights, double learning_rate, 
-                         double gamma, tcp::socket& socket) {
-    int n_samples = data.rows();
+    boost::asio::io_context io_context_;
+    tcp::socket socket_;
+    boost::asio::executor_work_guard<boost::asio::io_context::executor_type> work_;
+    std::thread io_thread_;
+    UpdateEncoder encoder_;
+
+    std::mutex mutex_;
+    std::condition_variable idle_;  // Signals a finished write, the server's end of stream or a failure
+    bool writing_ = false;
+    bool ended_ = false;
+    std::exception_ptr error_;
+    VectorXd reference_;         // Newest global model received; zero before the first one
+    int reference_version_ = 0;
+    int models_received_ = 0;
+
+    // Owned by whichever side holds writing_: the encoder's output and the frame being written
+    VectorXd delta_;
+    boost::asio::const_buffer payload_;
+    FrameHeader out_header_;
+
+    // I/O thread only: the frame being read ahead
+    FrameHeader in_header_;
+    VectorXd incoming_;
+};
+
+// Train on the next TRAIN_BATCH_SIZE samples of a resident shard. Each kernel
+// row comes from the engine once and serves both the prediction and the
+// gradient update
+bool train_incrementally(RbfKernelEngine& engine, const Ref<const VectorXd>& labels,
+                         VectorXd& weights, double learning_rate, ModelChannel& channel) {
+    TRACE_SCOPE("train_batch");
+    int n_samples = engine.rows();
     static int last_sample = 0;  // Remember the last sample across function calls
 
     VectorXd gradient = VectorXd::Zero(weights.size());  // Declare gradient outside the loop
@@ -71,23 +231,17 @@ bool train_incrementally(const MatrixXd& data, const VectorXd& labels,
             return true;  // Exit condition: All samples processed
         }
 
-        // Compute the gradient for the current sample
-        VectorXd xi = data.row(current_sample);
+        // Kernel row of the current sample against every support
+        auto kernel_row = engine.kernel_row(current_sample);
         double yi = labels(current_sample);
-        double kernel_output = 0.0;
-
-        for (int j = 0; j < weights.size(); ++j) {
-            kernel_output += rbf_kernel(xi, data.row(j), gamma) * weights(j);
-        }
+        double kernel_output = kernel_row.dot(weights);
 
         if (yi * kernel_output < 1) {
-            for (int j = 0; j < weights.size(); ++j) {
-                gradient(j) += -yi * rbf_kernel(data.row(j), xi, gamma);
-            }
+            gradient.noalias() -= yi * kernel_row;
         }
 
         // Update weights after processing each sample
-        weights -= learning_rate * gradient;
+        weights.noalias() -= learning_rate * gradient;
 
         // Move to the next sample
         current_sample++;
@@ -96,7 +250,7 @@ bool train_incrementally(const MatrixXd& data, const VectorXd& labels,
         // Send weights to server after processing the entire batch
         if (processed_samples % TRAIN_BATCH_SIZE == 0) {
             std::cout << "[DEBUG] Sending weights after processing " << TRAIN_BATCH_SIZE << " samples." << std::endl;
-            send_in_batches(socket, weights);
+            channel.send(weights);
         }
     }
 
@@ -105,57 +259,270 @@ bool train_incrementally(const MatrixXd& data, const VectorXd& labels,
     return false;  // Continue training
 }
 
-int main() {
+// One pass over the shard in the approximate feature space: mini-batch hinge-loss
+// SGD on z(x), then the D-dimensional weight vector goes to the server
+bool train_approximate(DataSource& source, const KernelFeatureMap& feature_map, VectorXd& weights,
+                       double learning_rate, ModelChannel& channel) {
+    Batch batch;
+    MatrixXd Z;
+    VectorXd coefficients;
+
+    TRACE_SCOPE("train_pass");
+    source.reset();
+    while (source.next_batch(batch)) {
+        TRACE_SCOPE("feature_map");
+        PERF_SCOPE("feature_map");
+        feature_map.transform(batch.X(), Z);
+
+        // Subgradient of the mean hinge loss: -y_i * z_i for margin violators
+        coefficients = (batch.y().cwiseProduct(Z * weights).array() < 1).select(-batch.y(), 0.0);
+        VectorXd gradient = Z.transpose() * coefficients / batch.rows + APPROX_LAMBDA * weights;
+        weights -= learning_rate * gradient;
+    }
+
+    std::cout << "[DEBUG] Sending " << weights.size() << " feature-space weights after a full pass." << std::endl;
+    channel.send(weights);
+    return false;
+}
+
+// Read `count` consecutive rows starting at `start` from the source
+void read_rows(DataSource& source, int start, int count, MatrixXd& rows, VectorXd& labels) {
+    rows.resize(count, source.cols());
+    labels.resize(count);
+    source.seek(start);
+
+    Batch batch;
+    int filled = 0;
+    while (filled < count && source.next_batch(batch)) {
+        int n = std::min<int>(batch.rows, count - filled);
+        rows.middleRows(filled, n) = batch.X().topRows(n);
+        labels.segment(filled, n) = batch.y().head(n);
+        filled += n;
+    }
+    if (filled < count) {
+        throw std::runtime_error("Data source ended before the requested rows");
+    }
+}
+
+// Train on the next TRAIN_BATCH_SIZE samples while streaming the support rows.
+//
+// Each sample t updates the weights with w -= lr * g, where the running
+// gradient g collects -y_s * K_s (kernel row of sample s) for every earlier
+// margin violator s. Unrolled, the prediction for sample t only needs
+// K_t.w0 and K_t.K_s for s < t, so one pass accumulates P = K w0 and
+// Q = K K^T, the per-sample updates replay on these small matrices, and a
+// second pass applies the final weight change. Memory stays O(batch).
+bool train_incrementally(DataSource& source, VectorXd& weights, double learning_rate,
+                         double gamma, ModelChannel& channel) {
+    TRACE_SCOPE("train_batch");
+    int n_samples = source.rows();
+    static int last_sample = 0;  // Remember the last sample across function calls
+
+    std::cout << "[DEBUG] Starting training from sample: " << last_sample << std::endl;
+
+    if (last_sample >= n_samples) {
+        std::cout << "[INFO] All samples processed. Exiting program." << std::endl;
+        return true;  // Exit condition: All samples processed
+    }
+    if (weights.size() != n_samples) {
+        throw std::runtime_error("Weight vector does not match the number of samples");
+    }
+
+    int batch_size = std::min(TRAIN_BATCH_SIZE, n_samples - last_sample);
+    MatrixXd samples;
+    VectorXd sample_labels;
+    read_rows(source, last_sample, batch_size, samples, sample_labels);
+
+    // Pass 1: P = K w and Q = K K^T over all support rows
+    VectorXd P = VectorXd::Zero(batch_size);
+    MatrixXd Q = MatrixXd::Zero(batch_size, batch_size);
+    VectorXd sample_norms = samples.rowwise().squaredNorm();
+    VectorXd block_norms;
+    Batch block;
+    MatrixXd K;
+
+    source.reset();
+    while (source.next_batch(block)) {
+        TRACE_SCOPE("kernel_block");
+        block_norms = block.X().rowwise().squaredNorm();
+        RbfKernelEngine::gram(samples, sample_norms, block.X(), block_norms, gamma, K);
+        P.noalias() += K * weights.segment(block.first_row, block.rows);
+        Q.noalias() += K * K.transpose();
+    }
+
+    // Replay the per-sample updates: c_s = -y_s for margin violators, 0 otherwise
+    VectorXd coefficients = VectorXd::Zero(batch_size);
+    for (int t = 0; t < batch_size; ++t) {
+        double kernel_output = P(t);
+        for (int s = 0; s < t; ++s) {
+            kernel_output -= learning_rate * (t - s) * coefficients(s) * Q(t, s);
+        }
+
+        double yi = sample_labels(t);
+        if (yi * kernel_output < 1) {
+            coefficients(t) = -yi;
+        }
+    }
+
+    // Pass 2: w -= lr * sum_s (batch_size - s) * c_s * K_s
+    VectorXd step(batch_size);
+    for (int s = 0; s < batch_size; ++s) {
+        step(s) = learning_rate * (batch_size - s) * coefficients(s);
+    }
+    if (!step.isZero(0.0)) {
+        source.reset();
+        while (source.next_batch(block)) {
+            TRACE_SCOPE("kernel_block");
+            block_norms = block.X().rowwise().squaredNorm();
+            RbfKernelEngine::gram(samples, sample_norms, block.X(), block_norms, gamma, K);
+            weights.segment(block.first_row, block.rows).noalias() -= K.transpose() * step;
+        }
+    }
+
+    if (batch_size < TRAIN_BATCH_SIZE) {
+        std::cout << "[INFO] All samples processed. Exiting program." << std::endl;
+        return true;  // Ran off the end of the data part-way through the batch
+    }
+
+    // Send weights to server after processing the entire batch
+    std::cout << "[DEBUG] Sending weights after processing " << TRAIN_BATCH_SIZE << " samples." << std::endl;
+    channel.send(weights);
+
+    // Update the last sample index for the next call
+    last_sample += batch_size;
+    return false;  // Continue training
+}
+
+bool file_exists(const std::string& path) {
+    struct stat st;
+    return stat(path.c_str(), &st) == 0;
+}
+
+// Usage: ./client [--stream] [--rff D | --nystrom D] [--codec none|fp16|int8|topk] [--topk R]
+//   --stream     read train.bin (or train.csv) in batches instead of mapping it whole
+//   --rff D      train a linear SVM on D Random Fourier Features
+//   --nystrom D  train a linear SVM on a D-landmark Nystrom map (landmarks.bin is
+//                loaded if present and must hold D landmarks, otherwise sampled here and
+//                written for other clients)
+//   --codec C    compression of the update deltas sent to the server (default none)
+//   --topk R     fraction of values top-k sends, with error feedback (default 0.01)
+int main(int argc, char** argv) {
     try {
-        // Load data from train.csv
-        std::vector<std::vector<float>> features;
-        std::vector<int> labels;
-        load_data("train.csv", features, labels);
-
-        // Convert to Eigen matrices
-        MatrixXd local_data(features.size(), features[0].size());
-        VectorXd local_labels(labels.size());
-        for (size_t i = 0; i < features.size(); ++i) {
-            for (size_t j = 0; j < features[i].size(); ++j) {
-                local_data(i, j) = features[i][j];
+        bool streaming = false;
+        std::string approximation;
+        int approx_dim = 0;
+        CodecOptions codec;
+        for (int i = 1; i < argc; ++i) {
+            std::string arg = argv[i];
+            if (arg == "--stream") {
+                streaming = true;
+            } else if ((arg == "--rff" || arg == "--nystrom") && i + 1 < argc) {
+                approximation = arg.substr(2);
+                approx_dim = std::stoi(argv[++i]);
+                if (approx_dim < 1) {
+                    std::cerr << "[ERROR] " << arg << " needs a dimension D >= 1, got " << approx_dim << std::endl;
+                    return 1;
+                }
+            } else if (arg == "--codec" && i + 1 < argc) {
+                codec.codec = parse_update_codec(argv[++i]);
+                codec.error_feedback = codec.codec == UpdateCodec::TopK;
+            } else if (arg == "--topk" && i + 1 < argc) {
+                codec.topk_ratio = std::stod(argv[++i]);
+            } else {
+                std::cerr << "[ERROR] Unknown argument: " << arg << std::endl;
+                return 1;
             }
-            local_labels(i) = labels[i];
         }
 
-        std::cout << "Conversion Done" << std::endl;
+        std::unique_ptr<MappedDataset> dataset;
+        VectorXd mapped_labels;
+        std::unique_ptr<DataSource> source;
+        std::unique_ptr<RbfKernelEngine> engine;
+        if (streaming) {
+            // Bounded memory: never builds the cache, since that needs the whole shard resident
+            std::string path = file_exists("train.bin") ? "train.bin" : "train.csv";
+            source = open_data_source(path, STREAM_BATCH_SIZE);
+            std::cout << "[INFO] Streaming " << path << " in batches of " << STREAM_BATCH_SIZE << " rows." << std::endl;
+        } else {
+            // Map the binary cache of train.csv, parsing the CSV only on the first run
+            TRACE_SCOPE("load_dataset");
+            dataset = std::make_unique<MappedDataset>(load_or_build_cache<double>("train.csv", "train.bin"));
+            mapped_labels = dataset->labels().cast<double>();
+            source = std::make_unique<MatrixDataSource>(dataset->features<double>(), mapped_labels, STREAM_BATCH_SIZE);
+        }
+
+        double learning_rate = 0.01;
+        double gamma = 0.1;
+        std::unique_ptr<KernelFeatureMap> feature_map;
+        if (approximation == "rff") {
+            feature_map = std::make_unique<RandomFourierFeatures>(source->cols(), approx_dim, gamma, FEATURE_MAP_SEED);
+        } else if (approximation == "nystrom") {
+            MatrixXd landmarks;
+            if (file_exists("landmarks.bin")) {
+                // Every client must share the landmarks, so a file of another size is stale, not a hint
+                landmarks = NystromFeatures::load_landmarks("landmarks.bin");
+                if (landmarks.rows() != approx_dim) {
+                    std::cerr << "[ERROR] landmarks.bin holds " << landmarks.rows() << " landmarks but --nystrom asked for "
+                              << approx_dim << "; pass --nystrom " << landmarks.rows() << " or delete the file"
+                              << std::endl;
+                    return 1;
+                }
+            } else {
+                landmarks = NystromFeatures::sample_landmarks(*source, approx_dim, FEATURE_MAP_SEED);
+                if (landmarks.rows() < approx_dim) {
+                    std::cerr << "[WARN] Only " << landmarks.rows() << " samples to draw landmarks from; using D = "
+                              << landmarks.rows() << " instead of " << approx_dim << std::endl;
+                }
+            }
+            auto nystrom = std::make_unique<NystromFeatures>(landmarks, gamma);
+            if (!file_exists("landmarks.bin")) nystrom->save("landmarks.bin");
+            feature_map = std::move(nystrom);
+        } else if (dataset) {
+            engine = std::make_unique<RbfKernelEngine>(dataset->features<double>(), gamma,
+                                                       KERNEL_TILE_ROWS, KERNEL_CACHE_BYTES);
+        }
+        if (feature_map) {
+            std::cout << "[INFO] Training in a " << feature_map->output_dim() << "-dimensional "
+                      << approximation << " feature space." << std::endl;
+        }
+
+        std::cout << "[INFO] Loaded " << source->rows() << " samples with "
+                  << source->cols() << " features each." << std::endl;
 
         // Initialize weights with small random values
         std::random_device rd;
         std::mt19937 gen(rd());
         std::normal_distribution<> d(0, 0.01);
-        VectorXd local_weights = VectorXd::Zero(local_data.rows()).unaryExpr([&](double) { return d(gen); });
+        // One weight per training row for the exact kernel, one per feature otherwise
+        Index model_size = feature_map ? feature_map->output_dim() : source->rows();
+        VectorXd local_weights = VectorXd::Zero(model_size).unaryExpr([&](double) { return d(gen); });
 
-        double learning_rate = 0.01;
-        double gamma = 0.1;
-
-        // Connect to the server
-        boost::asio::io_context io_context;
-        tcp::socket socket(io_context);
-        socket.connect(tcp::endpoint(boost::asio::ip::address::from_string("127.0.0.1"), 8080));
-
-        // Send vector size to the server
-        int vector_size = local_weights.size();
-        std::cout << "[DEBUG] Sending vector size: " << vector_size << std::endl;
-        boost::asio::write(socket, boost::asio::buffer(&vector_size, sizeof(int)));
+        // Connect to the server; every update frame carries the vector size, which the
+        // server checks against the global model
+        std::cout << "[DEBUG] Model size: " << local_weights.size() << ", update codec: " << codec_name(codec.codec)
+                  << std::endl;
+        ModelChannel channel(tcp::endpoint(boost::asio::ip::address::from_string("127.0.0.1"), 8080), codec,
+                             local_weights.size());
 
         // Train incrementally in batches of 50 samples
         for (int epoch = 0; epoch < MAX_EPOCHS; ++epoch) {
             std::cout << "[INFO] Starting epoch " << epoch + 1 << std::endl;
 
-            bool exit = train_incrementally(local_data, local_labels, local_weights, 
-                                            learning_rate, gamma, socket);
+            bool exit;
+            if (feature_map) {
+                exit = train_approximate(*source, *feature_map, local_weights, learning_rate, channel);
+            } else if (engine) {
+                exit = train_incrementally(*engine, mapped_labels, local_weights, learning_rate, channel);
+            } else {
+                exit = train_incrementally(*source, local_weights, learning_rate, gamma, channel);
+            }
 
             if (exit) {
                 std::cout << "[INFO] Exiting after epoch " << epoch + 1 << std::endl;
                 break;
             }
 
-            // double loss = compute_loss(local_data, local_labels, local_weights, gamma);
+            // double loss = compute_loss(*engine, mapped_labels, local_weights);
             // std::cout << "[INFO] Epoch " << epoch + 1 << " - Loss: " << loss << std::endl;
 
             // if (loss < EPSILON) {
@@ -163,7 +530,7 @@ int main() {
             //     break;
             // }
         }
-        socket.close();
+        channel.finish();
 
     } catch (const std::exception& e) {
         std::cerr << "[ERROR] Exception in client: " << e.what() << std::endl;
@@ -0,0 +1,135 @@
+#pragma once
+
+// Explicit feature maps approximating the RBF kernel.
+//
+// Both maps send an input row x to a D-dimensional z(x) with
+// z(x).z(y) ~= exp(-gamma * ||x - y||^2), so a linear model over z replaces
+// the one-weight-per-training-row kernel expansion. The model size is D no
+// matter how many rows a client holds.
+//
+// Clients only produce compatible models if they share the same map: the
+// same seed for Random Fourier Features, the same landmark set for Nystrom.
+
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <Eigen/Dense>
+#include <Eigen/Eigenvalues>
+#include "../common/binary_dataset.hpp"
+#include "../common/data_source.hpp"
+#include "rbf_kernel_engine.hpp"
+
+class KernelFeatureMap {
+public:
+    virtual ~KernelFeatureMap() = default;
+    virtual Eigen::Index output_dim() const = 0;
+    // Z = z(X), one row per input row
+    virtual void transform(const Eigen::Ref<const Eigen::MatrixXd>& X, Eigen::MatrixXd& Z) const = 0;
+};
+
+// Random Fourier Features: z(x) = sqrt(2 / D) * cos(W^T x + b) with
+// W ~ N(0, 2 * gamma) and b ~ U[0, 2 pi)
+class RandomFourierFeatures : public KernelFeatureMap {
+public:
+    RandomFourierFeatures(Eigen::Index input_dim, Eigen::Index output_dim, double gamma, uint64_t seed)
+        : W_(input_dim, output_dim), b_(output_dim), scale_(std::sqrt(2.0 / output_dim)) {
+        std::mt19937_64 rng(seed);
+        std::normal_distribution<double> normal(0.0, std::sqrt(2.0 * gamma));
+        std::uniform_real_distribution<double> phase(0.0, 2.0 * M_PI);
+        for (Eigen::Index j = 0; j < output_dim; ++j) {
+            for (Eigen::Index i = 0; i < input_dim; ++i) W_(i, j) = normal(rng);
+            b_(j) = phase(rng);
+        }
+    }
+
+    Eigen::Index output_dim() const override { return W_.cols(); }
+
+    void transform(const Eigen::Ref<const Eigen::MatrixXd>& X, Eigen::MatrixXd& Z) const override {
+        if (X.cols() != W_.rows()) {
+            throw std::runtime_error("Input has " + std::to_string(X.cols()) + " features, feature map expects " +
+                                     std::to_string(W_.rows()));
+        }
+        Z.resize(X.rows(), W_.cols());
+        Z.noalias() = X * W_;
+        Z.array() = scale_ * (Z.array().rowwise() + b_.transpose().array()).cos();
+    }
+
+private:
+    Eigen::MatrixXd W_;
+    Eigen::VectorXd b_;
+    double scale_;
+};
+
+// Nystrom features: z(x) = K(x, L) * K(L, L)^{-1/2} for a landmark set L
+class NystromFeatures : public KernelFeatureMap {
+public:
+    NystromFeatures(const Eigen::MatrixXd& landmarks, double gamma)
+        : landmarks_(landmarks), landmark_norms_(landmarks.rowwise().squaredNorm()), gamma_(gamma) {
+        Eigen::MatrixXd K_mm;
+        RbfKernelEngine::gram(landmarks_, landmark_norms_, landmarks_, landmark_norms_, gamma_, K_mm);
+
+        // Inverse square root through the eigendecomposition; near-zero modes
+        // (duplicate landmarks) are dropped rather than amplified
+        Eigen::SelfAdjointEigenSolver<Eigen::MatrixXd> eigen(K_mm);
+        Eigen::VectorXd values = eigen.eigenvalues();
+        double cutoff = 1e-10 * std::max(1.0, values.maxCoeff());
+        Eigen::VectorXd inv_sqrt = (values.array() > cutoff).select(values.array().max(cutoff).rsqrt(), 0.0);
+        normalization_ = eigen.eigenvectors() * inv_sqrt.asDiagonal() * eigen.eigenvectors().transpose();
+    }
+
+    Eigen::Index output_dim() const override { return landmarks_.rows(); }
+    const Eigen::MatrixXd& landmarks() const { return landmarks_; }
+
+    void transform(const Eigen::Ref<const Eigen::MatrixXd>& X, Eigen::MatrixXd& Z) const override {
+        if (X.cols() != landmarks_.cols()) {
+            throw std::runtime_error("Input has " + std::to_string(X.cols()) + " features, landmarks have " +
+                                     std::to_string(landmarks_.cols()));
+        }
+        Eigen::VectorXd norms = X.rowwise().squaredNorm();
+        RbfKernelEngine::gram(X, norms, landmarks_, landmark_norms_, gamma_, kernel_);
+        Z.resize(X.rows(), landmarks_.rows());
+        Z.noalias() = kernel_ * normalization_;
+    }
+
+    // Reservoir-sample `count` rows of the source with a fixed seed
+    static Eigen::MatrixXd sample_landmarks(DataSource& source, Eigen::Index count, uint64_t seed) {
+        std::mt19937_64 rng(seed);
+        Eigen::MatrixXd landmarks(std::min(count, source.rows()), source.cols());
+        Eigen::Index seen = 0;
+        Batch batch;
+
+        source.reset();
+        while (source.next_batch(batch)) {
+            for (Eigen::Index i = 0; i < batch.rows; ++i, ++seen) {
+                if (seen < landmarks.rows()) {
+                    landmarks.row(seen) = batch.features.row(i);
+                } else {
+                    std::uniform_int_distribution<Eigen::Index> slot(0, seen);
+                    Eigen::Index j = slot(rng);
+                    if (j < landmarks.rows()) landmarks.row(j) = batch.features.row(i);
+                }
+            }
+        }
+        return landmarks;
+    }
+
+    // Landmarks are stored as a binary dataset file (labels unused) so one
+    // client can sample them and the others can load the same set
+    void save(const std::string& path) const {
+        write_binary_dataset<double>(path, landmarks_, Eigen::VectorXd::Zero(landmarks_.rows()), -1);
+    }
+
+    static Eigen::MatrixXd load_landmarks(const std::string& path) {
+        MappedDataset file(path, true);
+        return file.features<double>();
+    }
+
+private:
+    Eigen::MatrixXd landmarks_;
+    Eigen::VectorXd landmark_norms_;
+    double gamma_;
+    Eigen::MatrixXd normalization_;
+    mutable Eigen::MatrixXd kernel_;  // Scratch for K(X, L)
+};
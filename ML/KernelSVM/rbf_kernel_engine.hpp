@@ -0,0 +1,106 @@
+#pragma once
+
+// RBF kernel engine for the kernel SVM client.
+//
+// Gram blocks are computed with the GEMM identity
+//     ||x - y||^2 = ||x||^2 + ||y||^2 - 2 x^T y
+// followed by a vectorised exp, instead of one rbf_kernel() call (and its
+// temporaries) per pair. Blocks of kernel rows are cached in a bounded LRU
+// keyed on the row tile, so every kernel row is computed once and reused for
+// both the prediction and the gradient update.
+
+#include <cmath>
+#include <cstddef>
+#include <list>
+#include <unordered_map>
+#include <Eigen/Dense>
+#include "../common/perf_counters.hpp"
+
+// Scalar RBF kernel, kept for reference and one-off evaluations
+inline double rbf_kernel(const Eigen::VectorXd& x1, const Eigen::VectorXd& x2, double gamma = 0.1) {
+    return std::exp(-gamma * (x1 - x2).squaredNorm());
+}
+
+class RbfKernelEngine {
+public:
+    RbfKernelEngine(const Eigen::Ref<const Eigen::MatrixXd>& data, double gamma, Eigen::Index tile_rows = 64,
+                    size_t cache_bytes = size_t(256) << 20)
+        : data_(data), norms_(data.rowwise().squaredNorm()), gamma_(gamma),
+          tile_rows_(std::max<Eigen::Index>(1, tile_rows)), cache_bytes_(cache_bytes) {}
+
+    // out(i, j) = exp(-gamma * ||a_i - b_j||^2) for all rows of a and b, given
+    // the squared row norms of both
+    static void gram(const Eigen::Ref<const Eigen::MatrixXd>& a, const Eigen::Ref<const Eigen::VectorXd>& a_norms,
+                     const Eigen::Ref<const Eigen::MatrixXd>& b, const Eigen::Ref<const Eigen::VectorXd>& b_norms,
+                     double gamma, Eigen::MatrixXd& out) {
+        PERF_SCOPE("rbf_kernel");
+        out.resize(a.rows(), b.rows());
+        out.noalias() = a * b.transpose();
+        out.array() = (out.array() * 2.0).colwise() - a_norms.array();
+        out.array().rowwise() -= b_norms.transpose().array();
+        // Rounding can push tiny distances slightly negative; clamp before exp
+        out.array() = (gamma * out.array().min(0.0)).exp();
+    }
+
+    Eigen::Index rows() const { return data_.rows(); }
+    Eigen::Index tile_rows() const { return tile_rows_; }
+    double gamma() const { return gamma_; }
+    const Eigen::VectorXd& norms() const { return norms_; }
+
+    // Kernel rows of row tile `index`, stored transposed: column i is the kernel
+    // row of sample index * tile_rows() + i against every row of the data. The
+    // reference is only valid until the next call that may evict.
+    const Eigen::MatrixXd& tile(Eigen::Index index) {
+        auto it = cache_.find(index);
+        if (it != cache_.end()) {
+            hits_++;
+            lru_.splice(lru_.begin(), lru_, it->second.position);
+            return it->second.kernel;
+        }
+
+        misses_++;
+        Eigen::Index first = index * tile_rows_;
+        Eigen::Index count = std::min(tile_rows_, rows() - first);
+        size_t bytes = size_t(rows()) * count * sizeof(double);
+        while (!lru_.empty() && cached_bytes_ + bytes > cache_bytes_) {
+            evict_oldest();
+        }
+
+        lru_.push_front(index);
+        Entry& entry = cache_[index];
+        entry.position = lru_.begin();
+        gram(data_, norms_, data_.middleRows(first, count), norms_.segment(first, count), gamma_, entry.kernel);
+        cached_bytes_ += bytes;
+        return entry.kernel;
+    }
+
+    // Kernel row of sample i against every row of the data (contiguous)
+    auto kernel_row(Eigen::Index i) { return tile(i / tile_rows_).col(i % tile_rows_); }
+
+    size_t hits() const { return hits_; }
+    size_t misses() const { return misses_; }
+
+private:
+    struct Entry {
+        Eigen::MatrixXd kernel;
+        std::list<Eigen::Index>::iterator position;
+    };
+
+    void evict_oldest() {
+        auto it = cache_.find(lru_.back());
+        cached_bytes_ -= size_t(it->second.kernel.size()) * sizeof(double);
+        cache_.erase(it);
+        lru_.pop_back();
+    }
+
+    Eigen::Ref<const Eigen::MatrixXd> data_;
+    Eigen::VectorXd norms_;
+    double gamma_;
+    Eigen::Index tile_rows_;
+    size_t cache_bytes_;
+    size_t cached_bytes_ = 0;
+    std::list<Eigen::Index> lru_;  // Most recently used tile first
+    std::unordered_map<Eigen::Index, Entry> cache_;
+    size_t hits_ = 0;
+    size_t misses_ = 0;
+};
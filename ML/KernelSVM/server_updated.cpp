@@ -2,110 +2,190 @@
 #include <iostream>
 #include <vector>
 #include <thread>
+#include <deque>
+#include <atomic>
 #include <fstream>
+#include <utility>
 #include <boost/asio.hpp>
 #include <mutex>
 #include <Eigen/Dense>
+#include "../common/async_server.hpp"
+#include "../common/sharded_aggregator.hpp"
+#include "../common/wire_protocol.hpp"
+#include "../common/update_codec.hpp"
+#include "../common/perf_counters.hpp"
+#include "../common/trace.hpp"
 
 using namespace Eigen;
 using boost::asio::ip::tcp;
 
-std::mutex model_mutex;  // Mutex for thread-safe operations
-VectorXd global_weights;  // Store the global model
-VectorXd total_weights;   // Accumulate weights for averaging
-int client_count = 0;     // Track the number of connected clients
+ShardedAccumulator total_weights;          // Sum of all updates, one spinlock per shard
+std::once_flag model_size_once;            // The first client fixes the model size
+AtomicSnapshot<VectorXd> global_weights;  // Latest global model, swapped in atomically
+std::atomic<int> model_versions{0};        // Version ids of the global models; 0 is the zero model
 
-const int BATCH_SIZE = 100;  // Batch size for receiving updates
+const size_t MAX_REFERENCE_MODELS = 16;  // Sent models a session keeps for delta references
 
-// Federated Aggregation of Local Models
-void aggregate_model(const VectorXd& local_update) {
-    std::lock_guard<std::mutex> lock(model_mutex);  // Ensure thread safety
-
-    if (total_weights.size() == 0) {
-        total_weights = VectorXd::Zero(local_update.size());
-    }
-
-    total_weights += local_update;
-    client_count++;
+// Federated Aggregation of Local Models; returns the new global model snapshot
+std::shared_ptr<const VectorXd> aggregate_model(const VectorXd& local_update) {
+    total_weights.add(local_update.data(), 1.0);
 
     // Update the global weights by averaging
-    global_weights = total_weights / client_count;
+    auto global = std::make_shared<VectorXd>(local_update.size());
+    total_weights.mean(global->data());
+    global_weights.store(global);
 
     std::cout << "[DEBUG] Aggregated global weights (first 10): "
-              << global_weights.head(10).transpose() << std::endl;
+              << global->head(10).transpose() << std::endl;
+    return global;
 }
 
-// Handle communication with a client
-void handle_client(tcp::socket socket) {
-    try {
-        std::cout << "[DEBUG] Handling new client connection." << std::endl;
-
-        // Read the size of the incoming weight vector
-        int vector_size = 0;
-        boost::system::error_code error;
-
-        // Read the vector size directly
-        boost::asio::read(socket, boost::asio::buffer(&vector_size, sizeof(int)), error);
-
-        if (error) {
-            std::cerr << "[ERROR] Failed to receive vector size: " << error.message() << std::endl;
-            return;
-        }
-
-        std::cout << "[DEBUG] Received vector size: " << vector_size << std::endl;
+// State of one streaming connection, shared by its reader (handle_client) and
+// its writer (send_models). Both coroutines run on the connection's strand, so
+// none of it needs a lock.
+struct ModelStream {
+    explicit ModelStream(tcp::socket s)
+        : socket(std::move(s)), wakeup(socket.get_executor()), drained(socket.get_executor()) {}
+
+    tcp::socket socket;
+    asio::steady_timer wakeup;   // Cancelled by the reader when there is something to send
+    asio::steady_timer drained;  // Cancelled by the writer when it has finished
+    std::shared_ptr<const VectorXd> pending;  // Newest global model not yet sent; older ones are dropped
+    int pending_version = 0;
+    // Models sent to the client that a delta may still name, oldest first
+    std::deque<std::pair<int, std::shared_ptr<const VectorXd>>> sent;
+    bool closing = false;         // The reader has stopped; flush and answer with EndOfStream
+    bool peer_ended = false;      // The client sent EndOfStream rather than dropping the connection
+    bool writer_done = false;
+};
+
+// Wait on a timer used as a signal; cancel() wakes the waiter early
+awaitable<void> wait_signal(asio::steady_timer& timer) {
+    boost::system::error_code ignored;
+    timer.expires_at(asio::steady_timer::time_point::max());
+    co_await timer.async_wait(asio::redirect_error(use_awaitable, ignored));
+}
 
-        if (vector_size <= 0 || vector_size > 1e7) {
-            std::cerr << "[ERROR] Invalid vector size received: " << vector_size << std::endl;
-            return;
+// Writer half of a session: sends the newest global model whenever one is
+// pending, so a client that reads slowly gets fewer, newer models instead of
+// stalling the reader behind TCP back-pressure
+awaitable<void> send_models(std::shared_ptr<ModelStream> stream) {
+    try {
+        while (true) {
+            if (stream->pending) {
+                std::shared_ptr<const VectorXd> model = std::move(stream->pending);
+                int version = stream->pending_version;
+                stream->sent.emplace_back(version, model);
+                if (stream->sent.size() > MAX_REFERENCE_MODELS) stream->sent.pop_front();
+                co_await async_write_frame(stream->socket, frame_header(MessageType::GlobalModel, version, model->size(), 1),
+                                           frame_buffer(*model));
+            } else if (stream->closing) {
+                if (stream->peer_ended) {
+                    co_await async_write_frame(stream->socket, frame_header(MessageType::EndOfStream, 0, 0, 0),
+                                               asio::const_buffer());
+                    std::cout << "[DEBUG] Stream ended; sent end of stream to client." << std::endl;
+                }
+                break;
+            } else {
+                co_await wait_signal(stream->wakeup);
+            }
         }
+    } catch (const std::exception& e) {
+        std::cerr << "[ERROR] Exception while sending models: " << e.what() << std::endl;
+        boost::system::error_code ignored;
+        stream->socket.close(ignored);  // Fails the reader too
+    }
+    stream->writer_done = true;
+    stream->drained.cancel();
+}
 
-    while(true) {
-
-        VectorXd local_update = VectorXd::Zero(vector_size);
-        int received = 0;
-
-        std::cout << "[DEBUG] Receiving data in batches..." << std::endl;
+// Handle communication with a client. Updates are read and aggregated as fast
+// as they arrive while send_models streams the resulting models back, so the
+// two directions never wait on each other.
+awaitable<void> handle_client(tcp::socket socket) {
+    auto stream = std::make_shared<ModelStream>(std::move(socket));
+    asio::co_spawn(stream->socket.get_executor(), send_models(stream), asio::detached);
 
-        while (received < vector_size) {
-            int batch_size = std::min(BATCH_SIZE, vector_size - received);
-            boost::asio::read(socket, boost::asio::buffer(
-                local_update.data() + received, batch_size * sizeof(double)));
+    try {
+        TRACE_CLIENT(client, stream->socket.remote_endpoint());
+        std::cout << "[DEBUG] Handling new client connection." << std::endl;
 
-            //std::cout << "[DEBUG] Received batch of size: " << batch_size << std::endl;
-            received += batch_size;
+        while (true) {
+            // Each update is one frame carrying its own vector size
+            std::optional<FrameHeader> header = co_await async_read_frame_header(stream->socket);
+            if (!header) break;
+            if (header->message_type() == MessageType::EndOfStream) {
+                expect_frame(*header, MessageType::EndOfStream);
+                stream->peer_ended = true;
+                break;
+            }
+
+            int vector_size = header->rows;
+            std::cout << "[DEBUG] Received vector size: " << vector_size << std::endl;
+
+            if (vector_size <= 0 || vector_size > 1e7 || header->cols != 1) {
+                std::cerr << "[ERROR] Invalid vector size received: " << vector_size << std::endl;
+                break;
+            }
+
+            // Exact-kernel clients send one weight per row, approximate-kernel clients
+            // a fixed D; every client of one run must agree on the size
+            std::call_once(model_size_once, [&]() { total_weights.resize(vector_size); });
+            if (total_weights.size() != vector_size) {
+                std::cerr << "[ERROR] Vector size " << vector_size << " does not match the global model size "
+                          << total_weights.size() << std::endl;
+                break;
+            }
+
+            // A delta names the model version it is relative to. The client's
+            // reference only moves forward, so older sent models can go.
+            std::shared_ptr<const VectorXd> reference;
+            if ((header->flags & FRAME_DELTA) && header->round != 0) {
+                while (!stream->sent.empty() && stream->sent.front().first < header->round) stream->sent.pop_front();
+                if (stream->sent.empty() || stream->sent.front().first != header->round) {
+                    throw ProtocolError("Delta against unknown model version " + std::to_string(header->round));
+                }
+                reference = stream->sent.front().second;
+            }
+
+            // Raw, fp16, int8 or top-k; deltas are added to the referenced model
+            VectorXd local_update;
+            co_await async_read_update(stream->socket, *header, reference.get(), local_update);
+
+            std::cout << "[DEBUG] First 10 weights received: "
+                      << local_update.head(10).transpose() << std::endl;
+
+            // Hand the new model to the writer; one it has not sent yet is superseded
+            {
+                TRACE_SCOPE_TAGGED("aggregate", header->round, client);
+                PERF_SCOPE("aggregate");
+                stream->pending = aggregate_model(local_update);
+            }
+            stream->pending_version = ++model_versions;
+            stream->wakeup.cancel();
         }
 
-        std::cout << "[DEBUG] First 10 weights received: " 
-                  << local_update.head(10).transpose() << std::endl;
-
-        aggregate_model(local_update);
-
-        boost::asio::write(socket, boost::asio::buffer(
-            global_weights.data(), global_weights.size() * sizeof(double)));
-
-        std::cout << "[DEBUG] Sent updated global model to client." << std::endl;
-    }
-
     } catch (const std::exception& e) {
         std::cerr << "[ERROR] Exception in handle_client: " << e.what() << std::endl;
     }
+
+    // Let the writer flush and answer the end of stream; a dropped connection gets nothing more
+    stream->closing = true;
+    if (!stream->peer_ended) stream->pending.reset();
+    stream->wakeup.cancel();
+    while (!stream->writer_done) co_await wait_signal(stream->drained);
 }
 
 // Main function to run the server
 int main() {
     try {
-        boost::asio::io_context io_context;
-        tcp::acceptor acceptor(io_context, tcp::endpoint(tcp::v4(), 8080));
+        TRACE_PROCESS("KernelSVM server", -1);
+        // Sessions run as coroutines on a fixed thread pool, one strand per connection
+        AsyncServer server(8080, handle_client);
 
         std::cout << "[DEBUG] Server started. Waiting for clients on port 8080..." << std::endl;
 
-        while (true) {
-            tcp::socket socket(io_context);
-            acceptor.accept(socket);
-            std::cout << "[DEBUG] Client connected." << std::endl;
-
-            std::thread(handle_client, std::move(socket)).detach();
-        }
+        server.run();
     } catch (const std::exception& e) {
         std::cerr << "[ERROR] Exception in main: " << e.what() << std::endl;
     }
@@ -0,0 +1,76 @@
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <random>
+#include <string>
+#include <Eigen/Dense>
+#include "kmeans_solvers.hpp"
+
+using namespace Eigen;
+// g++ -O3 -march=native -fopenmp -std=c++17 bench_kmeans.cpp -o bench_kmeans -I /usr/include/eigen3
+// ./bench_kmeans [rows] [features] [clusters] [max_iters]
+
+// Gaussian blobs around `clusters` random centres
+MatrixXd make_blobs(int rows, int features, int clusters, std::mt19937_64& rng) {
+    MatrixXd centres = MatrixXd::Random(clusters, features) * 10.0;
+    std::normal_distribution<double> noise(0.0, 1.0);
+    std::uniform_int_distribution<int> pick(0, clusters - 1);
+    MatrixXd data(rows, features);
+    for (int i = 0; i < rows; ++i) {
+        int c = pick(rng);
+        for (int j = 0; j < features; ++j) data(i, j) = centres(c, j) + noise(rng);
+    }
+    return data;
+}
+
+void report(const std::string& name, const KMeansResult& result, double seconds, const KMeansResult& lloyd,
+            double lloyd_seconds) {
+    std::cout << std::left << std::setw(10) << name << std::right
+              << std::setw(6) << result.iterations << (result.converged ? "*" : " ")
+              << std::setw(16) << result.distance_evaluations
+              << std::setw(10) << std::setprecision(3) << double(lloyd.distance_evaluations) / result.distance_evaluations << "x"
+              << std::setw(12) << std::setprecision(4) << seconds * 1e3 << " ms"
+              << std::setw(9) << std::setprecision(3) << lloyd_seconds / seconds << "x"
+              << std::setw(16) << std::setprecision(8) << result.inertia << std::endl;
+}
+
+int main(int argc, char** argv) {
+    int rows = argc > 1 ? std::stoi(argv[1]) : 200000;
+    int features = argc > 2 ? std::stoi(argv[2]) : 16;
+    int clusters = argc > 3 ? std::stoi(argv[3]) : 32;
+    int max_iters = argc > 4 ? std::stoi(argv[4]) : 100;
+
+    std::mt19937_64 rng(7);
+    MatrixXd data = make_blobs(rows, features, clusters, rng);
+    MatrixXd initial(clusters, features);
+    std::uniform_int_distribution<int> pick(0, rows - 1);
+    for (int c = 0; c < clusters; ++c) initial.row(c) = data.row(pick(rng));
+
+    std::cout << "[INFO] " << rows << " rows x " << features << " features, k = " << clusters
+              << ", max_iters = " << max_iters << std::endl;
+
+    KMeansOptions options;
+    options.max_iters = max_iters;
+
+    auto timed = [&](KMeansMode mode, double& seconds) {
+        options.mode = mode;
+        auto start = std::chrono::steady_clock::now();
+        KMeansResult result = run_kmeans(data, initial, options);
+        seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return result;
+    };
+
+    double t_lloyd, t_hamerly, t_minibatch;
+    KMeansResult lloyd = timed(KMeansMode::Lloyd, t_lloyd);
+    KMeansResult hamerly = timed(KMeansMode::Hamerly, t_hamerly);
+    KMeansResult minibatch = timed(KMeansMode::MiniBatch, t_minibatch);
+
+    std::cout << "mode       iters   distance evals   vs Lloyd     wall time  vs Lloyd         inertia" << std::endl;
+    report("lloyd", lloyd, t_lloyd, lloyd, t_lloyd);
+    report("hamerly", hamerly, t_hamerly, lloyd, t_lloyd);
+    report("minibatch", minibatch, t_minibatch, lloyd, t_lloyd);
+    std::cout << "(* = stopped on tolerance " << options.tolerance << ")" << std::endl;
+    std::cout << "max |c_lloyd - c_hamerly| = " << (lloyd.centroids - hamerly.centroids).cwiseAbs().maxCoeff() << std::endl;
+    return 0;
+}
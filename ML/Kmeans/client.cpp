@@ -5,9 +5,18 @@
 #include <Eigen/Dense>
 #include <cstdlib>
 #include <ctime>
+#include <string>
+#include <array>
+#include "../common/perf_counters.hpp"
+#include "../common/trace.hpp"
+#include "../common/wire_protocol.hpp"
+#include "kmeans_solvers.hpp"
 
 using namespace Eigen;
 using boost::asio::ip::tcp;
+// g++ -O3 -march=native -fopenmp client.cpp -o client -I /usr/include/eigen3
+// ./client [lloyd|minibatch|hamerly]
+
 // Function to simulate or load local data
 MatrixXd load_local_data() {
     MatrixXd data(4, 2); // 4 samples, 2 features
@@ -35,71 +44,81 @@ MatrixXd initialize_centroids(const MatrixXd& data, int k) {
 }
 
 // Function to perform K-means clustering
-MatrixXd perform_kmeans(const MatrixXd& data, MatrixXd centroids, int max_iters = 10) {
-    int n_samples = data.rows();
-    int k = centroids.rows();
-    VectorXi labels(n_samples);
-    
-    for (int iter = 0; iter < max_iters; ++iter) {
-        // Assignment step: Assign each point to the nearest centroid
-        for (int i = 0; i < n_samples; ++i) {
-            RowVectorXd point = data.row(i);
-            VectorXd distances = (centroids.rowwise() - point).rowwise().squaredNorm();
-            labels(i) = distances.minCoeff();
-        }
-
-        // Update step: Update centroids
-        for (int j = 0; j < k; ++j) {
-            std::vector<RowVectorXd> points_in_cluster;
-
-            for (int i = 0; i < n_samples; ++i) {
-                if (labels(i) == j) {
-                    points_in_cluster.push_back(data.row(i));
-                }
-            }
-
-            if (!points_in_cluster.empty()) {
-                MatrixXd points_matrix(points_in_cluster.size(), data.cols());
-
-                for (int i = 0; i < points_in_cluster.size(); ++i) {
-                    points_matrix.row(i) = points_in_cluster[i];
-                }
-
-                centroids.row(j) = points_matrix.colwise().mean();
-            }
-        }
-    }
+KMeansResult perform_kmeans(const MatrixXd& data, MatrixXd centroids, const KMeansOptions& options = {}) {
+    TRACE_SCOPE("kmeans");
+    PERF_SCOPE("perform_kmeans");
+    KMeansResult result = run_kmeans(data, centroids, options);
+
+    std::cout << "[INFO] K-means finished after " << result.iterations << " iterations"
+              << (result.converged ? " (converged)" : "") << ", inertia " << result.inertia
+              << ", " << result.distance_evaluations << " distance evaluations" << std::endl;
+    return result;
+}
 
-    return centroids;
+// Function to parse the k-means mode from the command line
+KMeansMode parse_mode(const std::string& name) {
+    if (name == "lloyd") return KMeansMode::Lloyd;
+    if (name == "minibatch") return KMeansMode::MiniBatch;
+    if (name == "hamerly") return KMeansMode::Hamerly;
+    throw std::runtime_error("Unknown k-means mode: " + name);
 }
 
-int main() {
+int main(int argc, char** argv) {
     try {
+        KMeansOptions options;
+        if (argc > 1) options.mode = parse_mode(argv[1]);
+
         boost::asio::io_context io_context;
         tcp::socket socket(io_context);
         socket.connect(tcp::endpoint(boost::asio::ip::address::from_string("127.0.0.1"), 8080));
+        TRACE_PROCESS("Kmeans client", trace_client_id(socket.local_endpoint()));
 
         // Load local data and initialize centroids with random variation
         MatrixXd local_data = load_local_data();
         MatrixXd local_centroids = initialize_centroids(local_data, 2);
 
-        // Perform local K-means clustering
-        MatrixXd updated_centroids = perform_kmeans(local_data, local_centroids);
-
-        // Send the size of the centroid matrix first
-        int rows = updated_centroids.rows();
-        int cols = updated_centroids.cols();
-        boost::asio::write(socket, boost::asio::buffer(&rows, sizeof(int)));
-        boost::asio::write(socket, boost::asio::buffer(&cols, sizeof(int)));
-
-        // Send local centroids to server
-        boost::asio::write(socket, boost::asio::buffer(updated_centroids.data(), rows * cols * sizeof(double)));
+        // Cluster locally, exchange statistics with the server and restart from the
+        // global centroids, until the server ends training
+        int round = 0;
+        bool finished = false;
+        while (!finished) {
+            // Perform local K-means clustering
+            TRACE_ROUND(round);
+            KMeansResult result = perform_kmeans(local_data, local_centroids, options);
+
+            // Per-cluster sums and counts let the server weight clients by their point counts
+            MatrixXd sums;
+            VectorXd counts;
+            {
+                TRACE_SCOPE("cluster_statistics");
+                PERF_SCOPE("cluster_statistics");
+                cluster_statistics(local_data, result.labels, result.centroids.rows(), sums, counts);
+            }
 
-        // Receive updated global centroids from the server
-        MatrixXd global_centroids(rows, cols);
-        boost::asio::read(socket, boost::asio::buffer(global_centroids.data(), rows * cols * sizeof(double)));
+            // Send the cluster statistics as one frame: sums and counts are gathered from their
+            // own storage into the k x (d + 1) column-major layout the server reads
+            int rows = sums.rows();
+            int cols = sums.cols();
+            double num_samples = local_data.rows();
+            std::array<boost::asio::const_buffer, 2> stats{frame_buffer(sums), frame_buffer(counts)};
+            write_frame(socket, frame_header(MessageType::Update, round, rows, cols + 1, num_samples), stats);
+
+            // Receive the next round id and the updated global centroids from the server
+            FrameHeader reply;
+            {
+                TRACE_SCOPE("wait_global_model");
+                reply = read_frame_header(socket);
+            }
+            expect_frame(reply, MessageType::GlobalModel);
+            if (int(reply.rows) != rows || int(reply.cols) != cols) {
+                throw std::runtime_error("Global centroids do not match the local cluster shape");
+            }
+            read_frame_payload(socket, reply, frame_buffer(local_centroids));
+            round = reply.round;
+            finished = reply.is_final();
 
-        std::cout << "Updated global centroids received from server:" << global_centroids << std::endl;
+            std::cout << "Updated global centroids received from server:" << local_centroids << std::endl;
+        }
 
     } catch (std::exception& e) {
         std::cerr << "Exception: " << e.what() << std::endl;
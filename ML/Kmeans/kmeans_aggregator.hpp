@@ -0,0 +1,217 @@
+#pragma once
+
+// Federated k-means aggregation from per-cluster sufficient statistics.
+//
+// Each client sends, for each of its k clusters, the sum of its points and the
+// point count. Before accumulating, the client's clusters are matched to the
+// current global centroids (Hungarian assignment on squared distance, greedy
+// for large k), so clients that found the same clusters under different labels
+// add up instead of cancelling out. The global centroid j is then
+// sum_j / count_j over all clients, which weights every client by the number
+// of points it actually holds.
+//
+// Accumulation is lock-free: sums and counts are atomics updated with CAS, and
+// the first client to arrive fixes the shape and the initial reference. Between
+// rounds, reset() makes the round's result the reference for the next one.
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <Eigen/Dense>
+
+namespace kmeans_detail {
+
+inline void atomic_add(std::atomic<double>& target, double value) {
+    double current = target.load(std::memory_order_relaxed);
+    while (!target.compare_exchange_weak(current, current + value, std::memory_order_relaxed)) {
+    }
+}
+
+// Minimum-cost perfect matching on a square cost matrix (Hungarian algorithm
+// with potentials, O(k^3)). Returns assignment[row] = column.
+inline std::vector<int> hungarian(const Eigen::MatrixXd& cost) {
+    const int n = static_cast<int>(cost.rows());
+    const double inf = std::numeric_limits<double>::infinity();
+    std::vector<double> u(n + 1, 0.0), v(n + 1, 0.0), min_to(n + 1);
+    std::vector<int> match(n + 1, 0), way(n + 1, 0);  // match[column] = row, 1-based
+    std::vector<char> used(n + 1);
+
+    for (int row = 1; row <= n; ++row) {
+        match[0] = row;
+        int col0 = 0;
+        std::fill(min_to.begin(), min_to.end(), inf);
+        std::fill(used.begin(), used.end(), 0);
+        do {
+            used[col0] = 1;
+            int row0 = match[col0];
+            int col1 = 0;
+            double delta = inf;
+            for (int col = 1; col <= n; ++col) {
+                if (used[col]) continue;
+                double reduced = cost(row0 - 1, col - 1) - u[row0] - v[col];
+                if (reduced < min_to[col]) {
+                    min_to[col] = reduced;
+                    way[col] = col0;
+                }
+                if (min_to[col] < delta) {
+                    delta = min_to[col];
+                    col1 = col;
+                }
+            }
+            for (int col = 0; col <= n; ++col) {
+                if (used[col]) {
+                    u[match[col]] += delta;
+                    v[col] -= delta;
+                } else {
+                    min_to[col] -= delta;
+                }
+            }
+            col0 = col1;
+        } while (match[col0] != 0);
+        do {
+            int col1 = way[col0];
+            match[col0] = match[col1];
+            col0 = col1;
+        } while (col0 != 0);
+    }
+
+    std::vector<int> assignment(n);
+    for (int col = 1; col <= n; ++col) assignment[match[col] - 1] = col - 1;
+    return assignment;
+}
+
+// Greedy matching: repeatedly take the cheapest remaining (row, column) pair
+inline std::vector<int> greedy_match(const Eigen::MatrixXd& cost) {
+    const Eigen::Index n = cost.rows();
+    std::vector<std::pair<double, Eigen::Index>> pairs;
+    pairs.reserve(size_t(n) * n);
+    for (Eigen::Index c = 0; c < n; ++c) {
+        for (Eigen::Index r = 0; r < n; ++r) pairs.emplace_back(cost(r, c), c * n + r);
+    }
+    std::sort(pairs.begin(), pairs.end());
+
+    std::vector<int> assignment(n, -1);
+    std::vector<char> taken(n, 0);
+    for (const auto& p : pairs) {
+        Eigen::Index r = p.second % n;
+        Eigen::Index c = p.second / n;
+        if (assignment[r] < 0 && !taken[c]) {
+            assignment[r] = static_cast<int>(c);
+            taken[c] = 1;
+        }
+    }
+    return assignment;
+}
+
+}  // namespace kmeans_detail
+
+class KMeansAggregator {
+public:
+    // Above this many clusters the O(k^3) Hungarian step gives way to greedy matching
+    static constexpr Eigen::Index HUNGARIAN_MAX_CLUSTERS = 256;
+
+    Eigen::Index clusters() const { return k_; }
+    Eigen::Index features() const { return d_; }
+    int contributions() const { return contributions_.load(std::memory_order_acquire); }
+
+    // Match one client's statistics to the global clusters and add them in.
+    // sums is k x d (row j = sum of the points in local cluster j), counts has k entries.
+    void accumulate(const Eigen::MatrixXd& sums, const Eigen::VectorXd& counts) {
+        if (sums.rows() != counts.size() || sums.rows() == 0 || sums.cols() == 0) {
+            throw std::runtime_error("Malformed cluster statistics");
+        }
+        if ((counts.array() < 0).any() || !counts.allFinite() || !sums.allFinite()) {
+            throw std::runtime_error("Cluster statistics must be finite with non-negative counts");
+        }
+        initialize(sums, counts);
+
+        std::vector<int> target = match(sums, counts);
+        for (Eigen::Index j = 0; j < k_; ++j) {
+            if (counts(j) == 0) continue;
+            const Eigen::Index g = target[j];
+            for (Eigen::Index f = 0; f < d_; ++f) kmeans_detail::atomic_add(sums_[g * d_ + f], sums(j, f));
+            kmeans_detail::atomic_add(counts_[g], counts(j));
+        }
+        contributions_.fetch_add(1, std::memory_order_release);
+    }
+
+    // Count-weighted global centroids; clusters nobody has filled yet keep
+    // their initial reference position
+    Eigen::MatrixXd centroids() const {
+        Eigen::MatrixXd out = reference_;
+        for (Eigen::Index j = 0; j < k_; ++j) {
+            double count = counts_[j].load(std::memory_order_relaxed);
+            if (count <= 0) continue;
+            for (Eigen::Index f = 0; f < d_; ++f) out(j, f) = sums_[j * d_ + f].load(std::memory_order_relaxed) / count;
+        }
+        return out;
+    }
+
+    // Start a new round: the current global centroids become the matching
+    // reference and the accumulators are cleared. Must not run concurrently
+    // with accumulate().
+    void reset() {
+        if (state_.load(std::memory_order_acquire) != Ready) return;
+        reference_ = centroids();
+        for (Eigen::Index i = 0; i < k_ * d_; ++i) sums_[i].store(0.0, std::memory_order_relaxed);
+        for (Eigen::Index j = 0; j < k_; ++j) counts_[j].store(0.0, std::memory_order_relaxed);
+        contributions_.store(0, std::memory_order_release);
+    }
+
+private:
+    enum State { Empty, Initializing, Ready };
+
+    // The first caller fixes k, d and the reference centroids; later callers
+    // wait for it and must send the same shape
+    void initialize(const Eigen::MatrixXd& sums, const Eigen::VectorXd& counts) {
+        int expected = Empty;
+        if (state_.compare_exchange_strong(expected, Initializing, std::memory_order_acq_rel)) {
+            k_ = sums.rows();
+            d_ = sums.cols();
+            reference_ = sums.array().colwise() / counts.array().max(1.0);
+            sums_.reset(new std::atomic<double>[k_ * d_]);
+            counts_.reset(new std::atomic<double>[k_]);
+            for (Eigen::Index i = 0; i < k_ * d_; ++i) sums_[i].store(0.0, std::memory_order_relaxed);
+            for (Eigen::Index j = 0; j < k_; ++j) counts_[j].store(0.0, std::memory_order_relaxed);
+            state_.store(Ready, std::memory_order_release);
+        } else {
+            while (state_.load(std::memory_order_acquire) != Ready) std::this_thread::yield();
+        }
+        if (sums.rows() != k_ || sums.cols() != d_) {
+            throw std::runtime_error("Client sent " + std::to_string(sums.rows()) + "x" + std::to_string(sums.cols()) +
+                                     " clusters, server expects " + std::to_string(k_) + "x" + std::to_string(d_));
+        }
+    }
+
+    // target[local cluster] = global cluster, minimising the total squared
+    // distance between local means and the current global centroids
+    std::vector<int> match(const Eigen::MatrixXd& sums, const Eigen::VectorXd& counts) const {
+        Eigen::MatrixXd global = centroids();
+        Eigen::MatrixXd local = sums.array().colwise() / counts.array().max(1.0);
+        Eigen::MatrixXd cost(k_, k_);
+        for (Eigen::Index j = 0; j < k_; ++j) {
+            // Empty local clusters carry no points, so any slot is as good as another
+            if (counts(j) == 0) {
+                cost.row(j).setZero();
+                continue;
+            }
+            for (Eigen::Index g = 0; g < k_; ++g) cost(j, g) = (local.row(j) - global.row(g)).squaredNorm();
+        }
+        return k_ <= HUNGARIAN_MAX_CLUSTERS ? kmeans_detail::hungarian(cost) : kmeans_detail::greedy_match(cost);
+    }
+
+    std::atomic<int> state_{Empty};
+    Eigen::Index k_ = 0;
+    Eigen::Index d_ = 0;
+    Eigen::MatrixXd reference_;                    // First client's means, then the last round's centroids
+    std::unique_ptr<std::atomic<double>[]> sums_;  // k x d, row-major
+    std::unique_ptr<std::atomic<double>[]> counts_;
+    std::atomic<int> contributions_{0};
+};
@@ -0,0 +1,198 @@
+#pragma once
+
+// Blocked k-means assignment / update engine.
+//
+// Points are processed in blocks of rows. For each block the squared distances
+// to all centroids come from one GEMM,
+//     ||x - c||^2 = ||x||^2 - 2 x.c + ||c||^2,
+// the argmin over centroids is taken with AVX2 / AVX-512 when available, and
+// the point is folded into per-cluster sums and counts in the same pass. All
+// buffers live in per-thread workspaces that are reused across iterations, so
+// the steady-state loop does not allocate. Blocks are spread over threads with
+// OpenMP when compiled with -fopenmp.
+
+#include <algorithm>
+#include <limits>
+#include <vector>
+#include <Eigen/Dense>
+#if defined(__AVX2__) || defined(__AVX512F__)
+#include <immintrin.h>
+#endif
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace kmeans_detail {
+
+inline int max_threads() {
+#ifdef _OPENMP
+    return omp_get_max_threads();
+#else
+    return 1;
+#endif
+}
+
+inline int thread_id() {
+#ifdef _OPENMP
+    return omp_get_thread_num();
+#else
+    return 0;
+#endif
+}
+
+// For each of `rows` rows of a column-major block (leading dimension ld, k
+// columns) write the index and value of the smallest entry. Ties go to the
+// lowest index, matching a scalar `<` scan.
+inline void argmin_rows(const double* dist, Eigen::Index rows, Eigen::Index ld, Eigen::Index k, int* labels,
+                        double* best) {
+    Eigen::Index i = 0;
+#if defined(__AVX512F__)
+    for (; i + 8 <= rows; i += 8) {
+        __m512d best_v = _mm512_loadu_pd(dist + i);
+        __m512i best_i = _mm512_setzero_si512();
+        for (Eigen::Index c = 1; c < k; ++c) {
+            __m512d v = _mm512_loadu_pd(dist + c * ld + i);
+            __mmask8 less = _mm512_cmp_pd_mask(v, best_v, _CMP_LT_OQ);
+            best_v = _mm512_mask_blend_pd(less, best_v, v);
+            best_i = _mm512_mask_blend_epi64(less, best_i, _mm512_set1_epi64(c));
+        }
+        _mm512_storeu_pd(best + i, best_v);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(labels + i), _mm512_cvtepi64_epi32(best_i));
+    }
+#elif defined(__AVX2__)
+    for (; i + 4 <= rows; i += 4) {
+        __m256d best_v = _mm256_loadu_pd(dist + i);
+        __m256d best_i = _mm256_setzero_pd();
+        for (Eigen::Index c = 1; c < k; ++c) {
+            __m256d v = _mm256_loadu_pd(dist + c * ld + i);
+            __m256d less = _mm256_cmp_pd(v, best_v, _CMP_LT_OQ);
+            best_v = _mm256_blendv_pd(best_v, v, less);
+            best_i = _mm256_blendv_pd(best_i, _mm256_set1_pd(static_cast<double>(c)), less);
+        }
+        _mm256_storeu_pd(best + i, best_v);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(labels + i), _mm256_cvttpd_epi32(best_i));
+    }
+#endif
+    for (; i < rows; ++i) {
+        double best_v = dist[i];
+        int best_i = 0;
+        for (Eigen::Index c = 1; c < k; ++c) {
+            double v = dist[c * ld + i];
+            if (v < best_v) {
+                best_v = v;
+                best_i = static_cast<int>(c);
+            }
+        }
+        best[i] = best_v;
+        labels[i] = best_i;
+    }
+}
+
+}  // namespace kmeans_detail
+
+class KMeansEngine {
+public:
+    explicit KMeansEngine(Eigen::Index block_rows = 256) : block_rows_(std::max<Eigen::Index>(1, block_rows)) {}
+
+    // Assign every row of `data` to its nearest centroid (rows of `centroids`),
+    // accumulating per-cluster sums and counts in the same pass. Returns the
+    // inertia (sum of squared distances to the assigned centroids).
+    double assign(const Eigen::Ref<const Eigen::MatrixXd>& data, const Eigen::Ref<const Eigen::MatrixXd>& centroids,
+                  Eigen::VectorXi& labels) {
+        const Eigen::Index n = data.rows();
+        const Eigen::Index d = data.cols();
+        const Eigen::Index k = centroids.rows();
+        prepare(d, k);
+        if (labels.size() != n) labels.resize(n);
+
+        neg2_ct_.noalias() = -2.0 * centroids.transpose();
+        centroid_norms_.noalias() = centroids.rowwise().squaredNorm().transpose();
+
+        const Eigen::Index n_blocks = (n + block_rows_ - 1) / block_rows_;
+        for (auto& ws : workspaces_) ws.reset();
+
+#pragma omp parallel for schedule(static)
+        for (Eigen::Index b = 0; b < n_blocks; ++b) {
+            Workspace& ws = workspaces_[kmeans_detail::thread_id()];
+            const Eigen::Index first = b * block_rows_;
+            const Eigen::Index m = std::min(block_rows_, n - first);
+            auto points = data.middleRows(first, m);
+
+            // dist(i, c) = ||c||^2 - 2 x_i.c  (||x_i||^2 is added to the minimum only)
+            auto dist = ws.dist.topRows(m);
+            dist.noalias() = points * neg2_ct_;
+            dist.rowwise() += centroid_norms_;
+
+            kmeans_detail::argmin_rows(ws.dist.data(), m, block_rows_, k, labels.data() + first, ws.best.data());
+
+            for (Eigen::Index i = 0; i < m; ++i) {
+                const int label = labels(first + i);
+                ws.sums.col(label) += points.row(i).transpose();
+                ws.counts(label) += 1;
+                ws.inertia += std::max(0.0, ws.best(i) + points.row(i).squaredNorm());
+            }
+        }
+
+        // Reduce the per-thread partial statistics
+        sums_ = workspaces_[0].sums;
+        counts_ = workspaces_[0].counts;
+        double inertia = workspaces_[0].inertia;
+        for (size_t t = 1; t < workspaces_.size(); ++t) {
+            sums_ += workspaces_[t].sums;
+            counts_ += workspaces_[t].counts;
+            inertia += workspaces_[t].inertia;
+        }
+        return inertia;
+    }
+
+    // Move each centroid to the mean of its points; clusters that received no
+    // points keep their previous position
+    void update_centroids(Eigen::MatrixXd& centroids) const {
+        for (Eigen::Index j = 0; j < centroids.rows(); ++j) {
+            if (counts_(j) > 0) {
+                centroids.row(j) = sums_.col(j).transpose() / counts_(j);
+            }
+        }
+    }
+
+    // Sufficient statistics of the last assign(): sums is d x k, counts has k entries
+    const Eigen::MatrixXd& sums() const { return sums_; }
+    const Eigen::VectorXd& counts() const { return counts_; }
+
+private:
+    struct Workspace {
+        Eigen::MatrixXd dist;  // block_rows x k
+        Eigen::VectorXd best;  // block_rows
+        Eigen::MatrixXd sums;  // d x k
+        Eigen::VectorXd counts;
+        double inertia = 0.0;
+
+        void reset() {
+            sums.setZero();
+            counts.setZero();
+            inertia = 0.0;
+        }
+    };
+
+    // Size the workspaces; only allocates when the shape changes
+    void prepare(Eigen::Index d, Eigen::Index k) {
+        workspaces_.resize(kmeans_detail::max_threads());
+        for (auto& ws : workspaces_) {
+            if (ws.dist.rows() != block_rows_ || ws.dist.cols() != k) ws.dist.resize(block_rows_, k);
+            if (ws.best.size() != block_rows_) ws.best.resize(block_rows_);
+            if (ws.sums.rows() != d || ws.sums.cols() != k) ws.sums.resize(d, k);
+            if (ws.counts.size() != k) ws.counts.resize(k);
+        }
+        if (neg2_ct_.rows() != d || neg2_ct_.cols() != k) neg2_ct_.resize(d, k);
+        if (centroid_norms_.size() != k) centroid_norms_.resize(k);
+        if (sums_.rows() != d || sums_.cols() != k) sums_.resize(d, k);
+        if (counts_.size() != k) counts_.resize(k);
+    }
+
+    Eigen::Index block_rows_;
+    std::vector<Workspace> workspaces_;
+    Eigen::MatrixXd neg2_ct_;          // -2 * centroids^T (d x k)
+    Eigen::RowVectorXd centroid_norms_;
+    Eigen::MatrixXd sums_;
+    Eigen::VectorXd counts_;
+};
@@ -0,0 +1,290 @@
+#pragma once
+
+// K-means drivers on top of KMeansEngine.
+//
+//   Lloyd     : full assignment + update every iteration
+//   MiniBatch : Sculley-style updates from a random sample of the shard per
+//               iteration, with per-centroid learning rates 1 / (points seen)
+//   Hamerly   : Lloyd with one upper and one lower distance bound per point;
+//               once centroids settle, the triangle inequality rules out most
+//               distance computations
+//
+// Every mode stops early once no centroid moves more than `tolerance`.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <random>
+#include <vector>
+#include <Eigen/Dense>
+#include "kmeans_engine.hpp"
+
+enum class KMeansMode { Lloyd, MiniBatch, Hamerly };
+
+struct KMeansOptions {
+    KMeansMode mode = KMeansMode::Lloyd;
+    int max_iters = 10;
+    double tolerance = 1e-4;          // Stop once the largest centroid shift is below this
+    Eigen::Index batch_size = 1024;   // MiniBatch only
+    uint64_t seed = 0;                // MiniBatch sampling
+};
+
+struct KMeansResult {
+    Eigen::MatrixXd centroids;
+    Eigen::VectorXi labels;
+    int iterations = 0;
+    bool converged = false;
+    double inertia = 0.0;
+    size_t distance_evaluations = 0;  // Point-centroid and centroid-centroid distances
+};
+
+namespace kmeans_detail {
+
+using RowMajorMatrixXd = Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>;
+
+// Largest Euclidean distance any centroid moved
+inline double max_shift(const Eigen::MatrixXd& before, const Eigen::MatrixXd& after) {
+    return (after - before).rowwise().norm().maxCoeff();
+}
+
+// Distances from x to its closest and second-closest centroid, with one GEMV
+// against the row-major centroids: ||x - c||^2 = ||x||^2 - 2 x.c + ||c||^2
+inline int nearest_two(const Eigen::VectorXd& x, const RowMajorMatrixXd& centroids,
+                       const Eigen::VectorXd& centroid_norms, Eigen::VectorXd& scratch, double& best, double& second) {
+    scratch.noalias() = centroids * x;
+    const double x_norm = x.squaredNorm();
+    double best_sq = std::numeric_limits<double>::max();
+    double second_sq = std::numeric_limits<double>::max();
+    int best_j = 0;
+    for (Eigen::Index j = 0; j < centroids.rows(); ++j) {
+        double dist = std::max(0.0, x_norm - 2.0 * scratch(j) + centroid_norms(j));
+        if (dist < best_sq) {
+            second_sq = best_sq;
+            best_sq = dist;
+            best_j = static_cast<int>(j);
+        } else if (dist < second_sq) {
+            second_sq = dist;
+        }
+    }
+    best = std::sqrt(best_sq);
+    second = std::sqrt(second_sq);
+    return best_j;
+}
+
+}  // namespace kmeans_detail
+
+inline KMeansResult kmeans_lloyd(const Eigen::Ref<const Eigen::MatrixXd>& data, Eigen::MatrixXd centroids,
+                                 const KMeansOptions& options) {
+    KMeansEngine engine;
+    KMeansResult result;
+    Eigen::MatrixXd previous = centroids;
+
+    for (int iter = 0; iter < options.max_iters; ++iter) {
+        result.inertia = engine.assign(data, centroids, result.labels);
+        result.distance_evaluations += size_t(data.rows()) * centroids.rows();
+        result.iterations = iter + 1;
+
+        previous = centroids;
+        engine.update_centroids(centroids);
+        if (kmeans_detail::max_shift(previous, centroids) <= options.tolerance) {
+            result.converged = true;
+            break;
+        }
+    }
+
+    result.centroids = std::move(centroids);
+    return result;
+}
+
+inline KMeansResult kmeans_minibatch(const Eigen::Ref<const Eigen::MatrixXd>& data, Eigen::MatrixXd centroids,
+                                     const KMeansOptions& options) {
+    KMeansEngine engine;
+    KMeansResult result;
+    const Eigen::Index b = std::min(options.batch_size, data.rows());
+    std::mt19937_64 rng(options.seed);
+    std::uniform_int_distribution<Eigen::Index> pick(0, data.rows() - 1);
+
+    Eigen::MatrixXd batch(b, data.cols());
+    Eigen::VectorXi batch_labels(b);
+    Eigen::VectorXd seen = Eigen::VectorXd::Zero(centroids.rows());  // Points absorbed per centroid so far
+    Eigen::MatrixXd previous = centroids;
+
+    for (int iter = 0; iter < options.max_iters; ++iter) {
+        for (Eigen::Index i = 0; i < b; ++i) batch.row(i) = data.row(pick(rng));
+        engine.assign(batch, centroids, batch_labels);
+        result.distance_evaluations += size_t(b) * centroids.rows();
+        result.iterations = iter + 1;
+
+        // Folding n_j points one at a time with rate 1 / seen_j is the same as
+        // c_j <- (seen_j * c_j + sum_j) / (seen_j + n_j)
+        previous = centroids;
+        for (Eigen::Index j = 0; j < centroids.rows(); ++j) {
+            double n_j = engine.counts()(j);
+            if (n_j == 0) continue;
+            centroids.row(j) = (seen(j) * centroids.row(j) + engine.sums().col(j).transpose()) / (seen(j) + n_j);
+            seen(j) += n_j;
+        }
+        if (kmeans_detail::max_shift(previous, centroids) <= options.tolerance) {
+            result.converged = true;
+            break;
+        }
+    }
+
+    // One full pass for the final labels and inertia
+    result.inertia = engine.assign(data, centroids, result.labels);
+    result.distance_evaluations += size_t(data.rows()) * centroids.rows();
+    result.centroids = std::move(centroids);
+    return result;
+}
+
+inline KMeansResult kmeans_hamerly(const Eigen::Ref<const Eigen::MatrixXd>& data, Eigen::MatrixXd centroids,
+                                   const KMeansOptions& options) {
+    const Eigen::Index n = data.rows();
+    const Eigen::Index d = data.cols();
+    const Eigen::Index k = centroids.rows();
+    KMeansResult result;
+    Eigen::VectorXi& labels = result.labels;
+    labels.resize(n);
+
+    Eigen::VectorXd upper(n);   // >= distance to the assigned centroid
+    Eigen::VectorXd lower(n);   // <= distance to every other centroid
+    Eigen::MatrixXd sums = Eigen::MatrixXd::Zero(d, k);
+    Eigen::VectorXd counts = Eigen::VectorXd::Zero(k);
+
+    const int n_threads = kmeans_detail::max_threads();
+    kmeans_detail::RowMajorMatrixXd centroids_rm = centroids;
+    Eigen::VectorXd centroid_norms = centroids.rowwise().squaredNorm();
+    std::vector<Eigen::VectorXd> thread_point(n_threads, Eigen::VectorXd(d));
+    std::vector<Eigen::VectorXd> thread_scratch(n_threads, Eigen::VectorXd(k));
+    std::vector<Eigen::MatrixXd> thread_sums(n_threads, Eigen::MatrixXd::Zero(d, k));
+    std::vector<Eigen::VectorXd> thread_counts(n_threads, Eigen::VectorXd::Zero(k));
+    std::vector<size_t> thread_evaluations(n_threads, 0);
+
+    // Exact first pass: closest and second-closest centroid per point
+#pragma omp parallel for schedule(static)
+    for (Eigen::Index i = 0; i < n; ++i) {
+        const int t = kmeans_detail::thread_id();
+        Eigen::VectorXd& x = thread_point[t];
+        x = data.row(i).transpose();
+        int a = kmeans_detail::nearest_two(x, centroids_rm, centroid_norms, thread_scratch[t], upper(i), lower(i));
+        labels(i) = a;
+        thread_sums[t].col(a) += x;
+        thread_counts[t](a) += 1;
+    }
+    for (int t = 0; t < n_threads; ++t) {
+        sums += thread_sums[t];
+        counts += thread_counts[t];
+    }
+    result.distance_evaluations += size_t(n) * k;
+
+    Eigen::MatrixXd previous = centroids;
+    Eigen::VectorXd half_gap(k);    // Half the distance to the nearest other centroid
+    Eigen::VectorXd movement(k);
+
+    for (int iter = 0; iter < options.max_iters; ++iter) {
+        result.iterations = iter + 1;
+
+        // Move centroids to the means of their current points
+        previous = centroids;
+        for (Eigen::Index j = 0; j < k; ++j) {
+            if (counts(j) > 0) centroids.row(j) = sums.col(j).transpose() / counts(j);
+        }
+        movement = (centroids - previous).rowwise().norm();
+        if (movement.maxCoeff() <= options.tolerance) {
+            result.converged = true;
+            break;
+        }
+        centroids_rm = centroids;
+        centroid_norms = centroids.rowwise().squaredNorm();
+
+        // Bounds loosen by how far the centroids moved
+        Eigen::Index fastest;
+        double max_move = movement.maxCoeff(&fastest);
+        double second_move = 0.0;
+        for (Eigen::Index j = 0; j < k; ++j) {
+            if (j != fastest) second_move = std::max(second_move, movement(j));
+        }
+
+        half_gap.setConstant(std::numeric_limits<double>::max());
+        for (Eigen::Index j = 0; j < k; ++j) {
+            for (Eigen::Index j2 = j + 1; j2 < k; ++j2) {
+                double gap = 0.5 * (centroids.row(j) - centroids.row(j2)).norm();
+                half_gap(j) = std::min(half_gap(j), gap);
+                half_gap(j2) = std::min(half_gap(j2), gap);
+            }
+        }
+        result.distance_evaluations += size_t(k) * (k - 1) / 2;
+
+        for (int t = 0; t < n_threads; ++t) {
+            thread_sums[t].setZero();
+            thread_counts[t].setZero();
+            thread_evaluations[t] = 0;
+        }
+
+#pragma omp parallel for schedule(static)
+        for (Eigen::Index i = 0; i < n; ++i) {
+            const int t = kmeans_detail::thread_id();
+            const int a = labels(i);
+            upper(i) += movement(a);
+            lower(i) -= (a == fastest) ? second_move : max_move;
+            double bound = std::max(half_gap(a), lower(i));
+            if (upper(i) <= bound) continue;
+
+            // Tighten the upper bound before paying for a full scan
+            Eigen::VectorXd& x = thread_point[t];
+            x = data.row(i).transpose();
+            upper(i) = (x.transpose() - centroids_rm.row(a)).norm();
+            thread_evaluations[t]++;
+            if (upper(i) <= bound) continue;
+
+            int best_j = kmeans_detail::nearest_two(x, centroids_rm, centroid_norms, thread_scratch[t], upper(i), lower(i));
+            thread_evaluations[t] += k - 1;
+            if (best_j != a) {
+                labels(i) = best_j;
+                thread_sums[t].col(a) -= x;
+                thread_sums[t].col(best_j) += x;
+                thread_counts[t](a) -= 1;
+                thread_counts[t](best_j) += 1;
+            }
+        }
+
+        for (int t = 0; t < n_threads; ++t) {
+            sums += thread_sums[t];
+            counts += thread_counts[t];
+            result.distance_evaluations += thread_evaluations[t];
+        }
+    }
+
+    result.inertia = 0.0;
+    for (Eigen::Index i = 0; i < n; ++i) {
+        result.inertia += (data.row(i) - centroids.row(labels(i))).squaredNorm();
+    }
+    result.centroids = std::move(centroids);
+    return result;
+}
+
+// Per-cluster point sums (k x d, one row per cluster) and counts for a labelling
+inline void cluster_statistics(const Eigen::Ref<const Eigen::MatrixXd>& data, const Eigen::VectorXi& labels,
+                               Eigen::Index k, Eigen::MatrixXd& sums, Eigen::VectorXd& counts) {
+    sums = Eigen::MatrixXd::Zero(k, data.cols());
+    counts = Eigen::VectorXd::Zero(k);
+    for (Eigen::Index i = 0; i < data.rows(); ++i) {
+        sums.row(labels(i)) += data.row(i);
+        counts(labels(i)) += 1;
+    }
+}
+
+// Function to run k-means in the requested mode
+inline KMeansResult run_kmeans(const Eigen::Ref<const Eigen::MatrixXd>& data, const Eigen::MatrixXd& centroids,
+                               const KMeansOptions& options = {}) {
+    switch (options.mode) {
+    case KMeansMode::MiniBatch:
+        return kmeans_minibatch(data, centroids, options);
+    case KMeansMode::Hamerly:
+        return kmeans_hamerly(data, centroids, options);
+    case KMeansMode::Lloyd:
+    default:
+        return kmeans_lloyd(data, centroids, options);
+    }
+}
@@ -1,64 +1,106 @@
 
 #include <iostream>
 #include <vector>
+#include <utility>
 #include <boost/asio.hpp>
 #include <Eigen/Dense>
+#include "../common/async_server.hpp"
+#include "../common/trace.hpp"
+#include "../common/wire_protocol.hpp"
+#include "kmeans_aggregator.hpp"
 
 using namespace Eigen;
 using boost::asio::ip::tcp;
 
-MatrixXd global_centroids_sum;
-int num_clients = 0;
-
-// Function to accumulate centroids from clients
-void accumulate_centroids(const MatrixXd& local_centroids) {
-    if (num_clients == 0) {
-        global_centroids_sum = local_centroids;
-    } else {
-        global_centroids_sum += local_centroids;
+// Upper bound on k * d accepted from a client
+const int MAX_CENTROID_VALUES = 1 << 24;
+
+// Round aggregator over k x (d + 1) updates: per-cluster point sums, then the
+// per-cluster counts in the last column. The counts already weight each
+// client, so the sample count is not used.
+class KMeansRoundAggregator : public RoundAggregator {
+public:
+    void add(const MatrixXd& update, double) override {
+        Index d = update.cols() - 1;
+        stats_.accumulate(update.leftCols(d), update.col(d));
     }
-    num_clients++;
-}
-
-void handle_client(tcp::socket socket) {
-    try {
-        // Read the size of the centroid matrix from client
-        int rows, cols;
-        boost::asio::read(socket, boost::asio::buffer(&rows, sizeof(int)));
-        boost::asio::read(socket, boost::asio::buffer(&cols, sizeof(int)));
-
-        // Read the centroids from client
-        MatrixXd local_centroids(rows, cols);
-        boost::asio::read(socket, boost::asio::buffer(local_centroids.data(), rows * cols * sizeof(double)));
 
-        std::cout << "Received local centroids from client:" << local_centroids << std::endl;
+    // KMeansAggregator accumulates with atomics, so sessions may add at once
+    bool concurrent() const override { return true; }
 
-        // Accumulate local centroids
-        accumulate_centroids(local_centroids);
+    MatrixXd finish() override {
+        MatrixXd centroids = stats_.centroids();
+        stats_.reset();
+        return centroids;
+    }
 
-        // Calculate the average centroids
-        MatrixXd global_centroids = global_centroids_sum / num_clients;
+private:
+    // Count-weighted, label-matched global cluster statistics
+    KMeansAggregator stats_;
+};
 
-        // Send updated global centroids back to client
-        boost::asio::write(socket, boost::asio::buffer(global_centroids.data(), rows * cols * sizeof(double)));
+// Runs the training rounds; created in main once the round options are known
+std::unique_ptr<RoundCoordinator> coordinator;
 
+// Serve one client over a persistent connection, one set of cluster statistics per round
+awaitable<void> handle_client(tcp::socket socket) {
+    try {
+        TRACE_CLIENT(client, socket.remote_endpoint());
+        while (true) {
+            // Each update is one frame: round id, sample count and the k x (d + 1) cluster statistics
+            std::optional<FrameHeader> header = co_await async_read_frame_header(socket);
+            if (!header) break;
+            expect_frame(*header, MessageType::Update);
+            int rows = header->rows;
+            int cols = int(header->cols) - 1;
+            if (rows <= 0 || cols <= 0 || (long long)rows * cols > MAX_CENTROID_VALUES) {
+                throw std::runtime_error("Invalid centroid shape " + std::to_string(rows) + "x" + std::to_string(cols));
+            }
+
+            // Read the per-cluster point sums (rows x cols) and point counts (rows)
+            MatrixXd local_stats(rows, cols + 1);
+            co_await async_read_frame_payload(socket, *header, frame_buffer(local_stats));
+
+            std::cout << "Received cluster statistics for round " << header->round << " from client: "
+                      << local_stats.col(cols).sum() << " points in " << rows << " clusters" << std::endl;
+
+            // Wait for the round to close; clusters are matched and count-weighted across clients
+            RoundReply reply;
+            {
+                TRACE_ASYNC_SCOPE_TAGGED("wait_round", header->round, client);
+                reply = co_await async_contribute(*coordinator, header->round, local_stats, header->samples, use_awaitable);
+            }
+            const MatrixXd& global_centroids = *reply.model;
+            if (global_centroids.rows() != rows || global_centroids.cols() != cols) {
+                throw std::runtime_error("Client cluster shape does not match the global centroids");
+            }
+
+            // Send the next round id and the global centroids, flagged final when training is finished
+            co_await async_write_frame(socket,
+                                       frame_header(MessageType::GlobalModel, reply.round, rows, cols, 0.0, DType::Float64,
+                                                    reply.finished ? FRAME_FINAL : 0),
+                                       frame_buffer(global_centroids));
+
+            if (reply.finished) break;
+        }
     } catch (std::exception& e) {
         std::cerr << "Exception in handle_client: " << e.what() << std::endl;
     }
 }
 
-int main() {
+// Usage: ./server [rounds] [expected_clients] [min_clients] [deadline_ms]
+int main(int argc, char** argv) {
     try {
-        boost::asio::io_context io_context;
-        tcp::acceptor acceptor(io_context, tcp::endpoint(tcp::v4(), 8080));
+        RoundOptions options = parse_round_options(argc, argv);
+        TRACE_PROCESS("Kmeans server", -1);
+        coordinator = std::make_unique<RoundCoordinator>(std::make_unique<KMeansRoundAggregator>(), options);
+
+        // Sessions run as coroutines on a fixed thread pool, one strand per connection
+        AsyncServer server(8080, handle_client);
 
         std::cout << "Server started. Waiting for clients..." << std::endl;
 
-        while (true) {
-            tcp::socket socket(io_context);
-            acceptor.accept(socket);
-            std::thread(handle_client, std::move(socket)).detach();
-        }
+        server.run();
 
     } catch (std::exception& e) {
         std::cerr << "Exception: " << e.what() << std::endl;
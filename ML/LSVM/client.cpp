@@ -4,10 +4,17 @@
 #include <random>
 #include <boost/asio.hpp>
 #include <Eigen/Dense>
+#include "../common/data_source.hpp"
+#include "../common/linear_core.hpp"
+#include "../common/trace.hpp"
+#include "../common/wire_protocol.hpp"
 
 using namespace Eigen;
 using boost::asio::ip::tcp;
 
+const int TRAIN_BATCH_SIZE = 4096;  // Rows per batch read from the data source
+const int LOCAL_EPOCHS = 5;         // Local gradient steps between federated rounds
+
 // Shuffle data to simulate different local datasets for each client
 MatrixXd load_local_data() {
     MatrixXd data(4, 2); // 4 samples, 2 features
@@ -36,65 +43,82 @@ VectorXd load_local_labels() {
     return labels;
 }
 
-// Perform one step of training using SGD
-VectorXd train_local_svm(const MatrixXd& data, const VectorXd& labels, VectorXd& weights, double learning_rate) {
-    int n_samples = data.rows();
-    int n_features = data.cols();
-
-    VectorXd gradient = VectorXd::Zero(n_features);
-
-    for (int i = 0; i < n_samples; ++i) {
-        VectorXd xi = data.row(i);
-        double yi = labels(i);
-
-        // Calculate gradient for hinge loss
-        if (yi * (xi.dot(weights)) < 1) {
-            gradient += -yi * xi;
-        }
-    }
-
+// Perform one step of training; the core sums the hinge loss gradient, -y x
+// over the rows inside the margin, over all rows
+VectorXd train_local_svm(LinearCore& core, VectorXd& weights, double learning_rate) {
     // Update weights
-    weights -= learning_rate * gradient;
+    weights -= learning_rate * core.gradient(weights);
 
     return weights;
 }
 
-int main() {
+// Usage: ./client [data.csv|data.bin] [f32]  (defaults to the built-in toy data in float64)
+int main(int argc, char** argv) {
     try {
         boost::asio::io_context io_context;
         tcp::socket socket(io_context);
         socket.connect(tcp::endpoint(boost::asio::ip::address::from_string("127.0.0.1"), 8080));
+        TRACE_PROCESS("LSVM client", trace_client_id(socket.local_endpoint()));
 
         // Load local data
         MatrixXd local_data = load_local_data();
         VectorXd local_labels = load_local_labels();
+        std::unique_ptr<DataSource> source;
+        if (argc > 1) {
+            source = open_data_source(argv[1], TRAIN_BATCH_SIZE);
+        } else {
+            source = std::make_unique<MatrixDataSource>(local_data, local_labels, TRAIN_BATCH_SIZE);
+        }
+
+        // Batched gradients over the source, in float32 when asked for
+        ThreadPool pool;
+        LinearCoreOptions core_options;
+        core_options.pool = &pool;
+        if (argc > 2 && std::string(argv[2]) == "f32") core_options.precision = Precision::Float32;
+        std::unique_ptr<LinearCore> core = make_linear_core(LinearLoss::Hinge, *source, core_options);
 
         // Initialize local model weights with small random values
         std::random_device rd;
         std::mt19937 gen(rd());
         std::normal_distribution<> d(0, 0.01); // Small random values
-        VectorXd local_weights = VectorXd::Zero(local_data.cols()).unaryExpr([&](double dummy) { return d(gen); });
+        VectorXd local_weights = VectorXd::Zero(source->cols()).unaryExpr([&](double dummy) { return d(gen); });
 
         double learning_rate = 0.01;
 
-        // Perform local training (single step for simplicity)
-        VectorXd updated_weights = train_local_svm(local_data, local_labels, local_weights, learning_rate);
-
-        // Print local update
-        std::cout << "Local model update: " << updated_weights.transpose() << std::endl;
-
-        // Send the size of the vector first
-        int vector_size = updated_weights.size();
-        boost::asio::write(socket, boost::asio::buffer(&vector_size, sizeof(int)));
-
-        // Send local update (weights) to server
-        boost::asio::write(socket, boost::asio::buffer(updated_weights.data(), updated_weights.size() * sizeof(double)));
-
-        // Receive updated global model from server
-        VectorXd global_model(local_weights.size());
-        boost::asio::read(socket, boost::asio::buffer(global_model.data(), global_model.size() * sizeof(double)));
-
-        std::cout << "Received updated global model: " << global_model.transpose() << std::endl;
+        // Train locally, exchange the model with the server, repeat until the server ends training
+        int round = 0;
+        bool finished = false;
+        while (!finished) {
+            // Perform local training
+            TRACE_ROUND(round);
+            {
+                TRACE_SCOPE("local_training");
+                for (int epoch = 0; epoch < LOCAL_EPOCHS; ++epoch) {
+                    local_weights = train_local_svm(*core, local_weights, learning_rate);
+                }
+            }
+
+            // Print local update
+            std::cout << "Local model update for round " << round << ": " << local_weights.transpose() << std::endl;
+
+            // Send local update (weights) to server as one frame tagged with the round id and the sample count
+            double num_samples = source->rows();
+            write_frame(socket, frame_header(MessageType::Update, round, local_weights.size(), 1, num_samples),
+                        frame_buffer(local_weights));
+
+            // Receive the next round id and the updated global model from server
+            FrameHeader reply;
+            {
+                TRACE_SCOPE("wait_global_model");
+                reply = read_frame_header(socket);
+            }
+            expect_frame(reply, MessageType::GlobalModel);
+            read_frame_payload(socket, reply, frame_buffer(local_weights));
+            round = reply.round;
+            finished = reply.is_final();
+
+            std::cout << "Received updated global model: " << local_weights.transpose() << std::endl;
+        }
     } catch (std::exception& e) {
         std::cerr << "Exception in client: " << e.what() << std::endl;
     }
@@ -1,84 +1,81 @@
 #include <iostream>
 #include <vector>
 #include <thread>
+#include <utility>
 #include <boost/asio.hpp>
 #include <mutex>
 #include <Eigen/Dense>
-//g++ server_continue.cpp -o server  -I /usr/include/eigen3
+#include "../common/async_server.hpp"
+#include "../common/sharded_aggregator.hpp"
+#include "../common/trace.hpp"
+#include "../common/wire_protocol.hpp"
+//g++ -std=c++20 server.cpp -o server -I /usr/include/eigen3 -lpthread
 
 using namespace Eigen;
 using boost::asio::ip::tcp;
 
-std::mutex model_mutex;
-VectorXd global_weights;
+// Runs the training rounds; created in main once the round options are known
+std::unique_ptr<RoundCoordinator> coordinator;
 
-VectorXd total_weights = VectorXd::Zero(global_weights.size());  // Initialize to zero
-int client_count = 0;
-
-void aggregate_model(const VectorXd& local_update) {
-    std::lock_guard<std::mutex> lock(model_mutex);
-    total_weights += local_update;
-    client_count++;
-    global_weights = total_weights / client_count;
-    std::cout << "[DEBUG] Aggregated global model weights: " << global_weights.transpose() << std::endl;
-}
-
-void handle_client(tcp::socket socket) {
+// Handles the communication with each client over a persistent connection, one update per round
+awaitable<void> handle_client(tcp::socket socket) {
     try {
+        TRACE_CLIENT(client, socket.remote_endpoint());
         std::cout << "[DEBUG] Handling new client connection." << std::endl;
 
-        // Read the size of the incoming vector first
-        int vector_size;
-        boost::asio::read(socket, boost::asio::buffer(&vector_size, sizeof(int)));
-
-        // Resize the local update vector based on the size received
-        VectorXd local_update(vector_size);
-
-        std::cout << "[DEBUG] Waiting to receive data from client..." << std::endl;
-
-        // Read local update from client
-        boost::asio::read(socket, boost::asio::buffer(local_update.data(), local_update.size() * sizeof(double)));
-        std::cout << "[DEBUG] Received local update of size: " << local_update.size() << std::endl;
-
-        // Initialize global_weights and total_weights if not already initialized
-        if (global_weights.size() == 0) {
-            global_weights = VectorXd::Zero(local_update.size());  // Initialize to correct size
-            total_weights = VectorXd::Zero(local_update.size());   // Initialize to the same size
-            std::cout << "[DEBUG] Initialized global_weights and total_weights with size: " << global_weights.size() << std::endl;
-        }
-
-        // Ensure sizes match before aggregating
-        if (global_weights.size() == local_update.size()) {
-            aggregate_model(local_update);
-        } else {
-            std::cerr << "[ERROR] Size mismatch between global model and local update!" << std::endl;
+        while (true) {
+            // Each update is one frame: round id, sample count and the weights as a column vector
+            std::optional<FrameHeader> header = co_await async_read_frame_header(socket);
+            if (!header) break;
+            expect_frame(*header, MessageType::Update);
+            if (header->rows == 0 || header->cols != 1) {
+                std::cerr << "[ERROR] Received local update of shape " << header->rows << "x" << header->cols << std::endl;
+                co_return;
+            }
+
+            // Read the actual local model update from the client
+            VectorXd local_update(header->rows);
+            co_await async_read_frame_payload(socket, *header, frame_buffer(local_update));
+            std::cout << "[DEBUG] Received local update for round " << header->round << " of size " << local_update.size()
+                      << " from " << header->samples << " samples" << std::endl;
+
+            // Wait for the round to close and get the sample-weighted global model
+            RoundReply reply;
+            {
+                TRACE_ASYNC_SCOPE_TAGGED("wait_round", header->round, client);
+                reply = co_await async_contribute(*coordinator, header->round, local_update, header->samples, use_awaitable);
+            }
+
+            // Reply with the next round id and the model, flagged final when training is finished
+            co_await async_write_frame(socket,
+                                       frame_header(MessageType::GlobalModel, reply.round, reply.model->rows(), reply.model->cols(),
+                                                    0.0, DType::Float64, reply.finished ? FRAME_FINAL : 0),
+                                       frame_buffer(*reply.model));
+            std::cout << "[DEBUG] Sent global model for round " << reply.round << " to client, size: "
+                      << reply.model->size() << std::endl;
+
+            if (reply.finished) break;
         }
-
-        // Send updated global model back to client
-        boost::asio::write(socket, boost::asio::buffer(global_weights.data(), global_weights.size() * sizeof(double)));
-        std::cout << "[DEBUG] Sent updated global model to client." << std::endl;
-
     } catch (std::exception& e) {
         std::cerr << "[ERROR] Exception in handle_client: " << e.what() << std::endl;
     }
 }
 
-int main() {
+// Usage: ./server [rounds] [expected_clients] [min_clients] [deadline_ms]
+int main(int argc, char** argv) {
     try {
-        boost::asio::io_context io_context;
-        tcp::acceptor acceptor(io_context, tcp::endpoint(tcp::v4(), 8080));
+        RoundOptions options = parse_round_options(argc, argv);
+        TRACE_PROCESS("LSVM server", -1);
+        coordinator = std::make_unique<RoundCoordinator>(std::make_unique<ShardedAggregator>(), options);
 
-        std::cout << "[DEBUG] Server started. Waiting for clients on port 8080..." << std::endl;
+        // Sessions run as coroutines on a fixed thread pool, one strand per connection
+        AsyncServer server(8080, handle_client);
 
-        while (true) {
-            tcp::socket socket(io_context);
-            std::cout << "[DEBUG] Waiting for new client connection..." << std::endl;
-            acceptor.accept(socket);
-            std::cout << "[DEBUG] Client connected." << std::endl;
+        std::cout << "[DEBUG] Server started. Waiting for clients on port 8080..." << std::endl;
+        std::cout << "[DEBUG] " << options.rounds << " rounds, " << options.expected_clients << " clients per round ("
+                  << options.min_clients << " after " << options.deadline.count() << " ms)" << std::endl;
 
-            // Start a thread to handle each client
-            std::thread(handle_client, std::move(socket)).detach();
-        }
+        server.run();
     } catch (std::exception& e) {
         std::cerr << "[ERROR] Exception in main: " << e.what() << std::endl;
     }
@@ -4,10 +4,17 @@
 #include <random>
 #include <boost/asio.hpp>
 #include <Eigen/Dense>
+#include "../common/data_source.hpp"
+#include "../common/linear_core.hpp"
+#include "../common/trace.hpp"
+#include "../common/wire_protocol.hpp"
 
 using namespace Eigen;
 using boost::asio::ip::tcp;
 
+const int TRAIN_BATCH_SIZE = 4096;  // Rows per batch read from the data source
+const int LOCAL_EPOCHS = 5;         // Local gradient steps between federated rounds
+
 // Load local data for linear regression
 MatrixXd load_local_data() {
     MatrixXd data(4, 2); // 4 samples, 2 features
@@ -37,35 +44,39 @@ VectorXd load_local_labels() {
     return labels;
 }
 
-// Perform one step of gradient descent for linear regression
-VectorXd train_local_linear_regression(const MatrixXd& data, const VectorXd& labels, VectorXd& weights, double learning_rate) {
-    int n_samples = data.rows();
-    int n_features = data.cols();
-
-    VectorXd gradient = VectorXd::Zero(n_features);
-
-    for (int i = 0; i < n_samples; ++i) {
-        VectorXd xi = data.row(i);
-        double yi = labels(i);
-        // Gradient of the squared loss
-        gradient += -2 * xi * (yi - xi.dot(weights));
-    }
-
+// Perform one step of gradient descent for linear regression; the core sums
+// the gradient of the squared loss over all rows
+VectorXd train_local_linear_regression(LinearCore& core, int n_samples, VectorXd& weights, double learning_rate) {
     // Update weights
-    weights -= learning_rate * gradient / n_samples;
+    weights -= learning_rate * core.gradient(weights) / n_samples;
 
     return weights;
 }
 
-int main() {
+// Usage: ./client [data.csv|data.bin] [f32]  (defaults to the built-in toy data in float64)
+int main(int argc, char** argv) {
     try {
         boost::asio::io_context io_context;
         tcp::socket socket(io_context);
         socket.connect(tcp::endpoint(boost::asio::ip::address::from_string("127.0.0.1"), 8080));
+        TRACE_PROCESS("Linear_Regression client", trace_client_id(socket.local_endpoint()));
 
         // Load local data and labels
         MatrixXd local_data = load_local_data();
         VectorXd local_labels = load_local_labels();
+        std::unique_ptr<DataSource> source;
+        if (argc > 1) {
+            source = open_data_source(argv[1], TRAIN_BATCH_SIZE);
+        } else {
+            source = std::make_unique<MatrixDataSource>(local_data, local_labels, TRAIN_BATCH_SIZE);
+        }
+
+        // Batched gradients over the source, in float32 when asked for
+        ThreadPool pool;
+        LinearCoreOptions core_options;
+        core_options.pool = &pool;
+        if (argc > 2 && std::string(argv[2]) == "f32") core_options.precision = Precision::Float32;
+        std::unique_ptr<LinearCore> core = make_linear_core(LinearLoss::Squared, *source, core_options);
 
         // Debug: print loaded data and labels
         std::cout << "[DEBUG] Loaded local data: \n" << local_data << std::endl;
@@ -75,7 +86,7 @@ int main() {
         std::random_device rd;
         std::mt19937 gen(rd());
         std::uniform_real_distribution<> dis(-0.1, 0.1);
-        VectorXd weights(local_data.cols());
+        VectorXd weights(source->cols());
         for (int i = 0; i < weights.size(); ++i) {
             weights(i) = dis(gen);
         }
@@ -83,30 +94,41 @@ int main() {
         // Debug: print initialized weights
         std::cout << "[DEBUG] Initialized weights: " << weights.transpose() << std::endl;
 
-        // Train local model
+        // Train locally, exchange the model with the server, repeat until the server ends training
         double learning_rate = 0.01;
-        weights = train_local_linear_regression(local_data, local_labels, weights, learning_rate);
-
-        // Debug: print weights after training
-        std::cout << "[DEBUG] Weights after training: " << weights.transpose() << std::endl;
-
-        //  local update to the server
-        //std:Send:cout << "[DEBUG] Sending local weights to server: " << weights.transpose() << std::endl;
-        
-        // Send the number of features first
-        int num_features = weights.size();
-        boost::asio::write(socket, boost::asio::buffer(&num_features, sizeof(int)));
-
-        // Then send the local update (weights)
-        boost::asio::write(socket, boost::asio::buffer(weights.data(), weights.size() * sizeof(double)));
-        std::cout << "[DEBUG] Sending local weights to server: " << weights.transpose() << std::endl;
-
-
-        // Receive updated global model from the server
-        boost::asio::read(socket, boost::asio::buffer(weights.data(), weights.size() * sizeof(double)));
-
-        // Debug: print updated global weights received
-        std::cout << "[DEBUG] Updated global weights received from server: " << weights.transpose() << std::endl;
+        int round = 0;
+        bool finished = false;
+        while (!finished) {
+            TRACE_ROUND(round);
+            {
+                TRACE_SCOPE("local_training");
+                for (int epoch = 0; epoch < LOCAL_EPOCHS; ++epoch) {
+                    weights = train_local_linear_regression(*core, source->rows(), weights, learning_rate);
+                }
+            }
+
+            // Debug: print weights after training
+            std::cout << "[DEBUG] Weights after training round " << round << ": " << weights.transpose() << std::endl;
+
+            // Send the local update (weights) as one frame tagged with the round id and the number of samples
+            double num_samples = source->rows();
+            write_frame(socket, frame_header(MessageType::Update, round, weights.size(), 1, num_samples), frame_buffer(weights));
+            std::cout << "[DEBUG] Sending local weights to server: " << weights.transpose() << std::endl;
+
+            // Receive the next round id and the updated global model from the server
+            FrameHeader reply;
+            {
+                TRACE_SCOPE("wait_global_model");
+                reply = read_frame_header(socket);
+            }
+            expect_frame(reply, MessageType::GlobalModel);
+            read_frame_payload(socket, reply, frame_buffer(weights));
+            round = reply.round;
+            finished = reply.is_final();
+
+            // Debug: print updated global weights received
+            std::cout << "[DEBUG] Updated global weights received from server: " << weights.transpose() << std::endl;
+        }
 
     } catch (std::exception& e) {
         std::cerr << "Exception: " << e.what() << std::endl;
@@ -6,14 +6,16 @@
 #include <boost/asio.hpp>
 #include <Eigen/Dense>
 #include <cmath>
+#include "../common/data_source.hpp"
+#include "../common/linear_core.hpp"
+#include "../common/trace.hpp"
+#include "../common/wire_protocol.hpp"
 
 using namespace Eigen;
 using boost::asio::ip::tcp;
 
-// Sigmoid function for logistic regression
-double sigmoid(double z) {
-    return 1.0 / (1.0 + std::exp(-z));
-}
+const int TRAIN_BATCH_SIZE = 4096;  // Rows per batch read from the data source
+const int LOCAL_EPOCHS = 5;         // Local gradient steps between federated rounds
 
 // Load local data for logistic regression
 MatrixXd load_local_data() {
@@ -44,42 +46,45 @@ VectorXd load_local_labels() {
     return labels;
 }
 
-// Perform one step of gradient descent for logistic regression
-VectorXd train_local_logistic_regression(const MatrixXd& data, const VectorXd& labels, VectorXd& weights, double learning_rate) {
-    int n_samples = data.rows();
-    int n_features = data.cols();
-
-    VectorXd gradient = VectorXd::Zero(n_features);
-
-    for (int i = 0; i < n_samples; ++i) {
-        VectorXd xi = data.row(i);
-        double yi = labels(i);
-        double prediction = sigmoid(xi.dot(weights)); // Logistic prediction
-        // Gradient of the log-loss
-        gradient += xi * (prediction - yi);
-    }
-
+// Perform one step of gradient descent for logistic regression; the core sums
+// the gradient of the log-loss, X^T (sigmoid(Xw) - y), over all rows
+VectorXd train_local_logistic_regression(LinearCore& core, int n_samples, VectorXd& weights, double learning_rate) {
     // Update weights
-    weights -= learning_rate * gradient / n_samples;
+    weights -= learning_rate * core.gradient(weights) / n_samples;
 
     return weights;
 }
 
-int main() {
+// Usage: ./client [data.csv|data.bin] [f32]  (defaults to the built-in toy data in float64)
+int main(int argc, char** argv) {
     try {
         boost::asio::io_context io_context;
         tcp::socket socket(io_context);
         socket.connect(tcp::endpoint(boost::asio::ip::address::from_string("127.0.0.1"), 8080));
+        TRACE_PROCESS("Logistic_Regression client", trace_client_id(socket.local_endpoint()));
 
         // Load local data and labels
         MatrixXd local_data = load_local_data();
         VectorXd local_labels = load_local_labels();
+        std::unique_ptr<DataSource> source;
+        if (argc > 1) {
+            source = open_data_source(argv[1], TRAIN_BATCH_SIZE);
+        } else {
+            source = std::make_unique<MatrixDataSource>(local_data, local_labels, TRAIN_BATCH_SIZE);
+        }
+
+        // Batched gradients over the source, in float32 when asked for
+        ThreadPool pool;
+        LinearCoreOptions core_options;
+        core_options.pool = &pool;
+        if (argc > 2 && std::string(argv[2]) == "f32") core_options.precision = Precision::Float32;
+        std::unique_ptr<LinearCore> core = make_linear_core(LinearLoss::Logistic, *source, core_options);
 
         // Initialize weights
         std::random_device rd;
         std::mt19937 gen(rd());
         std::uniform_real_distribution<> dis(-0.1, 0.1);
-        VectorXd weights(local_data.cols());
+        VectorXd weights(source->cols());
         for (int i = 0; i < weights.size(); ++i) {
             weights(i) = dis(gen);
         }
@@ -87,27 +92,39 @@ int main() {
 
         double learning_rate = 0.01;
 
-        // Train the local model
-        VectorXd updated_weights = train_local_logistic_regression(local_data, local_labels, weights, learning_rate);
-
-        // Send the size of the weight vector first
-        size_t vector_size = updated_weights.size();
-        boost::asio::write(socket, boost::asio::buffer(&vector_size, sizeof(vector_size)));
-        std::cout << "[DEBUG] Sent local weights size: " << vector_size << std::endl;
-
-        // Send the actual weight vector
-        boost::asio::write(socket, boost::asio::buffer(updated_weights.data(), updated_weights.size() * sizeof(double)));
-        std::cout << "[DEBUG] Sent local model to server." << std::endl;
-
-        // Ensure the size of the global weights matches
-        VectorXd global_weights = VectorXd::Zero(weights.size());
-
-        // Read the updated global model from the server
-        boost::asio::read(socket, boost::asio::buffer(global_weights.data(), global_weights.size() * sizeof(double)));
-        std::cout << "[DEBUG] Received updated global model from server, size: " << global_weights.size() << std::endl;
+        // Train locally, exchange the model with the server, repeat until the server ends training
+        int round = 0;
+        bool finished = false;
+        while (!finished) {
+            // Train the local model
+            TRACE_ROUND(round);
+            {
+                TRACE_SCOPE("local_training");
+                for (int epoch = 0; epoch < LOCAL_EPOCHS; ++epoch) {
+                    weights = train_local_logistic_regression(*core, source->rows(), weights, learning_rate);
+                }
+            }
+
+            // Send the weight vector as one frame tagged with the round id and the sample count
+            double num_samples = source->rows();
+            write_frame(socket, frame_header(MessageType::Update, round, weights.size(), 1, num_samples), frame_buffer(weights));
+            std::cout << "[DEBUG] Sent local model of size " << weights.size() << " for round " << round << std::endl;
+
+            // Read the next round id and the updated global model from the server
+            FrameHeader reply;
+            {
+                TRACE_SCOPE("wait_global_model");
+                reply = read_frame_header(socket);
+            }
+            expect_frame(reply, MessageType::GlobalModel);
+            read_frame_payload(socket, reply, frame_buffer(weights));
+            round = reply.round;
+            finished = reply.is_final();
+            std::cout << "[DEBUG] Received updated global model from server, size: " << weights.size() << std::endl;
+        }
 
         // Print the coefficients (weights)
-        std::cout << "[INFO] Final model coefficients (weights): " << global_weights.transpose() << std::endl;
+        std::cout << "[INFO] Final model coefficients (weights): " << weights.transpose() << std::endl;
 
     } catch (std::exception& e) {
         std::cerr << "[ERROR] Exception: " << e.what() << std::endl;
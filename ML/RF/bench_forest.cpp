@@ -0,0 +1,211 @@
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <limits>
+#include <map>
+#include <random>
+#include <vector>
+#include <Eigen/Dense>
+#include "flat_forest.hpp"
+#include "forest_codec.hpp"
+
+using namespace Eigen;
+// g++ -O3 -march=native -std=c++17 bench_forest.cpp -o bench_forest -I /usr/include/eigen3
+// ./bench_forest [rows] [features] [trees] [max_depth]
+//
+// Scores random forests with the original linked trees and with FlatForest,
+// then compares the preorder double payload with the compact encodings in size,
+// load time and predictions.
+
+// The original server representation: linked nodes, recursive prediction
+struct TreeNode {
+    int feature_index = -1;
+    double threshold = 0.0;
+    double prediction = 0.0;
+    TreeNode* left = nullptr;
+    TreeNode* right = nullptr;
+};
+
+TreeNode* deserialize_tree_node(const std::vector<double>& serialized_tree, size_t& index) {
+    TreeNode* node = new TreeNode;
+    node->feature_index = static_cast<int>(serialized_tree[index++]);
+    node->threshold = serialized_tree[index++];
+    node->prediction = serialized_tree[index++];
+    if (node->feature_index != -1) {
+        node->left = deserialize_tree_node(serialized_tree, index);
+        node->right = deserialize_tree_node(serialized_tree, index);
+    }
+    return node;
+}
+
+double predict_tree(const TreeNode* node, const Eigen::VectorXd& x) {
+    if (!node->left && !node->right) return node->prediction;
+    return x(node->feature_index) <= node->threshold ? predict_tree(node->left, x) : predict_tree(node->right, x);
+}
+
+std::vector<double> majority_voting(const std::vector<TreeNode*>& trees, const MatrixXd& test_data) {
+    std::vector<double> final_predictions(test_data.rows(), 0.0);
+    for (int i = 0; i < test_data.rows(); ++i) {
+        std::map<double, int> votes_count;
+        for (const auto& tree : trees) votes_count[predict_tree(tree, test_data.row(i))]++;
+        int max_votes = 0;
+        double best_class = -1;
+        for (const auto& [predicted_class, count] : votes_count) {
+            if (count > max_votes) {
+                max_votes = count;
+                best_class = predicted_class;
+            }
+        }
+        final_predictions[i] = best_class;
+    }
+    return final_predictions;
+}
+
+// Random preorder tree in the client's wire format: splits on random features
+// at random thresholds, leaves labelled -1 / +1, stopping early now and then
+void random_tree(std::vector<double>& out, int depth, int max_depth, int features, std::mt19937_64& rng) {
+    std::uniform_real_distribution<double> unit(0.0, 1.0);
+    if (depth >= max_depth || (depth > 2 && unit(rng) < 0.1)) {
+        out.insert(out.end(), {-1.0, 0.0, unit(rng) < 0.5 ? -1.0 : 1.0});
+        return;
+    }
+    out.insert(out.end(), {double(rng() % features), unit(rng) * 2.0 - 1.0, 0.0});
+    random_tree(out, depth + 1, max_depth, features, rng);
+    random_tree(out, depth + 1, max_depth, features, rng);
+}
+
+void free_tree(TreeNode* node) {
+    if (!node) return;
+    free_tree(node->left);
+    free_tree(node->right);
+    delete node;
+}
+
+template <typename Fn>
+double seconds(Fn&& fn) {
+    auto start = std::chrono::steady_clock::now();
+    fn();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char** argv) {
+    int rows = argc > 1 ? std::stoi(argv[1]) : 100000;
+    int features = argc > 2 ? std::stoi(argv[2]) : 20;
+    int n_trees = argc > 3 ? std::stoi(argv[3]) : 100;
+    int max_depth = argc > 4 ? std::stoi(argv[4]) : 10;
+
+    std::mt19937_64 rng(5);
+    std::vector<double> serialized;
+    for (int t = 0; t < n_trees; ++t) random_tree(serialized, 0, max_depth, features, rng);
+    MatrixXd X = MatrixXd::Random(rows, features);
+
+    std::vector<TreeNode*> trees;
+    FlatForest forest;
+    double parse_linked = seconds([&]() {
+        size_t index = 0;
+        while (index < serialized.size()) trees.push_back(deserialize_tree_node(serialized, index));
+    });
+    double parse_flat = seconds([&]() { forest.append_serialized(serialized); });
+
+    std::vector<double> expected, predicted;
+    double linked = seconds([&]() { expected = majority_voting(trees, X); });
+    double flat = seconds([&]() { predicted = forest.predict(X); });
+
+    size_t mismatches = 0;
+    for (int i = 0; i < rows; ++i) mismatches += expected[i] != predicted[i];
+
+    // Compact encodings: decoded forests must score like the original, exactly
+    // with float64 thresholds and up to values within float32 rounding with float32
+    std::vector<const TreeNode*> roots(trees.begin(), trees.end());
+    ForestEncoding exact;
+    exact.float64_thresholds = true;
+    ForestEncoding fixed_width;
+    fixed_width.varint_features = false;
+    struct Encoding {
+        const char* name;
+        ForestEncoding options;
+    };
+    std::vector<Encoding> encodings = {{"f32 varint", {}}, {"f32 int16", fixed_width}, {"f64 varint", exact}};
+    std::vector<std::vector<uint8_t>> encoded_forests;
+    std::vector<double> decode_seconds;
+    std::vector<size_t> encoded_mismatches;
+    for (const Encoding& encoding : encodings) {
+        std::vector<uint8_t> encoded = encode_forest(roots, encoding.options);
+        FlatForest decoded;
+        decode_seconds.push_back(seconds([&]() { decode_forest(encoded.data(), encoded.size(), decoded); }));
+        std::vector<double> decoded_predictions = decoded.predict(X);
+        size_t differing = 0;
+        for (int i = 0; i < rows; ++i) differing += expected[i] != decoded_predictions[i];
+        encoded_mismatches.push_back(differing);
+        encoded_forests.push_back(std::move(encoded));
+    }
+
+    std::cout << "[INFO] " << rows << " rows x " << features << " features, " << n_trees << " trees of depth <= "
+              << max_depth << " (" << forest.nodes() << " nodes)" << std::endl;
+    std::cout << std::fixed << std::setprecision(4);
+    std::cout << "  load    linked " << parse_linked << " s   flat " << parse_flat << " s" << std::endl;
+    std::cout << "  score   linked " << linked << " s   flat " << flat << " s   speedup " << std::setprecision(1)
+              << linked / flat << "x   (" << std::setprecision(0) << rows / flat << " rows/s)" << std::endl;
+    std::cout << "  predictions differing: " << mismatches << std::endl;
+
+    const double preorder_bytes = double(serialized.size() * sizeof(double));
+    std::cout << std::setprecision(4) << "  payload preorder   " << std::setw(10) << size_t(preorder_bytes)
+              << " bytes   load " << parse_flat << " s" << std::endl;
+    for (size_t e = 0; e < encodings.size(); ++e) {
+        std::cout << "  payload " << std::left << std::setw(11) << encodings[e].name << std::right << std::setw(10)
+                  << encoded_forests[e].size() << " bytes   load " << decode_seconds[e] << " s   "
+                  << std::setprecision(1) << preorder_bytes / encoded_forests[e].size() << "x smaller   "
+                  << std::setprecision(4) << encoded_mismatches[e] << " predictions differing" << std::endl;
+    }
+    bool exact_matches = encoded_mismatches.back() == 0;
+
+    // A payload that fails part way must leave the target forest as it was,
+    // including leaves whose class ids a new label shifted
+    FlatForest target;
+    decode_forest(encoded_forests.back().data(), encoded_forests.back().size(), target);
+    const size_t target_nodes = target.nodes(), target_trees = target.trees();
+    const std::vector<double> target_classes = target.classes();
+    TreeNode new_label;
+    new_label.prediction = -7.0;
+    std::vector<uint8_t> trailing = encode_forest(std::vector<const TreeNode*>{&new_label, roots[0]});
+    trailing.push_back(0);
+    // One single-leaf tree per label, one label more than a forest may hold
+    std::vector<TreeNode> label_leaves(FlatForest::MAX_CLASSES + 1);
+    std::vector<const TreeNode*> label_trees;
+    for (size_t i = 0; i < label_leaves.size(); ++i) {
+        label_leaves[i].prediction = 100.0 + double(i);
+        label_trees.push_back(&label_leaves[i]);
+    }
+    std::vector<uint8_t> too_many_classes = encode_forest(label_trees);
+    std::vector<uint8_t> truncated(encoded_forests.back().begin(), encoded_forests.back().end() - 1);
+    size_t rejected = 0;
+    for (const std::vector<uint8_t>* bad : {&trailing, &truncated, &too_many_classes}) {
+        try {
+            decode_forest(bad->data(), bad->size(), target);
+        } catch (const std::runtime_error&) {
+            ++rejected;
+        }
+    }
+    std::vector<double> preorder_truncated(serialized.begin(), serialized.end() - 1);
+    std::vector<double> preorder_nan_leaf = serialized;
+    preorder_nan_leaf.insert(preorder_nan_leaf.end(), {-1.0, 0.0, std::numeric_limits<double>::quiet_NaN()});
+    std::vector<double> preorder_too_many_classes;
+    for (const TreeNode& leaf : label_leaves) {
+        preorder_too_many_classes.insert(preorder_too_many_classes.end(), {-1.0, 0.0, leaf.prediction});
+    }
+    for (const std::vector<double>* bad : {&preorder_truncated, &preorder_nan_leaf, &preorder_too_many_classes}) {
+        try {
+            target.append_serialized(*bad);
+        } catch (const std::runtime_error&) {
+            ++rejected;
+        }
+    }
+    bool rolled_back = rejected == 6 && target.nodes() == target_nodes && target.trees() == target_trees &&
+                       target.classes() == target_classes && target.predict(X) == expected;
+    std::cout << "  rejected payloads: " << rejected << " of 6, forest " << (rolled_back ? "unchanged" : "CHANGED")
+              << std::endl;
+
+    for (TreeNode* tree : trees) free_tree(tree);
+    return mismatches == 0 && exact_matches && rolled_back ? 0 : 1;
+}
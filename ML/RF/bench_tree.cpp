@@ -0,0 +1,238 @@
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <limits>
+#include <memory>
+#include <random>
+#include <thread>
+#include <vector>
+#include <Eigen/Dense>
+#include "hist_tree.hpp"
+
+using namespace Eigen;
+// g++ -O3 -march=native -std=c++17 bench_tree.cpp -o bench_tree -I /usr/include/eigen3
+// ./bench_tree [baseline_rows] [features] [forest_trees]
+//
+// Trains one depth-10 tree with the original exhaustive trainer and with the
+// histogram trainer on the same data and compares time and test accuracy,
+// then shows how the histogram trainer scales with the row count. Finally a
+// bootstrapped forest is trained on thread pools of growing size, checking
+// that every pool size produces the same trees.
+
+// The original trainer: every row value of every feature as a threshold,
+// copying both sides of each candidate split
+void split_data(const MatrixXd& data, const VectorXd& labels, int feature_index, double threshold,
+                MatrixXd& left_data, VectorXd& left_labels, MatrixXd& right_data, VectorXd& right_labels) {
+    std::vector<int> left_indices, right_indices;
+    for (int i = 0; i < data.rows(); ++i) {
+        (data(i, feature_index) <= threshold ? left_indices : right_indices).push_back(i);
+    }
+    left_data.resize(left_indices.size(), data.cols());
+    left_labels.resize(left_indices.size());
+    right_data.resize(right_indices.size(), data.cols());
+    right_labels.resize(right_indices.size());
+    for (size_t i = 0; i < left_indices.size(); ++i) {
+        left_data.row(i) = data.row(left_indices[i]);
+        left_labels(i) = labels(left_indices[i]);
+    }
+    for (size_t i = 0; i < right_indices.size(); ++i) {
+        right_data.row(i) = data.row(right_indices[i]);
+        right_labels(i) = labels(right_indices[i]);
+    }
+}
+
+double gini_impurity(const VectorXd& labels) {
+    int n_samples = labels.size();
+    if (n_samples == 0) return 0.0;
+    double prob_pos = (labels.array() == 1.0).count() / double(n_samples);
+    return 1.0 - (prob_pos * prob_pos + (1 - prob_pos) * (1 - prob_pos));
+}
+
+TreeNode* train_tree(const MatrixXd& data, const VectorXd& labels, int depth = 0, int max_depth = 10) {
+    TreeNode* node = new TreeNode();
+    if (depth >= max_depth || labels.size() <= 1 || gini_impurity(labels) == 0) {
+        node->prediction = (labels.sum() >= 0) ? 1.0 : -1.0;
+        return node;
+    }
+    double best_gini = std::numeric_limits<double>::max();
+    int best_feature = -1;
+    double best_threshold = 0.0;
+    MatrixXd best_left_data, best_right_data;
+    VectorXd best_left_labels, best_right_labels;
+    for (int feature_index = 0; feature_index < data.cols(); ++feature_index) {
+        for (int i = 0; i < data.rows(); ++i) {
+            double threshold = data(i, feature_index);
+            MatrixXd left_data, right_data;
+            VectorXd left_labels, right_labels;
+            split_data(data, labels, feature_index, threshold, left_data, left_labels, right_data, right_labels);
+            if (left_labels.size() == 0 || right_labels.size() == 0) continue;
+            double weighted_gini = (left_labels.size() * gini_impurity(left_labels) +
+                                    right_labels.size() * gini_impurity(right_labels)) / labels.size();
+            if (weighted_gini < best_gini) {
+                best_gini = weighted_gini;
+                best_feature = feature_index;
+                best_threshold = threshold;
+                best_left_data = left_data;
+                best_right_data = right_data;
+                best_left_labels = left_labels;
+                best_right_labels = right_labels;
+            }
+        }
+    }
+    if (best_feature == -1) {
+        node->prediction = (labels.sum() >= 0) ? 1.0 : -1.0;
+        return node;
+    }
+    node->feature_index = best_feature;
+    node->threshold = best_threshold;
+    node->left = train_tree(best_left_data, best_left_labels, depth + 1, max_depth);
+    node->right = train_tree(best_right_data, best_right_labels, depth + 1, max_depth);
+    return node;
+}
+
+double predict(const TreeNode* node, const Ref<const RowVectorXd>& x) {
+    while (node->feature_index != -1) node = x(node->feature_index) <= node->threshold ? node->left : node->right;
+    return node->prediction;
+}
+
+void free_tree(TreeNode* node) {
+    if (!node) return;
+    free_tree(node->left);
+    free_tree(node->right);
+    delete node;
+}
+
+// Labels from a noisy nonlinear rule over the first few features
+void make_data(int rows, int features, std::mt19937_64& rng, MatrixXd& X, VectorXd& y) {
+    std::normal_distribution<double> normal(0.0, 1.0);
+    X = MatrixXd::NullaryExpr(rows, features, [&]() { return normal(rng); });
+    y.resize(rows);
+    for (int i = 0; i < rows; ++i) {
+        double score = X(i, 0) * X(i, 1) + std::sin(2.0 * X(i, 2)) + 0.3 * normal(rng);
+        y(i) = score >= 0 ? 1.0 : -1.0;
+    }
+}
+
+double accuracy(const TreeNode* tree, const MatrixXd& X, const VectorXd& y) {
+    int correct = 0;
+    for (int i = 0; i < X.rows(); ++i) correct += predict(tree, X.row(i)) == y(i);
+    return double(correct) / X.rows();
+}
+
+template <typename Fn>
+double seconds(Fn&& fn) {
+    auto start = std::chrono::steady_clock::now();
+    fn();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+TreeNode* train_hist(const MatrixXd& X, const VectorXd& y, double& bin_seconds) {
+    TreeNode* tree = nullptr;
+    std::unique_ptr<BinnedMatrix> binned;
+    bin_seconds = seconds([&]() { binned = std::make_unique<BinnedMatrix>(X); });
+    std::vector<uint32_t> rows(X.rows());
+    for (size_t i = 0; i < rows.size(); ++i) rows[i] = uint32_t(i);
+    HistTreeTrainer trainer(*binned, y);
+    tree = trainer.train(std::move(rows));
+    return tree;
+}
+
+void serialize(const TreeNode* node, std::vector<double>& out) {
+    out.insert(out.end(), {double(node->feature_index), node->threshold, node->prediction});
+    if (node->feature_index != -1) {
+        serialize(node->left, out);
+        serialize(node->right, out);
+    }
+}
+
+// Forest of bootstrapped trees, trained the way RandomForest::train does
+std::vector<double> train_forest(const BinnedMatrix& binned, const VectorXd& y, int trees, ThreadPool* pool) {
+    HistTreeOptions options;
+    options.pool = pool;
+    HistTreeTrainer trainer(binned, y, options);
+    std::vector<TreeNode*> forest(trees);
+    auto train_one = [&](int t) {
+        Bootstrap sample = bootstrap_counts(binned.rows(), 42, t);
+        forest[t] = trainer.train(std::move(sample.rows), &sample.counts);
+    };
+    if (pool) {
+        TaskGroup group(*pool);
+        for (int t = 0; t < trees; ++t) group.run([&, t]() { train_one(t); });
+        group.wait();
+    } else {
+        for (int t = 0; t < trees; ++t) train_one(t);
+    }
+
+    std::vector<double> serialized;
+    for (TreeNode* tree : forest) {
+        serialize(tree, serialized);
+        free_tree(tree);
+    }
+    return serialized;
+}
+
+void bench_forest_threads(int rows, int features, int trees) {
+    std::mt19937_64 rng(9);
+    MatrixXd X;
+    VectorXd y;
+    make_data(rows, features, rng, X, y);
+    BinnedMatrix binned(X);
+
+    std::cout << "\n[INFO] Forest of " << trees << " trees, " << rows << " rows ("
+              << std::thread::hardware_concurrency() << " hardware threads)" << std::endl;
+    std::vector<double> reference;
+    double serial = seconds([&]() { reference = train_forest(binned, y, trees, nullptr); });
+    std::cout << std::setw(9) << "serial" << std::setw(12) << serial << " s" << std::endl;
+
+    unsigned max_threads = std::max(4u, std::thread::hardware_concurrency());
+    for (unsigned threads = 1; threads <= max_threads; threads *= 2) {
+        ThreadPool pool(threads);
+        std::vector<double> forest;
+        double t = seconds([&]() { forest = train_forest(binned, y, trees, &pool); });
+        std::cout << std::setw(9) << threads << std::setw(12) << t << " s   speedup " << std::setprecision(2)
+                  << serial / t << "x   " << (forest == reference ? "same trees" : "TREES DIFFER")
+                  << std::setprecision(4) << std::endl;
+    }
+}
+
+int main(int argc, char** argv) {
+    int baseline_rows = argc > 1 ? std::stoi(argv[1]) : 400;
+    int features = argc > 2 ? std::stoi(argv[2]) : 8;
+    int forest_trees = argc > 3 ? std::stoi(argv[3]) : 16;
+
+    std::mt19937_64 rng(3);
+    MatrixXd X_test;
+    VectorXd y_test;
+    make_data(20000, features, rng, X_test, y_test);
+
+    std::cout << std::fixed << std::setprecision(4);
+    std::cout << "[INFO] One depth-10 tree, " << features << " features" << std::endl;
+    std::cout << std::setw(9) << "rows" << std::setw(16) << "exhaustive s" << std::setw(12) << "acc"
+              << std::setw(14) << "histogram s" << std::setw(11) << "binning" << std::setw(12) << "acc" << std::endl;
+    for (int rows : {baseline_rows, 10 * baseline_rows, 100000, 1000000}) {
+        MatrixXd X;
+        VectorXd y;
+        make_data(rows, features, rng, X, y);
+
+        std::cout << std::setw(9) << rows;
+        if (rows <= 10 * baseline_rows) {
+            TreeNode* tree = nullptr;
+            double t = seconds([&]() { tree = train_tree(X, y); });
+            std::cout << std::setw(16) << t << std::setw(12) << accuracy(tree, X_test, y_test);
+            free_tree(tree);
+        } else {
+            std::cout << std::setw(16) << "-" << std::setw(12) << "-";
+        }
+
+        TreeNode* tree = nullptr;
+        double bin_seconds = 0.0;
+        double t = seconds([&]() { tree = train_hist(X, y, bin_seconds); });
+        std::cout << std::setw(14) << t << std::setw(11) << bin_seconds << std::setw(12) << accuracy(tree, X_test, y_test)
+                  << std::endl;
+        free_tree(tree);
+    }
+
+    bench_forest_threads(200000, features, forest_trees);
+    return 0;
+}
@@ -3,122 +3,15 @@
 #include <boost/asio.hpp>
 #include <Eigen/Dense>
 #include <random>
+#include "../common/perf_counters.hpp"
+#include "../common/trace.hpp"
+#include "../common/wire_protocol.hpp"
+#include "hist_tree.hpp"  // Binned features, histogram split search
+#include "forest_codec.hpp"  // Compact forest encoding
 
 using namespace Eigen;
 using boost::asio::ip::tcp;
 
-// Decision Tree Node Structure
-struct TreeNode {
-    int feature_index = -1;
-    double threshold = 0.0;
-    double prediction = 0.0;
-    TreeNode* left = nullptr;
-    TreeNode* right = nullptr;
-};
-
-void split_data(const MatrixXd& data, const VectorXd& labels, int feature_index, double threshold,
-                MatrixXd& left_data, VectorXd& left_labels,
-                MatrixXd& right_data, VectorXd& right_labels) {
-    std::vector<int> left_indices, right_indices;
-
-    for (int i = 0; i < data.rows(); ++i) {
-        if (data(i, feature_index) <= threshold) {
-            left_indices.push_back(i);
-        } else {
-            right_indices.push_back(i);
-        }
-    }
-
-    // Create left and right data and labels
-    left_data.resize(left_indices.size(), data.cols());
-    left_labels.resize(left_indices.size());
-    right_data.resize(right_indices.size(), data.cols());
-    right_labels.resize(right_indices.size());
-
-    for (size_t i = 0; i < left_indices.size(); ++i) {
-        left_data.row(i) = data.row(left_indices[i]);
-        left_labels(i) = labels(left_indices[i]);
-    }
-    for (size_t i = 0; i < right_indices.size(); ++i) {
-        right_data.row(i) = data.row(right_indices[i]);
-        right_labels(i) = labels(right_indices[i]);
-    }
-}
-
-
-// Gini Impurity Calculation
-double gini_impurity(const Eigen::VectorXd& labels) {
-    int n_samples = labels.size();
-    if (n_samples == 0) return 0.0;
-
-    double count_pos = (labels.array() == 1.0).count();
-    double count_neg = n_samples - count_pos;
-
-    double prob_pos = count_pos / n_samples;
-    double prob_neg = count_neg / n_samples;
-
-    return 1.0 - (prob_pos * prob_pos + prob_neg * prob_neg);
-}
-
-// Train Decision Tree
-TreeNode* train_tree(const MatrixXd& data, const VectorXd& labels, int depth = 0, int max_depth = 10) {
-    TreeNode* node = new TreeNode();
-
-    // Stopping conditions
-    if (depth >= max_depth || labels.size() <= 1 || gini_impurity(labels) == 0) {
-        node->prediction = (labels.sum() >= 0) ? 1.0 : -1.0; // Majority vote
-        return node;
-    }
-
-    // Find the best split
-    double best_gini = std::numeric_limits<double>::max();
-    int best_feature = -1;
-    double best_threshold = 0.0;
-    MatrixXd best_left_data, best_right_data;
-    VectorXd best_left_labels, best_right_labels;
-
-    for (int feature_index = 0; feature_index < data.cols(); ++feature_index) {
-        for (int i = 0; i < data.rows(); ++i) {
-            double threshold = data(i, feature_index);
-
-            MatrixXd left_data, right_data;
-            VectorXd left_labels, right_labels;
-            split_data(data, labels, feature_index, threshold, left_data, left_labels, right_data, right_labels);
-
-            if (left_labels.size() == 0 || right_labels.size() == 0) continue;  // Skip invalid splits
-
-            // Calculate Gini impurity for the split
-            double left_gini = gini_impurity(left_labels);
-            double right_gini = gini_impurity(right_labels);
-            double weighted_gini = (left_labels.size() * left_gini + right_labels.size() * right_gini) / labels.size();
-
-            if (weighted_gini < best_gini) {
-                best_gini = weighted_gini;
-                best_feature = feature_index;
-                best_threshold = threshold;
-                best_left_data = left_data;
-                best_right_data = right_data;
-                best_left_labels = left_labels;
-                best_right_labels = right_labels;
-            }
-        }
-    }
-
-    // If no valid split was found, return a leaf node
-    if (best_feature == -1) {
-        node->prediction = (labels.sum() >= 0) ? 1.0 : -1.0;
-        return node;
-    }
-
-    // Create a decision node
-    node->feature_index = best_feature;
-    node->threshold = best_threshold;
-    node->left = train_tree(best_left_data, best_left_labels, depth + 1, max_depth);
-    node->right = train_tree(best_right_data, best_right_labels, depth + 1, max_depth);
-
-    return node;
-}
-
 // Serialize a decision tree node
 void serialize_tree_node(const TreeNode* node, std::vector<double>& serialized_tree) {
     if (!node) return;
@@ -142,35 +35,48 @@ public:
         trees.resize(num_trees, nullptr);
     }
 
-    // Train the Random Forest with bootstrap sampling
-    void train(const Eigen::MatrixXd& data, const Eigen::VectorXd& labels) {
-        std::mt19937 rng;
-        std::uniform_int_distribution<int> dist(0, data.rows() - 1);
-
-        for (int t = 0; t < trees.size(); ++t) {
-            MatrixXd bootstrapped_data(data.rows(), data.cols());
-            VectorXd bootstrapped_labels(data.rows());
-
-            for (int i = 0; i < data.rows(); ++i) {
-                int index = dist(rng);
-                bootstrapped_data.row(i) = data.row(index);
-                bootstrapped_labels(i) = labels(index);
-            }
-
-            trees[t] = train_tree(bootstrapped_data, bootstrapped_labels);
+    // Train the Random Forest with bootstrap sampling. The features are binned
+    // once, and the trees train concurrently on the pool, each on its own
+    // bootstrap sample given as draw counts over the original rows. Tree t
+    // always gets the same sample for the same seed.
+    void train(const Eigen::MatrixXd& data, const Eigen::VectorXd& labels, ThreadPool& pool, uint64_t seed) {
+        if (data.rows() > Index(UINT32_MAX)) throw std::runtime_error("Too many rows for one forest");
+        TRACE_SCOPE("train_forest");
+
+        HistTreeOptions options;
+        options.pool = &pool;
+        BinnedMatrix binned(data);
+        HistTreeTrainer trainer(binned, labels, options);
+
+        TaskGroup group(pool);
+        for (size_t t = 0; t < trees.size(); ++t) {
+            group.run([&, t]() {
+                TRACE_SCOPE("train_tree");
+                PERF_SCOPE("train_tree");
+                Bootstrap sample = bootstrap_counts(data.rows(), seed, t);
+                trees[t] = trainer.train(std::move(sample.rows), &sample.counts);
+            });
         }
+        group.wait();
     }
 
     // Serialize the entire forest
     std::vector<std::vector<double>> serialize_forest() {
         std::vector<std::vector<double>> serialized_forest(trees.size());
 
-        for (int i = 0; i < trees.size(); ++i) {
+        for (size_t i = 0; i < trees.size(); ++i) {
             serialize_tree_node(trees[i], serialized_forest[i]);
         }
 
         return serialized_forest;
     }
+
+    // Compact encoding of the entire forest (forest_codec.hpp)
+    std::vector<uint8_t> encode(ForestEncoding encoding = {}) const {
+        TRACE_SCOPE("encode");
+        PERF_SCOPE("encode");
+        return encode_forest(std::vector<const TreeNode*>(trees.begin(), trees.end()), encoding);
+    }
 };
 
 // Function to load local data
@@ -190,33 +96,33 @@ VectorXd load_local_labels() {
 }
 
 // Main client function
-int main() {
+// Usage: ./client [seed]  (defaults to a random seed, so clients draw different bootstraps)
+int main(int argc, char** argv) {
     boost::asio::io_service io_service;
     tcp::socket socket(io_service);
     tcp::resolver resolver(io_service);
     boost::asio::connect(socket, resolver.resolve({"127.0.0.1", "8080"}));
+    TRACE_PROCESS("RF client", trace_client_id(socket.local_endpoint()));
+    TRACE_ROUND(0);
 
     // Load local data and labels
     MatrixXd data = load_local_data();
     VectorXd labels = load_local_labels();
 
-    // Train a random forest
-    RandomForest forest(5); // A forest with 5 trees
-    forest.train(data, labels);
+    uint64_t seed = argc > 1 ? std::stoull(argv[1]) : (uint64_t(std::random_device()()) << 32) | std::random_device()();
+    std::cout << "[DEBUG] Bootstrap seed: " << seed << std::endl;
 
-    // Serialize the random forest model
-    std::vector<std::vector<double>> serialized_forest = forest.serialize_forest();
-
-    // Send the model size first (number of trees)
-    int forest_size = serialized_forest.size();
-    boost::asio::write(socket, boost::asio::buffer(&forest_size, sizeof(int)));
-
-    // Send each serialized tree
-    for (const auto& tree : serialized_forest) {
-        int tree_size = tree.size();
-        boost::asio::write(socket, boost::asio::buffer(&tree_size, sizeof(int)));
-        boost::asio::write(socket, boost::asio::buffer(tree.data(), tree_size * sizeof(double)));
-    }
+    // Train a random forest, one tree per task on a work-stealing pool
+    ThreadPool pool;
+    RandomForest forest(5); // A forest with 5 trees
+    forest.train(data, labels, pool, seed);
+
+    // Send all trees as one compactly encoded frame; the server also accepts
+    // serialize_forest()'s preorder doubles as a Float64 frame
+    std::vector<uint8_t> encoded = forest.encode();
+    std::cout << "[DEBUG] Encoded forest: " << encoded.size() << " bytes" << std::endl;
+    write_frame(socket, frame_header(MessageType::Forest, 0, encoded.size(), 1, data.rows(), DType::Bytes),
+                boost::asio::buffer(encoded));
 
     // Print confirmation message
     std::cout << "Decision trees have been successfully sent to the server." << std::endl;
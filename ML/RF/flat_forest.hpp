@@ -0,0 +1,423 @@
+#pragma once
+
+// Compiled random forest for batched scoring.
+//
+// All trees live in one set of contiguous node arrays (feature, threshold,
+// child pair, leaf class) instead of heap-allocated linked nodes. Each
+// tree is laid out breadth-first, so the top levels every row visits share a
+// few cache lines, and a leaf's children point back at the leaf itself: a row
+// that reaches a leaf early simply stays there, so every row of a batch can
+// take exactly depth(tree) steps without branching on the tree shape.
+//
+// predict() walks a block of rows through one tree level by level. A step
+// for one row is independent of every other row, so the steps of a whole
+// block overlap in the pipeline instead of each row chasing pointers on its
+// own; with AVX2, four rows advance per instruction using gathers. Votes go
+// into a fixed rows x classes count array rather than a map per row.
+//
+// Leaf predictions are class labels; ties go to the smallest label.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iterator>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+#include <Eigen/Dense>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+class FlatForest {
+public:
+    // Rows scored together; their cursors and votes stay in L1 / L2
+    static const int BLOCK_ROWS = 512;
+    // Deeper trees are rejected; the clients grow trees of depth 10
+    static const int MAX_DEPTH = 64;
+    // Larger label sets are rejected; predict() keeps a vote counter per class
+    // for every row of a block, and the clients send two labels
+    static const int MAX_CLASSES = 1024;
+
+    // Sizes to return to when an append fails part way
+    struct Checkpoint {
+        size_t nodes;
+        size_t trees;
+        std::vector<double> classes;
+        int32_t max_feature;
+    };
+
+    size_t trees() const { return roots_.size(); }
+    size_t nodes() const { return feature_.size(); }
+    const std::vector<double>& classes() const { return classes_; }
+
+    Checkpoint checkpoint() const { return {nodes(), trees(), classes_, max_feature_}; }
+
+    // Drop every node, tree and class label added since `mark`
+    void rollback(const Checkpoint& mark) {
+        feature_.resize(mark.nodes);
+        threshold_.resize(mark.nodes);
+        children_.resize(2 * mark.nodes);
+        leaf_class_.resize(mark.nodes);
+        roots_.resize(mark.trees);
+        depths_.resize(mark.trees);
+        if (classes_.size() != mark.classes.size()) {
+            // New labels shifted the ids of the remaining leaves; map them back
+            for (size_t node = 0; node < mark.nodes; ++node) {
+                if (children_[2 * node] != int32_t(node)) continue;
+                const double label = classes_[leaf_class_[node]];
+                leaf_class_[node] = int32_t(std::lower_bound(mark.classes.begin(), mark.classes.end(), label) -
+                                            mark.classes.begin());
+            }
+            classes_ = mark.classes;
+        }
+        max_feature_ = mark.max_feature;
+    }
+
+    // Append the trees of a forest payload: concatenated preorder trees where
+    // every node is (feature index, threshold, prediction) and an internal
+    // node (feature index != -1) is followed by its left then right subtree.
+    // Returns the number of trees added; on a malformed payload nothing is added.
+    size_t append_serialized(const std::vector<double>& serialized) {
+        const Checkpoint mark = checkpoint();
+        try {
+            // Every node is a triple, so the leaf labels can be collected first
+            // and merged into the classes once, not one insertion per new label
+            std::vector<double> labels;
+            for (size_t i = 0; i + 3 <= serialized.size(); i += 3) {
+                if (serialized[i] != -1) continue;
+                // A NaN label would never match its class and would add one per leaf
+                if (!std::isfinite(serialized[i + 2])) throw std::runtime_error("Invalid leaf label in forest payload");
+                labels.push_back(serialized[i + 2]);
+            }
+            add_classes(labels);
+
+            size_t index = 0;
+            while (index < serialized.size()) append_tree(serialized, index);
+        } catch (...) {
+            rollback(mark);
+            throw;
+        }
+        return trees() - mark.trees;
+    }
+
+    // Append all trees of another forest
+    void append(const FlatForest& other) {
+        const size_t base = nodes();
+        if (base + other.nodes() > size_t(std::numeric_limits<int32_t>::max())) {
+            throw std::runtime_error("Forest exceeds the node limit");
+        }
+        const std::vector<int32_t> class_map = add_classes(other.classes_);
+
+        const int32_t offset = int32_t(base);
+        feature_.insert(feature_.end(), other.feature_.begin(), other.feature_.end());
+        threshold_.insert(threshold_.end(), other.threshold_.begin(), other.threshold_.end());
+        for (size_t node = 0; node < other.nodes(); ++node) {
+            children_.push_back(other.children_[2 * node] + offset);
+            children_.push_back(other.children_[2 * node + 1] + offset);
+            leaf_class_.push_back(class_map[other.leaf_class_[node]]);
+        }
+        for (int32_t root : other.roots_) roots_.push_back(root + offset);
+        depths_.insert(depths_.end(), other.depths_.begin(), other.depths_.end());
+        max_feature_ = std::max(max_feature_, other.max_feature_);
+    }
+
+    // Merge finite `labels` (any order, repeats allowed) into the class list
+    // in one step and return the class id of each. Existing leaves are
+    // renumbered in a single pass, however many labels are new. Throws if the
+    // forest would have more than MAX_CLASSES classes.
+    std::vector<int32_t> add_classes(const std::vector<double>& labels) {
+        std::vector<double> sorted(labels);
+        std::sort(sorted.begin(), sorted.end());
+        sorted.erase(std::unique(sorted.begin(), sorted.end()), sorted.end());
+        std::vector<double> merged;
+        merged.reserve(classes_.size() + sorted.size());
+        std::set_union(classes_.begin(), classes_.end(), sorted.begin(), sorted.end(), std::back_inserter(merged));
+        if (merged.size() > size_t(MAX_CLASSES)) {
+            throw std::runtime_error("Forest would have more than " + std::to_string(MAX_CLASSES) + " classes");
+        }
+
+        if (merged.size() != classes_.size()) {
+            std::vector<int32_t> renumber(classes_.size());
+            for (size_t c = 0; c < classes_.size(); ++c) {
+                renumber[c] = int32_t(std::lower_bound(merged.begin(), merged.end(), classes_[c]) - merged.begin());
+            }
+            for (size_t node = 0; node < leaf_class_.size(); ++node) {
+                if (children_[2 * node] == int32_t(node)) leaf_class_[node] = renumber[leaf_class_[node]];
+            }
+            classes_.swap(merged);
+        }
+
+        std::vector<int32_t> ids(labels.size());
+        for (size_t i = 0; i < labels.size(); ++i) {
+            ids[i] = int32_t(std::lower_bound(classes_.begin(), classes_.end(), labels[i]) - classes_.begin());
+        }
+        return ids;
+    }
+
+    // Breadth-first construction for decoders (forest_codec.hpp): add_classes
+    // for the payload's labels, then begin_tree, add_split / add_leaf (with an
+    // id from add_classes) for every node in breadth-first order, end_tree.
+    // The children of the k-th split of a tree are its nodes 2k + 1 and
+    // 2k + 2, so node kinds and values alone define the tree. A shape that is
+    // not a tree throws; rollback() to a checkpoint taken before the first
+    // begin_tree then restores the forest.
+    //
+    // reserve() makes room for `nodes` nodes in total, at least doubling the
+    // capacity, so decoding many payloads into one forest stays linear.
+    void reserve(size_t nodes) {
+        if (nodes <= feature_.capacity()) return;
+        nodes = std::max(nodes, 2 * feature_.capacity());
+        feature_.reserve(nodes);
+        threshold_.reserve(nodes);
+        children_.reserve(2 * nodes);
+        leaf_class_.reserve(nodes);
+    }
+
+    void begin_tree(size_t nodes) {
+        if (nodes == 0 || nodes % 2 == 0) throw std::runtime_error("Tree must have an odd number of nodes");
+        if (this->nodes() + nodes > size_t(std::numeric_limits<int32_t>::max())) {
+            throw std::runtime_error("Forest exceeds the node limit");
+        }
+        building_.base = int32_t(this->nodes());
+        building_.nodes = nodes;
+        building_.splits = 0;
+        building_.depth = 0;
+        building_.levels.assign(nodes, 0);
+    }
+
+    void add_split(int32_t feature, double threshold) {
+        const size_t node = next_node();
+        const size_t left = 2 * building_.splits + 1;
+        if (feature < 0) throw std::runtime_error("Invalid feature index in forest payload");
+        // Children come after their parent and inside the tree, or it is not a tree
+        if (left <= node || left + 1 >= building_.nodes) throw std::runtime_error("Malformed tree shape in forest payload");
+        const int level = building_.levels[node] + 1;
+        if (level > MAX_DEPTH) throw std::runtime_error("Tree in forest payload is too deep");
+        building_.levels[left] = building_.levels[left + 1] = level;
+        building_.depth = std::max(building_.depth, level);
+        ++building_.splits;
+
+        feature_.push_back(feature);
+        threshold_.push_back(threshold);
+        children_.push_back(building_.base + int32_t(left));
+        children_.push_back(building_.base + int32_t(left + 1));
+        leaf_class_.push_back(0);
+        max_feature_ = std::max(max_feature_, feature);
+    }
+
+    void add_leaf(int32_t class_id) {
+        if (class_id < 0 || size_t(class_id) >= classes_.size()) {
+            throw std::runtime_error("Invalid leaf class in forest payload");
+        }
+        const int32_t self = building_.base + int32_t(next_node());
+        feature_.push_back(0);
+        threshold_.push_back(0.0);
+        children_.push_back(self);
+        children_.push_back(self);
+        leaf_class_.push_back(class_id);
+    }
+
+    void end_tree() {
+        if (nodes() - building_.base != building_.nodes || 2 * building_.splits + 1 != building_.nodes) {
+            throw std::runtime_error("Malformed tree shape in forest payload");
+        }
+        roots_.push_back(building_.base);
+        depths_.push_back(building_.depth);
+    }
+
+    // Majority vote of all trees for every row of X; -1 when the forest is empty
+    std::vector<double> predict(const Eigen::MatrixXd& X) const {
+        std::vector<double> predictions(X.rows(), -1.0);
+        if (roots_.empty()) return predictions;
+        if (max_feature_ >= X.cols()) {
+            throw std::runtime_error("Forest splits on feature " + std::to_string(max_feature_) + " but the data has " +
+                                     std::to_string(X.cols()) + " features");
+        }
+        if (X.rows() > std::numeric_limits<int32_t>::max()) throw std::runtime_error("Too many rows to score at once");
+
+        const int n_classes = int(classes_.size());
+        std::vector<int32_t> cursor(BLOCK_ROWS);
+        std::vector<uint32_t> votes(size_t(BLOCK_ROWS) * n_classes);
+
+        for (Eigen::Index first = 0; first < X.rows(); first += BLOCK_ROWS) {
+            const int rows = int(std::min<Eigen::Index>(BLOCK_ROWS, X.rows() - first));
+            std::fill(votes.begin(), votes.begin() + size_t(rows) * n_classes, 0u);
+
+            for (size_t t = 0; t < roots_.size(); ++t) {
+                std::fill(cursor.begin(), cursor.begin() + rows, roots_[t]);
+                for (int level = 0; level < depths_[t]; ++level) {
+                    advance(X, first, rows, cursor.data());
+                }
+                for (int r = 0; r < rows; ++r) ++votes[size_t(r) * n_classes + leaf_class_[cursor[r]]];
+            }
+
+            // Classes are sorted, so the first maximum is the smallest label
+            for (int r = 0; r < rows; ++r) {
+                const uint32_t* row_votes = &votes[size_t(r) * n_classes];
+                predictions[first + r] = classes_[std::max_element(row_votes, row_votes + n_classes) - row_votes];
+            }
+        }
+        return predictions;
+    }
+
+    // Prediction of tree t alone for one sample
+    double predict_tree(size_t t, const Eigen::Ref<const Eigen::VectorXd>& x) const {
+        int32_t node = roots_.at(t);
+        for (int level = 0; level < depths_[t]; ++level) {
+            node = children_[2 * node + !(x(feature_[node]) <= threshold_[node])];
+        }
+        return classes_[leaf_class_[node]];
+    }
+
+private:
+    // Preorder node before it is placed breadth-first
+    struct ParsedNode {
+        int32_t feature;
+        double threshold;
+        double prediction;
+        int32_t left = -1;
+        int32_t right = -1;
+    };
+
+    void append_tree(const std::vector<double>& serialized, size_t& index) {
+        // Parse the preorder sequence with an explicit stack of child slots to
+        // fill (parent, is right child), so hostile depth cannot overflow the stack
+        std::vector<ParsedNode> parsed;
+        std::vector<std::pair<int32_t, bool>> slots{{-1, false}};
+        while (!slots.empty()) {
+            auto [parent, is_right] = slots.back();
+            slots.pop_back();
+            if (index + 3 > serialized.size()) throw std::runtime_error("Truncated tree in forest payload");
+            double feature = serialized[index++];
+            double threshold = serialized[index++];
+            double prediction = serialized[index++];
+            if (!(feature >= -1 && feature < std::numeric_limits<int32_t>::max()) || feature != int32_t(feature)) {
+                throw std::runtime_error("Invalid feature index in forest payload");
+            }
+
+            int32_t id = int32_t(parsed.size());
+            parsed.push_back({int32_t(feature), threshold, prediction});
+            if (parent >= 0) (is_right ? parsed[parent].right : parsed[parent].left) = id;
+            if (feature != -1) {
+                slots.push_back({id, true});
+                slots.push_back({id, false});
+            }
+        }
+
+        // Breadth-first placement: both children of a node are enqueued together
+        const int32_t base = int32_t(feature_.size());
+        if (size_t(base) + parsed.size() > size_t(std::numeric_limits<int32_t>::max())) {
+            throw std::runtime_error("Forest exceeds the node limit");
+        }
+        std::vector<int32_t> order{0}, level_of{0}, position(parsed.size());
+        int depth = 0;
+        for (size_t q = 0; q < order.size(); ++q) {
+            const ParsedNode& node = parsed[order[q]];
+            position[order[q]] = base + int32_t(q);
+            if (node.feature != -1) {
+                if (level_of[q] + 1 > MAX_DEPTH) throw std::runtime_error("Tree in forest payload is too deep");
+                order.push_back(node.left);
+                order.push_back(node.right);
+                level_of.push_back(level_of[q] + 1);
+                level_of.push_back(level_of[q] + 1);
+                depth = std::max(depth, level_of[q] + 1);
+            }
+        }
+
+        for (int32_t id : order) {
+            const ParsedNode& node = parsed[id];
+            const int32_t self = position[id];
+            if (node.feature == -1) {
+                // Leaves loop back to themselves; feature 0 is always a valid column
+                feature_.push_back(0);
+                threshold_.push_back(0.0);
+                children_.push_back(self);
+                children_.push_back(self);
+                leaf_class_.push_back(existing_class(node.prediction));
+            } else {
+                feature_.push_back(node.feature);
+                threshold_.push_back(node.threshold);
+                children_.push_back(position[node.left]);
+                children_.push_back(position[node.right]);
+                leaf_class_.push_back(0);
+                max_feature_ = std::max(max_feature_, node.feature);
+            }
+        }
+        roots_.push_back(base);
+        depths_.push_back(depth);
+    }
+
+    size_t next_node() const {
+        size_t node = nodes() - building_.base;
+        if (node >= building_.nodes) throw std::runtime_error("Tree has more nodes than announced");
+        return node;
+    }
+
+    // Index of a leaf label already merged in by add_classes
+    int32_t existing_class(double label) const {
+        auto it = std::lower_bound(classes_.begin(), classes_.end(), label);
+        if (it == classes_.end() || *it != label) throw std::runtime_error("Leaf label missing from the class list");
+        return int32_t(it - classes_.begin());
+    }
+
+    // One level for rows [first, first + rows): x <= threshold goes left,
+    // anything else (including NaN) goes right. The comparison result indexes
+    // the child pair directly, so there is no branch to mispredict.
+    void advance(const Eigen::MatrixXd& X, Eigen::Index first, int rows, int32_t* cursor) const {
+        const double* data = X.data() + first;
+        const Eigen::Index stride = X.rows();  // Column-major: feature f of row r is data[f * stride + r]
+        int r = 0;
+#if defined(__AVX2__)
+        // The child pair is gathered alongside the split, not after the
+        // comparison, which keeps the dependency chain per level short
+        const __m256i stride4 = _mm256_set1_epi64x(stride);
+        const __m256i pack = _mm256_setr_epi32(0, 2, 4, 6, 0, 2, 4, 6);
+        auto step = [&](int at) {
+            __m128i node = _mm_loadu_si128(reinterpret_cast<const __m128i*>(cursor + at));
+            __m128i pair = _mm_slli_epi32(node, 1);
+            __m128i left = _mm_i32gather_epi32(children_.data(), pair, 4);
+            __m128i right = _mm_i32gather_epi32(children_.data() + 1, pair, 4);
+            __m128i feature = _mm_i32gather_epi32(feature_.data(), node, 4);
+            __m256d threshold = _mm256_i32gather_pd(threshold_.data(), node, 8);
+            __m256i offset = _mm256_add_epi64(_mm256_mul_epi32(_mm256_cvtepi32_epi64(feature), stride4),
+                                              _mm256_setr_epi64x(at, at + 1, at + 2, at + 3));
+            __m256d x = _mm256_i64gather_pd(data, offset, 8);
+            __m256d go_right = _mm256_cmp_pd(x, threshold, _CMP_NLE_UQ);
+            __m128i mask = _mm256_castsi256_si128(_mm256_permutevar8x32_epi32(_mm256_castpd_si256(go_right), pack));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(cursor + at), _mm_blendv_epi8(left, right, mask));
+        };
+        for (; r + 8 <= rows; r += 8) {
+            step(r);
+            step(r + 4);
+        }
+        for (; r + 4 <= rows; r += 4) step(r);
+#endif
+        for (; r < rows; ++r) {
+            const int32_t node = cursor[r];
+            cursor[r] = children_[2 * node + !(data[feature_[node] * stride + r] <= threshold_[node])];
+        }
+    }
+
+    // Node arrays of all trees, tree after tree
+    std::vector<int32_t> feature_;
+    std::vector<double> threshold_;
+    std::vector<int32_t> children_;    // Left and right child of node i at 2i and 2i + 1
+    std::vector<int32_t> leaf_class_;  // Index into classes_ (leaves only)
+
+    std::vector<int32_t> roots_;   // First node of each tree
+    std::vector<int32_t> depths_;  // Levels from the root to the deepest leaf
+    std::vector<double> classes_;  // Distinct leaf labels, ascending
+    int32_t max_feature_ = -1;
+
+    // Tree under construction by begin_tree / end_tree
+    struct Building {
+        int32_t base = 0;
+        size_t nodes = 0;
+        size_t splits = 0;
+        int depth = 0;
+        std::vector<int> levels;  // Depth of each node of the tree; reused across trees
+    } building_;
+};
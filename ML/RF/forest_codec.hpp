@@ -0,0 +1,351 @@
+#pragma once
+
+// Compact binary encoding of a forest (DType::Bytes payload of a Forest frame).
+//
+// The preorder double format spends 24 bytes on every node. Here each tree is
+// written breadth-first as the shape plus the values a node kind needs:
+//
+//     u8       format version (FOREST_CODEC_VERSION)
+//     u8       flags (FOREST_*)
+//     varint   tree count, then total node count
+//     varint   class count, then that many float64 leaf labels, ascending
+//     per tree:
+//       varint   node count (odd: a tree with s splits has 2s + 1 nodes)
+//       bitmap   one bit per node in breadth-first order, 1 = split
+//       features one per split: LEB128 varint, or int16 / int32 little endian
+//       thresholds one per split: float32, or float64 with FOREST_F64_THRESHOLDS
+//       leaves   one class index per leaf, ceil(log2(classes)) bits each
+//
+// Every section starts on a byte boundary. Child indices are implicit: the
+// children of the k-th split of a tree are its nodes 2k + 1 and 2k + 2, which
+// is exactly the node order of FlatForest, so the decoder writes straight into
+// the target forest's arrays in one pass, with no intermediate forest to copy
+// from. The arrays grow tree by tree, and only once all sections of a tree
+// are known to be in the payload, so a header cannot make the decoder reserve
+// memory the payload does not back.
+//
+// A float32 threshold is the original rounded up to the next float, so a
+// value equal to the trained threshold still goes left; only values strictly
+// between the two (within float32 precision) change sides. Encode with
+// float64_thresholds when that matters.
+//
+// decode_forest validates everything it reads (lengths against the payload,
+// class count, feature ranges, tree shape, depth) before it can index with it
+// and throws std::runtime_error on a malformed payload, after rolling the
+// target back to the nodes, trees and classes it had before the call.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "flat_forest.hpp"
+
+const uint8_t FOREST_CODEC_VERSION = 1;
+
+enum ForestCodecFlags : uint8_t {
+    FOREST_F64_THRESHOLDS = 1,   // float64 thresholds instead of float32
+    FOREST_VARINT_FEATURES = 2,  // LEB128 feature indices
+    FOREST_I32_FEATURES = 4,     // Fixed int32 feature indices (otherwise int16) without FOREST_VARINT_FEATURES
+};
+
+struct ForestEncoding {
+    bool float64_thresholds = false;  // Exact thresholds, 4 more bytes per split
+    bool varint_features = true;      // Otherwise fixed width: int16, or int32 if an index needs it
+};
+
+namespace forest_codec {
+
+inline void put_varint(std::vector<uint8_t>& out, uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back(uint8_t(value) | 0x80);
+        value >>= 7;
+    }
+    out.push_back(uint8_t(value));
+}
+
+template <typename T>
+void put_raw(std::vector<uint8_t>& out, T value) {
+    uint8_t bytes[sizeof(T)];
+    std::memcpy(bytes, &value, sizeof(T));
+    out.insert(out.end(), bytes, bytes + sizeof(T));
+}
+
+// Smallest float >= threshold
+inline float round_up_to_float(double threshold) {
+    float rounded = float(threshold);
+    if (double(rounded) < threshold) rounded = std::nextafter(rounded, std::numeric_limits<float>::infinity());
+    return rounded;
+}
+
+inline int bits_for(size_t values) {
+    int bits = 0;
+    while ((size_t(1) << bits) < values) ++bits;
+    return bits;
+}
+
+// Appends values of a fixed bit width, least significant bit first
+class BitWriter {
+public:
+    explicit BitWriter(std::vector<uint8_t>& out) : out_(out) {}
+    ~BitWriter() { flush(); }
+
+    void put(uint32_t value, int bits) {
+        for (int b = 0; b < bits; ++b) {
+            if (used_ == 8) flush();
+            current_ |= uint8_t(((value >> b) & 1) << used_++);
+        }
+    }
+
+    void flush() {
+        if (used_ > 0) out_.push_back(current_);
+        current_ = 0;
+        used_ = 0;
+    }
+
+private:
+    std::vector<uint8_t>& out_;
+    uint8_t current_ = 0;
+    int used_ = 0;
+};
+
+// Bounds-checked cursor over a payload
+class Reader {
+public:
+    Reader(const uint8_t* data, size_t size) : data_(data), end_(data + size) {}
+
+    size_t remaining() const { return size_t(end_ - data_); }
+    const uint8_t* position() const { return data_; }
+
+    const uint8_t* take(size_t bytes) {
+        if (bytes > remaining()) throw std::runtime_error("Truncated forest payload");
+        const uint8_t* at = data_;
+        data_ += bytes;
+        return at;
+    }
+
+    uint8_t byte() { return *take(1); }
+
+    uint64_t varint() {
+        uint64_t value = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            uint8_t b = byte();
+            value |= uint64_t(b & 0x7f) << shift;
+            if (!(b & 0x80)) return value;
+        }
+        throw std::runtime_error("Invalid varint in forest payload");
+    }
+
+    template <typename T>
+    T raw() {
+        T value;
+        std::memcpy(&value, take(sizeof(T)), sizeof(T));
+        return value;
+    }
+
+private:
+    const uint8_t* data_;
+    const uint8_t* end_;
+};
+
+}  // namespace forest_codec
+
+// Encode trees of TreeNode-like nodes (feature_index, threshold, prediction,
+// left, right; feature_index == -1 marks a leaf)
+template <typename Node>
+std::vector<uint8_t> encode_forest(const std::vector<const Node*>& trees, ForestEncoding encoding = {}) {
+    using namespace forest_codec;
+
+    // Breadth-first node order of every tree, and the classes and widest feature
+    std::vector<std::vector<const Node*>> orders(trees.size());
+    std::vector<double> classes;
+    int max_feature = 0;
+    for (size_t t = 0; t < trees.size(); ++t) {
+        std::vector<const Node*>& order = orders[t];
+        order.push_back(trees[t]);
+        for (size_t i = 0; i < order.size(); ++i) {
+            const Node* node = order[i];
+            if (node->feature_index == -1) {
+                classes.push_back(node->prediction);
+            } else {
+                if (node->feature_index < 0 || !node->left || !node->right) {
+                    throw std::invalid_argument("Cannot encode a malformed tree");
+                }
+                max_feature = std::max(max_feature, node->feature_index);
+                order.push_back(node->left);
+                order.push_back(node->right);
+            }
+        }
+    }
+    std::sort(classes.begin(), classes.end());
+    classes.erase(std::unique(classes.begin(), classes.end()), classes.end());
+    const int class_bits = bits_for(classes.size());
+
+    uint8_t flags = 0;
+    if (encoding.float64_thresholds) flags |= FOREST_F64_THRESHOLDS;
+    if (encoding.varint_features) flags |= FOREST_VARINT_FEATURES;
+    else if (max_feature > std::numeric_limits<int16_t>::max()) flags |= FOREST_I32_FEATURES;
+
+    std::vector<uint8_t> out;
+    out.push_back(FOREST_CODEC_VERSION);
+    out.push_back(flags);
+    size_t total_nodes = 0;
+    for (const std::vector<const Node*>& order : orders) total_nodes += order.size();
+    put_varint(out, trees.size());
+    put_varint(out, total_nodes);
+    put_varint(out, classes.size());
+    for (double label : classes) put_raw(out, label);
+
+    for (const std::vector<const Node*>& order : orders) {
+        put_varint(out, order.size());
+        {
+            BitWriter shape(out);
+            for (const Node* node : order) shape.put(node->feature_index != -1, 1);
+        }
+        for (const Node* node : order) {
+            if (node->feature_index == -1) continue;
+            if (flags & FOREST_VARINT_FEATURES) put_varint(out, uint32_t(node->feature_index));
+            else if (flags & FOREST_I32_FEATURES) put_raw(out, int32_t(node->feature_index));
+            else put_raw(out, int16_t(node->feature_index));
+        }
+        for (const Node* node : order) {
+            if (node->feature_index == -1) continue;
+            if (flags & FOREST_F64_THRESHOLDS) put_raw(out, node->threshold);
+            else put_raw(out, round_up_to_float(node->threshold));
+        }
+        BitWriter leaves(out);
+        for (const Node* node : order) {
+            if (node->feature_index != -1) continue;
+            leaves.put(uint32_t(std::lower_bound(classes.begin(), classes.end(), node->prediction) - classes.begin()),
+                       class_bits);
+        }
+    }
+    return out;
+}
+
+// Decode a payload of encode_forest and append its trees to `forest`.
+// Returns the number of trees added; on a malformed payload nothing is added.
+inline size_t decode_forest(const uint8_t* data, size_t size, FlatForest& forest) {
+    using namespace forest_codec;
+    Reader in(data, size);
+
+    if (in.byte() != FOREST_CODEC_VERSION) throw std::runtime_error("Unsupported forest encoding version");
+    const uint8_t flags = in.byte();
+    if (flags & ~(FOREST_F64_THRESHOLDS | FOREST_VARINT_FEATURES | FOREST_I32_FEATURES)) {
+        throw std::runtime_error("Unknown forest encoding flags");
+    }
+    const size_t feature_bytes = (flags & FOREST_I32_FEATURES) ? 4 : 2;
+    const size_t threshold_bytes = (flags & FOREST_F64_THRESHOLDS) ? 8 : 4;
+    const uint64_t trees = in.varint();
+    const uint64_t total_nodes = in.varint();
+    const uint64_t class_count = in.varint();
+    // A tree takes at least two bytes and a class eight bytes, so no count can
+    // make the decoder allocate more than the payload justifies
+    if (trees > in.remaining() / 2 || class_count > in.remaining() / sizeof(double)) {
+        throw std::runtime_error("Forest payload counts exceed its size");
+    }
+    if (class_count > uint64_t(FlatForest::MAX_CLASSES)) {
+        throw std::runtime_error("Forest payload has more than " + std::to_string(FlatForest::MAX_CLASSES) +
+                                 " classes");
+    }
+    std::vector<double> classes(class_count);
+    for (double& label : classes) {
+        label = in.raw<double>();
+        if (!std::isfinite(label)) throw std::runtime_error("Invalid class label in forest payload");
+    }
+    const int class_bits = bits_for(classes.size());
+    // A tree of s splits has 2s + 1 nodes, and every split needs a feature
+    // (at least one byte) and a threshold
+    const size_t split_bytes = ((flags & FOREST_VARINT_FEATURES) ? 1 : feature_bytes) + threshold_bytes;
+    if (total_nodes > trees + 2 * uint64_t(in.remaining() / split_bytes)) {
+        throw std::runtime_error("Forest payload node count exceeds its size");
+    }
+
+    const FlatForest::Checkpoint mark = forest.checkpoint();
+    try {
+        // The whole class table is merged at once, not label by label
+        const std::vector<int32_t> class_ids = forest.add_classes(classes);
+        for (uint64_t t = 0; t < trees; ++t) {
+            const uint64_t nodes = in.varint();
+            // The shape bitmap alone needs a bit per node
+            if (nodes == 0 || nodes > total_nodes - (forest.nodes() - mark.nodes)) {
+                throw std::runtime_error("Invalid tree size in forest payload");
+            }
+            const uint8_t* shape = in.take((nodes + 7) / 8);
+            size_t splits = 0;
+            for (uint64_t i = 0; i < nodes; ++i) splits += (shape[i / 8] >> (i % 8)) & 1;
+            // Checked before anything is sized from the bitmap, which costs a bit per node
+            if (nodes != 2 * splits + 1) throw std::runtime_error("Malformed tree shape in forest payload");
+            const size_t leaves = nodes - splits;
+            if (leaves > 0 && classes.empty()) throw std::runtime_error("Forest payload has leaves but no classes");
+
+            // Sections of this tree, checked against the payload before any is read
+            const uint8_t* features = nullptr;
+            Reader varint_features(nullptr, 0);
+            if (flags & FOREST_VARINT_FEATURES) {
+                const uint8_t* start = in.position();
+                size_t length = 0;
+                for (size_t s = 0; s < splits; ++s) {
+                    do {
+                        if (length >= in.remaining()) throw std::runtime_error("Truncated forest payload");
+                    } while (start[length++] & 0x80);
+                }
+                varint_features = Reader(in.take(length), length);
+            } else {
+                features = in.take(splits * feature_bytes);
+            }
+            const uint8_t* thresholds = in.take(splits * threshold_bytes);
+            const uint8_t* leaf_bits = in.take((leaves * class_bits + 7) / 8);
+
+            forest.reserve(forest.nodes() + nodes);
+            forest.begin_tree(nodes);
+            size_t split = 0, leaf = 0;
+            for (uint64_t i = 0; i < nodes; ++i) {
+                if ((shape[i / 8] >> (i % 8)) & 1) {
+                    int64_t feature;
+                    if (flags & FOREST_VARINT_FEATURES) {
+                        uint64_t value = varint_features.varint();
+                        feature = value > uint64_t(std::numeric_limits<int32_t>::max()) ? -1 : int64_t(value);
+                    } else if (flags & FOREST_I32_FEATURES) {
+                        int32_t value;
+                        std::memcpy(&value, features + 4 * split, 4);
+                        feature = value;
+                    } else {
+                        int16_t value;
+                        std::memcpy(&value, features + 2 * split, 2);
+                        feature = value;
+                    }
+                    double threshold;
+                    if (flags & FOREST_F64_THRESHOLDS) {
+                        std::memcpy(&threshold, thresholds + 8 * split, 8);
+                    } else {
+                        float value;
+                        std::memcpy(&value, thresholds + 4 * split, 4);
+                        threshold = value;
+                    }
+                    forest.add_split(int32_t(feature), threshold);
+                    ++split;
+                } else {
+                    uint32_t index = 0;
+                    for (int b = 0; b < class_bits; ++b, ++leaf) {
+                        index |= uint32_t((leaf_bits[leaf / 8] >> (leaf % 8)) & 1) << b;
+                    }
+                    if (index >= classes.size()) throw std::runtime_error("Invalid leaf class in forest payload");
+                    forest.add_leaf(class_ids[index]);
+                }
+            }
+            forest.end_tree();
+        }
+        if (forest.nodes() - mark.nodes != total_nodes) {
+            throw std::runtime_error("Forest payload node count does not match its trees");
+        }
+        if (in.remaining() != 0) throw std::runtime_error("Trailing bytes in forest payload");
+    } catch (...) {
+        forest.rollback(mark);
+        throw;
+    }
+    return forest.trees() - mark.trees;
+}
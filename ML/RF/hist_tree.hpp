@@ -0,0 +1,294 @@
+#pragma once
+
+// Histogram-based decision tree training.
+//
+// Every feature is binned once per dataset into at most 256 uint8 codes
+// (BinnedMatrix). The bin edges are data values, chosen by quantile when a
+// feature has more distinct values than bins, and code(x) <= b exactly when
+// x <= edge[b]. A split "bin <= b" is therefore the split x <= edge[b] on the
+// raw data, and the trained trees use plain thresholds.
+//
+// A node is a range of a shared row-index array, not a copy of its rows.
+// One pass over the node's rows fills a (weight, positive weight) histogram per
+// feature, and the best Gini split is a prefix scan over each histogram. Only
+// the smaller child's histogram is built from its rows; the larger one is the
+// parent's minus the smaller one. Training a level is therefore linear in the
+// rows, instead of trying every row value of every feature with copied subsets.
+//
+// With a ThreadPool in the options, large nodes build their feature
+// histograms in parallel and grow their two subtrees in parallel; the tree is
+// the same for any number of threads.
+//
+// Labels are +1 / -1. Rows may repeat in the index list and may carry weights,
+// e.g. bootstrap draw counts (bootstrap_counts).
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <random>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+#include <Eigen/Dense>
+#include "../common/perf_counters.hpp"
+#include "../common/thread_pool.hpp"
+
+// Decision Tree Node Structure
+struct TreeNode {
+    int feature_index = -1;
+    double threshold = 0.0;
+    double prediction = 0.0;
+    TreeNode* left = nullptr;
+    TreeNode* right = nullptr;
+};
+
+// Features quantized to uint8 bin codes, column-major like the source matrix
+class BinnedMatrix {
+public:
+    static const int MAX_BINS = 256;
+    static const Eigen::Index SAMPLE_ROWS = Eigen::Index(1) << 18;  // Rows the bin edges are chosen from
+
+    BinnedMatrix(const Eigen::MatrixXd& data, int max_bins = MAX_BINS)
+        : rows_(data.rows()), cols_(data.cols()), codes_(size_t(data.rows()) * data.cols()), edges_(data.cols()) {
+        if (max_bins < 2 || max_bins > MAX_BINS) throw std::invalid_argument("max_bins must be in [2, 256]");
+        // Large inputs choose edges from an evenly strided sample of the rows
+        const Eigen::Index stride = std::max<Eigen::Index>(1, (rows_ + SAMPLE_ROWS - 1) / SAMPLE_ROWS);
+        std::vector<double> sorted;
+        for (Eigen::Index f = 0; f < cols_; ++f) {
+            sorted.clear();
+            for (Eigen::Index i = 0; i < rows_; i += stride) sorted.push_back(data(i, f));
+            std::sort(sorted.begin(), sorted.end());
+            std::vector<double>& edges = edges_[f];
+
+            // Every distinct value is an edge when they fit; otherwise the values
+            // at evenly spaced ranks, which keeps the bins equally populated
+            edges.assign(sorted.begin(), std::unique(sorted.begin(), sorted.end()));
+            if (int(edges.size()) > max_bins) {
+                edges.clear();
+                for (int b = 1; b <= max_bins; ++b) {
+                    double value = sorted[size_t(b) * sorted.size() / max_bins - 1];
+                    if (edges.empty() || value > edges.back()) edges.push_back(value);
+                }
+            }
+
+            // Smallest b with x <= edge[b]. Values above every edge (possible with
+            // sampling) and NaN take the last bin, which is never a split threshold
+            uint8_t* column = &codes_[size_t(f) * rows_];
+            const size_t last = edges.size() - 1;
+            for (Eigen::Index i = 0; i < rows_; ++i) {
+                double x = data(i, f);
+                column[i] = uint8_t(std::isnan(x) ? last : std::min(lower_bound(edges, x), last));
+            }
+        }
+    }
+
+    Eigen::Index rows() const { return rows_; }
+    Eigen::Index cols() const { return cols_; }
+    int bins(Eigen::Index feature) const { return int(edges_[feature].size()); }
+    double edge(Eigen::Index feature, int bin) const { return edges_[feature][bin]; }
+    const uint8_t* column(Eigen::Index feature) const { return &codes_[size_t(feature) * rows_]; }
+
+private:
+    // std::lower_bound without the unpredictable branch per halving step
+    static size_t lower_bound(const std::vector<double>& edges, double x) {
+        const double* base = edges.data();
+        size_t n = edges.size();
+        while (n > 1) {
+            size_t half = n / 2;
+            base = base[half - 1] < x ? base + half : base;
+            n -= half;
+        }
+        return size_t(base - edges.data()) + (*base < x);
+    }
+
+    Eigen::Index rows_, cols_;
+    std::vector<uint8_t> codes_;
+    std::vector<std::vector<double>> edges_;  // Upper edge of each bin, ascending
+};
+
+struct HistTreeOptions {
+    int max_depth = 10;
+    ThreadPool* pool = nullptr;        // Expand nodes in parallel on this pool
+    size_t parallel_min_rows = 4096;   // Smaller nodes are expanded on the calling thread
+};
+
+// Grows trees on a BinnedMatrix. One trainer serves every tree of a forest,
+// and train() may run concurrently for different trees.
+class HistTreeTrainer {
+public:
+    HistTreeTrainer(const BinnedMatrix& binned, const Eigen::VectorXd& labels, HistTreeOptions options = {})
+        : binned_(binned), labels_(labels), options_(options), offsets_(binned.cols() + 1, 0) {
+        if (labels.size() != binned.rows()) throw std::invalid_argument("Labels do not match the binned data");
+        if (binned.cols() == 0) throw std::invalid_argument("Cannot train a tree without features");
+        for (Eigen::Index f = 0; f < binned.cols(); ++f) offsets_[f + 1] = offsets_[f] + binned.bins(f);
+    }
+
+    // Train on the given rows (repeats allowed); weights, if given, are per
+    // row of the full matrix and default to 1
+    TreeNode* train(std::vector<uint32_t> rows, const std::vector<double>* weights = nullptr) const {
+        for (uint32_t row : rows) {
+            if (Eigen::Index(row) >= binned_.rows()) throw std::out_of_range("Row index outside the training data");
+        }
+        Tree tree{std::move(rows), weights};
+        Histogram root = build(tree, 0, tree.rows.size());
+        return grow(tree, 0, tree.rows.size(), root, 0);
+    }
+
+private:
+    struct Bin {
+        double weight = 0.0;
+        double positive = 0.0;  // Weight of the +1 labels
+    };
+    using Histogram = std::vector<Bin>;  // Bins of all features, offsets_[f] onwards for feature f
+
+    struct Split {
+        int feature = -1;
+        int bin = 0;
+        double gini = std::numeric_limits<double>::max();
+    };
+
+    // State of one train() call
+    struct Tree {
+        std::vector<uint32_t> rows;  // Row indices, partitioned into node ranges
+        const std::vector<double>* weights;
+
+        double weight(uint32_t row) const { return weights ? (*weights)[row] : 1.0; }
+    };
+
+    static double gini(double weight, double positive) {
+        if (weight <= 0.0) return 0.0;
+        double p = positive / weight;
+        return 1.0 - (p * p + (1.0 - p) * (1.0 - p));
+    }
+
+    // One pass over the rows of [begin, end) per feature; features of a large
+    // node go to the pool, each filling its own slice of the histogram
+    Histogram build(const Tree& tree, size_t begin, size_t end) const {
+        Histogram hist(offsets_.back());
+        auto build_feature = [&](Eigen::Index f) {
+            const uint8_t* codes = binned_.column(f);
+            Bin* bins = &hist[offsets_[f]];
+            for (size_t i = begin; i < end; ++i) {
+                uint32_t row = tree.rows[i];
+                double w = tree.weight(row);
+                bins[codes[row]].weight += w;
+                bins[codes[row]].positive += labels_[row] > 0 ? w : 0.0;
+            }
+        };
+        if (options_.pool && end - begin >= options_.parallel_min_rows && binned_.cols() > 1) {
+            TaskGroup features(*options_.pool);
+            for (Eigen::Index f = 1; f < binned_.cols(); ++f) features.run([&build_feature, f]() { build_feature(f); });
+            build_feature(0);
+            features.wait();
+        } else {
+            for (Eigen::Index f = 0; f < binned_.cols(); ++f) build_feature(f);
+        }
+        return hist;
+    }
+
+    // Lowest weighted Gini impurity over all "bin <= b" splits with two non-empty sides
+    Split best_split(const Histogram& hist, double weight, double positive) const {
+        Split best;
+        const double empty = weight * 1e-12;  // Residue of subtracted histograms
+        for (Eigen::Index f = 0; f < binned_.cols(); ++f) {
+            const Bin* bins = &hist[offsets_[f]];
+            double left_weight = 0.0, left_positive = 0.0;
+            for (int b = 0; b + 1 < binned_.bins(f); ++b) {
+                left_weight += bins[b].weight;
+                left_positive += bins[b].positive;
+                double right_weight = weight - left_weight;
+                if (bins[b].weight <= empty) continue;  // Same split as the previous bin, or none
+                if (right_weight <= empty) break;
+
+                double weighted = (left_weight * gini(left_weight, left_positive) +
+                                   right_weight * gini(right_weight, positive - left_positive)) / weight;
+                if (weighted < best.gini) best = {int(f), b, weighted};
+            }
+        }
+        return best;
+    }
+
+    TreeNode* grow(Tree& tree, size_t begin, size_t end, Histogram& hist, int depth) const {
+        TreeNode* node = new TreeNode();
+
+        double weight = 0.0, positive = 0.0;
+        for (int b = 0; b < binned_.bins(0); ++b) {
+            weight += hist[b].weight;
+            positive += hist[b].positive;
+        }
+        node->prediction = positive >= weight - positive ? 1.0 : -1.0;  // Majority vote
+
+        // Stopping conditions
+        if (depth >= options_.max_depth || end - begin <= 1 || gini(weight, positive) == 0.0) return node;
+        Split split = best_split(hist, weight, positive);
+        if (split.feature == -1) return node;
+
+        // Partition the node's rows in place: bin <= split.bin goes left
+        size_t middle;
+        bool left_smaller;
+        Histogram smaller;
+        {
+            PERF_SCOPE("split_data");
+            const uint8_t* codes = binned_.column(split.feature);
+            middle = std::partition(tree.rows.begin() + begin, tree.rows.begin() + end,
+                                    [&](uint32_t row) { return codes[row] <= split.bin; }) - tree.rows.begin();
+            if (middle == begin || middle == end) return node;
+
+            // Build the smaller child; the parent minus it is the larger one
+            left_smaller = middle - begin <= end - middle;
+            smaller = left_smaller ? build(tree, begin, middle) : build(tree, middle, end);
+            for (size_t i = 0; i < hist.size(); ++i) {
+                hist[i].weight -= smaller[i].weight;
+                hist[i].positive -= smaller[i].positive;
+            }
+        }
+        Histogram& left_hist = left_smaller ? smaller : hist;
+        Histogram& right_hist = left_smaller ? hist : smaller;
+
+        node->feature_index = split.feature;
+        node->threshold = binned_.edge(split.feature, split.bin);
+
+        // The children own disjoint row ranges and histograms, so a large
+        // left subtree can grow on another worker while this one takes the right
+        if (options_.pool && std::min(middle - begin, end - middle) >= options_.parallel_min_rows) {
+            TaskGroup subtree(*options_.pool);
+            subtree.run([&]() { node->left = grow(tree, begin, middle, left_hist, depth + 1); });
+            node->right = grow(tree, middle, end, right_hist, depth + 1);
+            subtree.wait();
+        } else {
+            node->left = grow(tree, begin, middle, left_hist, depth + 1);
+            node->right = grow(tree, middle, end, right_hist, depth + 1);
+        }
+        return node;
+    }
+
+    const BinnedMatrix& binned_;
+    const Eigen::VectorXd& labels_;
+    HistTreeOptions options_;
+    std::vector<size_t> offsets_;  // Start of each feature's bins in a Histogram
+};
+
+// Bootstrap sample of `rows` draws with replacement for tree `tree` of a
+// forest, as draw counts per row of the full matrix (the trainer's weights)
+// plus the rows drawn at least once. Each tree has its own random stream
+// derived from (seed, tree), so the sample never depends on which thread
+// trains the tree or in what order.
+struct Bootstrap {
+    std::vector<uint32_t> rows;
+    std::vector<double> counts;
+};
+
+inline Bootstrap bootstrap_counts(Eigen::Index rows, uint64_t seed, uint64_t tree) {
+    std::seed_seq sequence{uint32_t(seed), uint32_t(seed >> 32), uint32_t(tree), uint32_t(tree >> 32)};
+    std::mt19937_64 rng(sequence);
+    Bootstrap sample;
+    sample.counts.assign(rows, 0.0);
+    if (rows == 0) return sample;
+    std::uniform_int_distribution<Eigen::Index> pick(0, rows - 1);
+    for (Eigen::Index i = 0; i < rows; ++i) sample.counts[pick(rng)] += 1.0;
+    for (Eigen::Index row = 0; row < rows; ++row) {
+        if (sample.counts[row] > 0.0) sample.rows.push_back(uint32_t(row));
+    }
+    return sample;
+}
@@ -1,164 +1,113 @@
 #include <iostream>
 #include <vector>
 #include <thread>
+#include <utility>
 #include <boost/asio.hpp>
 #include <mutex>
 #include <Eigen/Dense>
-#include <map>
-#include <iterator>  // For begin() and end()
+#include "../common/async_server.hpp"
+#include "../common/perf_counters.hpp"
+#include "../common/trace.hpp"
+#include "../common/wire_protocol.hpp"
+#include "flat_forest.hpp"
+#include "forest_codec.hpp"
 
 using namespace Eigen;
 using boost::asio::ip::tcp;
 
-// Decision Tree Node Structure
-struct TreeNode {
-    int feature_index = -1;
-    double threshold = 0.0;
-    double prediction = 0.0;
-    TreeNode* left = nullptr;
-    TreeNode* right = nullptr;
-};
-
 std::mutex model_mutex;
 
-// Aggregated decision trees (from multiple clients)
-std::vector<std::vector<TreeNode*>> aggregated_forests;  // Correct declaration
-
-// Deserialize TreeNode (assuming a specific format for simplicity)
-TreeNode* deserialize_tree_node(const std::vector<double>& serialized_tree, int& index) {
-    if (index >= serialized_tree.size()) return nullptr;
-
-    TreeNode* node = new TreeNode;
-    node->feature_index = static_cast<int>(serialized_tree[index++]);
-    node->threshold = serialized_tree[index++];
-    node->prediction = serialized_tree[index++];
-
-    // Recursively deserialize left and right subtrees
-    if (node->feature_index != -1) {
-        node->left = deserialize_tree_node(serialized_tree, index);
-        node->right = deserialize_tree_node(serialized_tree, index);
-    }
-
-    return node;
-}
-
-// Predict using a single decision tree
-double predict_tree(const TreeNode* node, const Eigen::VectorXd& x) {
-    if (!node->left && !node->right) {
-        return node->prediction;
-    }
-    if (x(node->feature_index) <= node->threshold) {
-        return predict_tree(node->left, x);
-    } else {
-        return predict_tree(node->right, x);
-    }
-}
+// Aggregated decision trees from all clients, flattened for batched scoring
+FlatForest aggregated_forest;
+int forests_received = 0;
 
-// Aggregation function using majority voting
-std::vector<double> majority_voting(const MatrixXd& test_data) {
-    std::vector<double> final_predictions(test_data.rows(), 0.0);
-
-    // For each test sample, calculate votes from all trees
-    for (int i = 0; i < test_data.rows(); ++i) {
-        std::map<double, int> votes_count;  // Map to store class and its vote count
+// Function to perform predictions; called with model_mutex held
+void perform_predictions() {
+    if (forests_received >= 2) {  // Wait until we have at least 2 forests
+        TRACE_SCOPE("predict");
+        PERF_SCOPE("predict");
+        MatrixXd test_data(4, 2);  // Example test data
+        test_data << 1, 2,
+                     2, 1,
+                     3, 4,
+                     4, 3;
 
-        for (const auto& forest : aggregated_forests) {
-            for (const auto& tree : forest) {
-                double prediction = predict_tree(tree, test_data.row(i));
-                votes_count[prediction]++;
-            }
-        }
+        std::vector<double> predictions = aggregated_forest.predict(test_data);
 
-        // Determine the class with the most votes
-        int max_votes = 0;
-        double best_class = -1;
-        for (const auto& [predicted_class, count] : votes_count) {
-            if (count > max_votes) {
-                max_votes = count;
-                best_class = predicted_class;
-            }
+        // Display the predictions
+        std::cout << "Predictions for test data: ";
+        for (const auto& pred : predictions) {
+            std::cout << pred << " ";
         }
-
-        // Final prediction for this sample
-        final_predictions[i] = best_class;
+        std::cout << std::endl;
     }
-
-    return final_predictions;
 }
 
 // Handle client function: Deserialize and store the client's random forest
-void handle_client(tcp::socket socket) {
+awaitable<void> handle_client(tcp::socket socket) {
     try {
+        TRACE_CLIENT(client, socket.remote_endpoint());
         std::cout << "[DEBUG] Handling new client connection.\n";
 
-        // Read size of the incoming forest (number of trees)
-        int forest_size;
-        boost::asio::read(socket, boost::asio::buffer(&forest_size, sizeof(int)));
-
-        // Deserialize the forest (each tree represented as a serialized vector of doubles)
-        std::vector<TreeNode*> local_forest(forest_size);
-        for (int i = 0; i < forest_size; ++i) {
-            // Read serialized tree size
-            int tree_size;
-            boost::asio::read(socket, boost::asio::buffer(&tree_size, sizeof(int)));
-
-            // Read the serialized tree data
-            std::vector<double> serialized_tree(tree_size);
-            boost::asio::read(socket, boost::asio::buffer(serialized_tree.data(), tree_size * sizeof(double)));
+        while (true) {
+            // Each forest is one frame: compactly encoded (Bytes), or
+            // concatenated preorder trees of doubles (Float64)
+            std::optional<FrameHeader> header = co_await async_read_frame_header(socket);
+            if (!header) break;
+            bool compact = header->element_type() == DType::Bytes;
+            expect_frame(*header, MessageType::Forest, compact ? DType::Bytes : DType::Float64);
+            if (header->cols != 1) throw std::runtime_error("Forest payload must be a single column");
+
+            // Read the payload outside the lock
+            std::vector<uint8_t> encoded;
+            std::vector<double> serialized_forest;
+            if (compact) {
+                encoded.resize(header->payload_bytes);
+                co_await async_read_frame_payload(socket, *header, asio::buffer(encoded));
+            } else {
+                serialized_forest.resize(header->rows);
+                co_await async_read_frame_payload(socket, *header, asio::buffer(serialized_forest));
+            }
 
-            // Deserialize the tree and store it in local_forest
-            int index = 0;
-            local_forest[i] = deserialize_tree_node(serialized_tree, index);
-        }
+            // Lock and decode straight into the global forest, with no
+            // intermediate forest to copy; a malformed payload is rolled back whole
+            size_t trees_added;
+            {
+                TRACE_SCOPE_TAGGED("merge_forest", header->round, client);
+                PERF_SCOPE("merge_forest");
+                std::lock_guard<std::mutex> lock(model_mutex);
+                if (compact) {
+                    TRACE_SCOPE_TAGGED("decode_forest", header->round, client);
+                    PERF_SCOPE("decode_forest");
+                    trees_added = decode_forest(encoded.data(), encoded.size(), aggregated_forest);
+                } else {
+                    trees_added = aggregated_forest.append_serialized(serialized_forest);
+                }
+                ++forests_received;
+
+                // Run the predictions once enough models have arrived
+                perform_predictions();
+            }
 
-        // Lock and aggregate the received forest into the global model
-        {
-            std::lock_guard<std::mutex> lock(model_mutex);
-            aggregated_forests.push_back(local_forest);  // Correct usage of push_back
+            std::cout << "[DEBUG] Received and stored a forest of " << trees_added << " trees from a client.\n";
         }
 
-        std::cout << "[DEBUG] Received and stored a forest from a client.\n";
-
     } catch (std::exception& e) {
         std::cerr << "Error: " << e.what() << "\n";
     }
 }
 
-// Function to perform predictions
-void perform_predictions() {
-    if (aggregated_forests.size() >= 2) {  // Wait until we have at least 2 forests
-        MatrixXd test_data(4, 2);  // Example test data
-        test_data << 1, 2,
-                     2, 1,
-                     3, 4,
-                     4, 3;
-
-        std::vector<double> predictions = majority_voting(test_data);
-
-        // Display the predictions
-        std::cout << "Predictions for test data: ";
-        for (const auto& pred : predictions) {
-            std::cout << pred << " ";
-        }
-        std::cout << std::endl;
-    }
-}
-
 int main() {
-    boost::asio::io_service io_service;
-    tcp::acceptor acceptor(io_service, tcp::endpoint(tcp::v4(), 8080));
-
-    std::cout << "Server is running on port 8080...\n";
-
-    while (true) {
-        tcp::socket socket(io_service);
-        acceptor.accept(socket);
+    try {
+        TRACE_PROCESS("RF server", -1);
+        // Sessions run as coroutines on a fixed thread pool, one strand per connection
+        AsyncServer server(8080, handle_client);
 
-        // Handle each client in a separate thread
-        std::thread(handle_client, std::move(socket)).detach();
+        std::cout << "Server is running on port 8080...\n";
 
-        // After handling clients, call the prediction function if conditions are met
-        perform_predictions();
+        server.run();
+    } catch (std::exception& e) {
+        std::cerr << "Error: " << e.what() << "\n";
     }
 
     return 0;
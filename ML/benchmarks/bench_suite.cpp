@@ -0,0 +1,278 @@
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <benchmark/benchmark.h>
+#include <Eigen/Dense>
+#include "../common/data_source.hpp"
+#include "../common/linear_core.hpp"
+#include "../common/sharded_aggregator.hpp"
+#include "../common/thread_pool.hpp"
+#include "../Adaboost/stump_learner.hpp"
+#include "../Adaboost/stump_ensemble.hpp"
+#include "../KernelSVM/rbf_kernel_engine.hpp"
+#include "../Kmeans/kmeans_solvers.hpp"
+#include "../RF/hist_tree.hpp"
+#include "../RF/flat_forest.hpp"
+#include "../RF/forest_codec.hpp"
+#include "synthetic_data.hpp"
+
+using namespace Eigen;
+// g++ -O3 -march=native -fopenmp -std=c++17 bench_suite.cpp -o bench_suite -I /usr/include/eigen3 -lbenchmark -lpthread
+// ./bench_suite [--benchmark_filter=regex] [--benchmark_out=run.json --benchmark_out_format=json] [max_values]
+//
+// Google Benchmark suite over the algorithm kernels, on synthetic data
+// (synthetic_data.hpp). Data kernels run over rows x features in
+// {1e3, 1e4, 1e5, 1e6} x {2, 10, 100, 1000}, and those that take a
+// ThreadPool also over 1 and all hardware threads. Grid points with more than
+// max_values (default 1e8) matrix values are skipped to bound memory.
+//
+// Kernels are the current implementations behind the functions of the
+// clients and servers:
+//
+//     train_local_svm     LinearCore hinge gradient and step (LSVM client)
+//     train_weak_learner  StumpLearner::train, presorting excluded (AdaBoost client)
+//     gini_impurity       HistTreeTrainer root split: one histogram pass and Gini scan (RF client)
+//     predict_tree        FlatForest::predict_tree, one tree, row by row (RF server)
+//     majority_voting     FlatForest::predict, 16 trees (RF server)
+//     stump_ensemble      StumpEnsemble::score of 256 stumps (AdaBoost server)
+//     rbf_kernel          RbfKernelEngine::gram of a 64-row tile against every row (KernelSVM client)
+//     perform_kmeans      One Lloyd iteration with k = 8 (Kmeans client)
+//     aggregate_model     ShardedAggregator::add from 1..N concurrent clients (linear servers)
+//
+// Compare a run against a stored baseline with compare_bench.py.
+
+Index max_values = 100000000;
+
+const std::vector<int64_t> ROWS = {1000, 10000, 100000, 1000000};
+const std::vector<int64_t> FEATURES = {2, 10, 100, 1000};
+
+// rows x features (x threads) grid, without the points over max_values
+void data_grid(benchmark::internal::Benchmark* b, bool threaded) {
+    std::vector<int64_t> threads = {1};
+    int64_t hardware = std::max(1u, std::thread::hardware_concurrency());
+    if (threaded && hardware > 1) threads.push_back(hardware);
+
+    b->ArgNames({"rows", "features", "threads"});
+    for (int64_t rows : ROWS) {
+        for (int64_t features : FEATURES) {
+            if (rows * features > max_values) continue;
+            for (int64_t t : threads) b->Args({rows, features, t});
+        }
+    }
+    b->Unit(benchmark::kMillisecond)->UseRealTime();
+}
+
+void data_grid_threaded(benchmark::internal::Benchmark* b) { data_grid(b, true); }
+void data_grid_serial(benchmark::internal::Benchmark* b) { data_grid(b, false); }
+
+// A pool of `threads` workers, or none for one thread
+std::unique_ptr<ThreadPool> pool_for(int64_t threads) {
+    return threads > 1 ? std::make_unique<ThreadPool>(unsigned(threads)) : nullptr;
+}
+
+void set_data_counters(benchmark::State& state, Index rows, Index features) {
+    state.SetItemsProcessed(int64_t(state.iterations()) * rows);
+    state.SetBytesProcessed(int64_t(state.iterations()) * rows * features * int64_t(sizeof(double)));
+}
+
+// Trees of depth 10 trained on at most 10k of the rows; scoring runs over all of them
+FlatForest train_forest(const SyntheticData& data, int trees) {
+    Index sample = std::min<Index>(data.X.rows(), 10000);
+    MatrixXd X = data.X.topRows(sample);
+    VectorXd labels = data.labels.head(sample);
+    BinnedMatrix binned(X);
+    HistTreeTrainer trainer(binned, labels);
+
+    std::vector<TreeNode*> roots;
+    for (int t = 0; t < trees; ++t) {
+        Bootstrap bootstrap = bootstrap_counts(sample, 7, t);
+        roots.push_back(trainer.train(std::move(bootstrap.rows), &bootstrap.counts));
+    }
+    std::vector<uint8_t> encoded = encode_forest(std::vector<const TreeNode*>(roots.begin(), roots.end()));
+    FlatForest forest;
+    decode_forest(encoded.data(), encoded.size(), forest);
+
+    auto destroy = [](TreeNode* node, auto& self) -> void {
+        if (!node) return;
+        self(node->left, self);
+        self(node->right, self);
+        delete node;
+    };
+    for (TreeNode* root : roots) destroy(root, destroy);
+    return forest;
+}
+
+void BM_train_local_svm(benchmark::State& state) {
+    const SyntheticData& data = synthetic_data(state.range(0), state.range(1));
+    auto pool = pool_for(state.range(2));
+    MatrixDataSource source(data.X, data.labels, 8192);
+    LinearCoreOptions options;
+    options.pool = pool.get();
+    auto core = make_linear_core(LinearLoss::Hinge, source, options);
+
+    VectorXd weights = VectorXd::Zero(data.X.cols());
+    core->gradient(weights);  // Loads the resident copy
+    for (auto _ : state) {
+        weights -= 0.01 * core->gradient(weights);
+        benchmark::DoNotOptimize(weights.data());
+    }
+    set_data_counters(state, data.X.rows(), data.X.cols());
+}
+
+void BM_train_weak_learner(benchmark::State& state) {
+    const SyntheticData& data = synthetic_data(state.range(0), state.range(1));
+    auto pool = pool_for(state.range(2));
+    StumpLearner stumps(data.X, data.labels, pool.get());
+    VectorXd weights = VectorXd::Ones(data.X.rows()) / double(data.X.rows());
+
+    for (auto _ : state) {
+        WeakLearner learner = stumps.train(weights);
+        benchmark::DoNotOptimize(learner);
+    }
+    set_data_counters(state, data.X.rows(), data.X.cols());
+}
+
+void BM_gini_impurity(benchmark::State& state) {
+    const SyntheticData& data = synthetic_data(state.range(0), state.range(1));
+    auto pool = pool_for(state.range(2));
+    BinnedMatrix binned(data.X);
+    HistTreeOptions options;
+    options.max_depth = 1;
+    options.pool = pool.get();
+    HistTreeTrainer trainer(binned, data.labels, options);
+
+    std::vector<uint32_t> rows(data.X.rows());
+    for (size_t i = 0; i < rows.size(); ++i) rows[i] = uint32_t(i);
+    for (auto _ : state) {
+        TreeNode* root = trainer.train(rows);
+        benchmark::DoNotOptimize(root->threshold);
+        delete root->left;
+        delete root->right;
+        delete root;
+    }
+    set_data_counters(state, data.X.rows(), data.X.cols());
+}
+
+void BM_predict_tree(benchmark::State& state) {
+    const SyntheticData& data = synthetic_data(state.range(0), state.range(1));
+    FlatForest forest = train_forest(data, 1);
+
+    for (auto _ : state) {
+        double votes = 0.0;
+        for (Index i = 0; i < data.X.rows(); ++i) votes += forest.predict_tree(0, data.X.row(i).transpose());
+        benchmark::DoNotOptimize(votes);
+    }
+    set_data_counters(state, data.X.rows(), data.X.cols());
+}
+
+void BM_majority_voting(benchmark::State& state) {
+    const SyntheticData& data = synthetic_data(state.range(0), state.range(1));
+    FlatForest forest = train_forest(data, 16);
+
+    for (auto _ : state) {
+        std::vector<double> predictions = forest.predict(data.X);
+        benchmark::DoNotOptimize(predictions.data());
+    }
+    set_data_counters(state, data.X.rows(), data.X.cols());
+}
+
+void BM_stump_ensemble(benchmark::State& state) {
+    const SyntheticData& data = synthetic_data(state.range(0), state.range(1));
+    auto pool = pool_for(state.range(2));
+    std::mt19937_64 rng(3);
+    std::uniform_int_distribution<int> feature(0, int(data.X.cols()) - 1);
+    std::normal_distribution<double> normal(0.0, 1.0);
+    std::vector<WeakLearner> learners(256);
+    for (WeakLearner& learner : learners) learner = {feature(rng), normal(rng), normal(rng)};
+    StumpEnsemble ensemble(learners);
+
+    for (auto _ : state) {
+        VectorXd scores = ensemble.score(data.X, pool.get());
+        benchmark::DoNotOptimize(scores.data());
+    }
+    set_data_counters(state, data.X.rows(), data.X.cols());
+}
+
+void BM_rbf_kernel(benchmark::State& state) {
+    const SyntheticData& data = synthetic_data(state.range(0), state.range(1));
+    const Index tile = std::min<Index>(64, data.X.rows());
+    VectorXd norms = data.X.rowwise().squaredNorm();
+    MatrixXd K;
+
+    for (auto _ : state) {
+        RbfKernelEngine::gram(data.X.topRows(tile), norms.head(tile), data.X, norms, 0.1, K);
+        benchmark::DoNotOptimize(K.data());
+    }
+    set_data_counters(state, data.X.rows(), data.X.cols());
+}
+
+void BM_perform_kmeans(benchmark::State& state) {
+    const SyntheticData& data = synthetic_data(state.range(0), state.range(1));
+#if defined(_OPENMP)
+    omp_set_num_threads(int(state.range(2)));
+#endif
+    MatrixXd centroids = data.X.topRows(std::min<Index>(8, data.X.rows()));
+    KMeansOptions options;
+    options.max_iters = 1;
+    options.tolerance = 0.0;
+
+    for (auto _ : state) {
+        KMeansResult result = run_kmeans(data.X, centroids, options);
+        benchmark::DoNotOptimize(result.centroids.data());
+    }
+    set_data_counters(state, data.X.rows(), data.X.cols());
+#if defined(_OPENMP)
+    omp_set_num_threads(int(std::max(1u, std::thread::hardware_concurrency())));
+#endif
+}
+
+// Every benchmark thread is one client adding a model of range(0) values per
+// iteration into the same aggregator
+std::unique_ptr<ShardedAggregator> aggregator;
+
+void BM_aggregate_model(benchmark::State& state) {
+    if (state.thread_index() == 0) aggregator = std::make_unique<ShardedAggregator>();
+    MatrixXd update = MatrixXd::Constant(state.range(0), 1, 0.5 + state.thread_index());
+
+    for (auto _ : state) aggregator->add(update, 100.0);
+
+    state.SetItemsProcessed(int64_t(state.iterations()));
+    state.SetBytesProcessed(int64_t(state.iterations()) * state.range(0) * int64_t(sizeof(double)));
+    if (state.thread_index() == 0) aggregator.reset();
+}
+
+// Registered at run time: the data grid depends on max_values
+void register_benchmarks() {
+    benchmark::RegisterBenchmark("BM_train_local_svm", BM_train_local_svm)->Apply(data_grid_threaded);
+    benchmark::RegisterBenchmark("BM_train_weak_learner", BM_train_weak_learner)->Apply(data_grid_threaded);
+    benchmark::RegisterBenchmark("BM_gini_impurity", BM_gini_impurity)->Apply(data_grid_threaded);
+    benchmark::RegisterBenchmark("BM_predict_tree", BM_predict_tree)->Apply(data_grid_serial);
+    benchmark::RegisterBenchmark("BM_majority_voting", BM_majority_voting)->Apply(data_grid_serial);
+    benchmark::RegisterBenchmark("BM_stump_ensemble", BM_stump_ensemble)->Apply(data_grid_threaded);
+    benchmark::RegisterBenchmark("BM_rbf_kernel", BM_rbf_kernel)->Apply(data_grid_serial);
+#if defined(_OPENMP)
+    benchmark::RegisterBenchmark("BM_perform_kmeans", BM_perform_kmeans)->Apply(data_grid_threaded);
+#else
+    benchmark::RegisterBenchmark("BM_perform_kmeans", BM_perform_kmeans)->Apply(data_grid_serial);
+#endif
+    benchmark::RegisterBenchmark("BM_aggregate_model", BM_aggregate_model)
+        ->ArgName("model_size")
+        ->RangeMultiplier(10)
+        ->Range(1000, 1000000)
+        ->ThreadRange(1, int(std::max(1u, std::thread::hardware_concurrency())))
+        ->UseRealTime();
+}
+
+int main(int argc, char** argv) {
+    benchmark::Initialize(&argc, argv);  // Consumes the --benchmark_* flags
+    if (argc > 1) max_values = std::stoll(argv[1]);
+    register_benchmarks();
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
@@ -0,0 +1,93 @@
+#!/usr/bin/env python3
+"""Compare a bench_suite JSON run against a stored baseline.
+
+    ./bench_suite --benchmark_out=baseline.json --benchmark_out_format=json
+    ./bench_suite --benchmark_out=run.json --benchmark_out_format=json
+    python3 compare_bench.py baseline.json run.json [--threshold 0.10]
+
+Benchmarks are matched by name and compared on real time per iteration. With
+--benchmark_repetitions the median aggregate is used. A benchmark more than
+`threshold` slower than its baseline is a regression; the script prints every
+match and exits with status 1 if there is any regression, so it can gate CI.
+Benchmarks present in only one file are listed but never fail the run.
+
+--update copies the run over the baseline after comparing it.
+"""
+
+import argparse
+import json
+import shutil
+import sys
+
+NS_PER_UNIT = {"ns": 1.0, "us": 1e3, "ms": 1e6, "s": 1e9}
+
+
+def load_times(path):
+    """Map benchmark name -> real time per iteration in ns"""
+    with open(path) as f:
+        report = json.load(f)
+    times = {}
+    medians = {}
+    for bench in report.get("benchmarks", []):
+        if bench.get("error_occurred"):
+            continue
+        ns = bench["real_time"] * NS_PER_UNIT[bench.get("time_unit", "ns")]
+        if bench.get("run_type") == "aggregate":
+            if bench.get("aggregate_name") == "median":
+                medians[bench["run_name"]] = ns
+        else:
+            # Repetitions share a run_name; keep the fastest if there is no median
+            name = bench.get("run_name", bench["name"])
+            times[name] = min(ns, times.get(name, ns))
+    times.update(medians)
+    return times
+
+
+def format_ns(ns):
+    for unit in ("s", "ms", "us"):
+        if ns >= NS_PER_UNIT[unit]:
+            return "%.3f %s" % (ns / NS_PER_UNIT[unit], unit)
+    return "%.0f ns" % ns
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Flag benchmark regressions against a baseline")
+    parser.add_argument("baseline")
+    parser.add_argument("run")
+    parser.add_argument("--threshold", type=float, default=0.10,
+                        help="relative slowdown that counts as a regression (default 0.10)")
+    parser.add_argument("--update", action="store_true", help="replace the baseline with this run afterwards")
+    args = parser.parse_args()
+
+    baseline = load_times(args.baseline)
+    run = load_times(args.run)
+
+    regressions = 0
+    width = max([len(name) for name in run] + [9])
+    print("%-*s %12s %12s %9s" % (width, "benchmark", "baseline", "run", "change"))
+    for name in sorted(run):
+        if name not in baseline:
+            print("%-*s %12s %12s %9s" % (width, name, "-", format_ns(run[name]), "new"))
+            continue
+        change = run[name] / baseline[name] - 1.0
+        flag = ""
+        if change > args.threshold:
+            flag = "  REGRESSION"
+            regressions += 1
+        elif change < -args.threshold:
+            flag = "  improved"
+        print("%-*s %12s %12s %+8.1f%%%s" % (width, name, format_ns(baseline[name]), format_ns(run[name]),
+                                            100.0 * change, flag))
+    for name in sorted(set(baseline) - set(run)):
+        print("%-*s %12s %12s %9s" % (width, name, format_ns(baseline[name]), "-", "missing"))
+
+    print("[INFO] %d of %d benchmarks regressed by more than %.0f%%"
+          % (regressions, len(set(run) & set(baseline)), 100.0 * args.threshold))
+    if args.update:
+        shutil.copyfile(args.run, args.baseline)
+        print("[INFO] Baseline %s updated" % args.baseline)
+    return 1 if regressions else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
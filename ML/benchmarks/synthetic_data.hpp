@@ -0,0 +1,64 @@
+#pragma once
+
+// Synthetic datasets for the benchmark suite.
+//
+// Every dataset is a deterministic function of (rows, features, seed), so two
+// runs of the suite on different builds measure the same inputs. Features
+// are standard normal; the labels come from a random linear teacher:
+//
+//     margin = x . w_true
+//     label  = sign(margin), flipped for 5% of the rows  (+1 / -1)
+//     target = margin + N(0, 0.1)                         (regression)
+//
+// which gives the SVM, boosting and tree kernels a learnable but noisy
+// problem, and the regression kernels a well-conditioned one.
+//
+// Generating 1e6 x 100 values takes longer than most kernels run, and the
+// benchmark library calls a benchmark several times per argument set, so
+// the most recent dataset is cached. Only one is kept: the largest sets are
+// hundreds of MB.
+
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <Eigen/Dense>
+
+struct SyntheticData {
+    Eigen::MatrixXd X;
+    Eigen::VectorXd labels;   // +1 / -1
+    Eigen::VectorXd targets;  // Real-valued regression targets
+};
+
+inline SyntheticData make_synthetic_data(Eigen::Index rows, Eigen::Index features, uint64_t seed = 42) {
+    std::mt19937_64 rng(seed);
+    std::normal_distribution<double> normal(0.0, 1.0);
+    std::bernoulli_distribution flip(0.05);
+
+    SyntheticData data;
+    data.X = Eigen::MatrixXd::NullaryExpr(rows, features, [&]() { return normal(rng); });
+    Eigen::VectorXd w_true = Eigen::VectorXd::NullaryExpr(features, [&]() { return normal(rng); });
+    Eigen::VectorXd margin = data.X * w_true;
+    data.labels.resize(rows);
+    data.targets.resize(rows);
+    for (Eigen::Index i = 0; i < rows; ++i) {
+        double label = margin(i) >= 0.0 ? 1.0 : -1.0;
+        data.labels(i) = flip(rng) ? -label : label;
+        data.targets(i) = margin(i) + 0.1 * normal(rng);
+    }
+    return data;
+}
+
+// The dataset for (rows, features, seed), reusing the previous one when it matches
+inline const SyntheticData& synthetic_data(Eigen::Index rows, Eigen::Index features, uint64_t seed = 42) {
+    static std::unique_ptr<SyntheticData> cached;
+    static Eigen::Index cached_rows = -1, cached_features = -1;
+    static uint64_t cached_seed = 0;
+    if (!cached || cached_rows != rows || cached_features != features || cached_seed != seed) {
+        cached.reset();  // Free the old set before building the new one
+        cached = std::make_unique<SyntheticData>(make_synthetic_data(rows, features, seed));
+        cached_rows = rows;
+        cached_features = features;
+        cached_seed = seed;
+    }
+    return *cached;
+}
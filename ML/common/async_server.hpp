@@ -0,0 +1,139 @@
+#pragma once
+
+// Asynchronous TCP server core shared by the algorithm servers.
+//
+// One io_context is run by a fixed pool of threads. Every accepted connection
+// becomes a C++20 coroutine session bound to its own strand, so a session's
+// handlers never run concurrently while different sessions spread over the
+// pool. A connection costs a coroutine frame and a socket instead of a
+// dedicated OS thread and its stack.
+//
+// Sessions are written as straight-line code:
+//
+//     awaitable<void> handle_client(tcp::socket socket) {
+//         int n;
+//         co_await asio::async_read(socket, asio::buffer(&n, sizeof(int)), use_awaitable);
+//         ...
+//     }
+//
+// Build with -std=c++20. Boost 1.74's awaitable.hpp uses std::exchange without
+// including <utility>, so include <utility> before <boost/asio.hpp>.
+
+#include <utility>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <exception>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <boost/asio.hpp>
+#include <boost/asio/co_spawn.hpp>
+#include <boost/asio/detached.hpp>
+#include <boost/asio/use_awaitable.hpp>
+#include "round_coordinator.hpp"
+
+namespace asio = boost::asio;
+using asio::awaitable;
+using asio::use_awaitable;
+using boost::asio::ip::tcp;
+
+class AsyncServer {
+public:
+    using SessionHandler = std::function<awaitable<void>(tcp::socket)>;
+
+    // threads = 0 uses one thread per hardware thread
+    AsyncServer(unsigned short port, SessionHandler handler, unsigned threads = 0)
+        : threads_(threads ? threads : std::max(1u, std::thread::hardware_concurrency())),
+          io_context_(static_cast<int>(threads_)),
+          acceptor_(io_context_, tcp::endpoint(tcp::v4(), port)),
+          signals_(io_context_, SIGINT, SIGTERM),
+          handler_(std::move(handler)) {}
+
+    // Accept and serve connections until stop() or SIGINT / SIGTERM. The
+    // calling thread is one of the pool threads.
+    void run() {
+        asio::co_spawn(io_context_, accept_loop(), asio::detached);
+        signals_.async_wait([this](const boost::system::error_code& error, int) {
+            if (!error) stop();
+        });
+
+        std::vector<std::thread> pool;
+        for (unsigned i = 1; i < threads_; ++i) pool.emplace_back([this]() { io_context_.run(); });
+        io_context_.run();
+        for (auto& thread : pool) thread.join();
+    }
+
+    void stop() { io_context_.stop(); }
+
+    asio::io_context& context() { return io_context_; }
+    unsigned short port() const { return acceptor_.local_endpoint().port(); }
+    unsigned threads() const { return threads_; }
+    size_t active_sessions() const { return active_.load(std::memory_order_relaxed); }
+    size_t accepted_sessions() const { return accepted_.load(std::memory_order_relaxed); }
+
+private:
+    awaitable<void> accept_loop() {
+        while (true) {
+            bool failed = false;
+            try {
+                tcp::socket socket(co_await acceptor_.async_accept(asio::make_strand(io_context_), use_awaitable));
+                accepted_.fetch_add(1, std::memory_order_relaxed);
+                active_.fetch_add(1, std::memory_order_relaxed);
+                auto executor = socket.get_executor();
+                asio::co_spawn(executor, run_session(std::move(socket)), asio::detached);
+            } catch (const std::exception& e) {
+                std::cerr << "[ERROR] Accept failed: " << e.what() << std::endl;
+                failed = true;
+            }
+            if (failed) {
+                // Typically out of file descriptors; back off instead of spinning
+                asio::steady_timer timer(io_context_, std::chrono::milliseconds(100));
+                co_await timer.async_wait(use_awaitable);
+            }
+        }
+    }
+
+    awaitable<void> run_session(tcp::socket socket) {
+        try {
+            co_await handler_(std::move(socket));
+        } catch (const std::exception& e) {
+            std::cerr << "[ERROR] Exception in session: " << e.what() << std::endl;
+        }
+        active_.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    unsigned threads_;
+    asio::io_context io_context_;
+    tcp::acceptor acceptor_;
+    asio::signal_set signals_;
+    SessionHandler handler_;
+    std::atomic<size_t> active_{0};
+    std::atomic<size_t> accepted_{0};
+};
+
+// Asynchronous RoundCoordinator::contribute: suspends the session until its
+// round closes, then resumes it on the session's own executor
+template <typename CompletionToken>
+auto async_contribute(RoundCoordinator& coordinator, int round, const Eigen::MatrixXd& update, double samples,
+                      CompletionToken&& token) {
+    return asio::async_initiate<CompletionToken, void(std::exception_ptr, RoundReply)>(
+        [&coordinator, round, &update, samples](auto handler) {
+            // The coordinator stores copyable callbacks; the handler is move-only
+            auto shared = std::make_shared<decltype(handler)>(std::move(handler));
+            auto executor = asio::get_associated_executor(*shared);
+            auto complete = [shared, executor](std::exception_ptr error, RoundReply reply) {
+                asio::post(executor, [shared, error, reply]() mutable { (*shared)(error, std::move(reply)); });
+            };
+            try {
+                coordinator.submit(round, update, samples,
+                                   [complete](const RoundReply& reply) { complete(nullptr, reply); });
+            } catch (...) {
+                complete(std::current_exception(), RoundReply{});
+            }
+        },
+        token);
+}
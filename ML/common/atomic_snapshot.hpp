@@ -0,0 +1,39 @@
+#pragma once
+
+// RCU-style publication of an immutable value.
+//
+// A writer builds a new value and swaps the pointer in; readers take a
+// shared_ptr to whatever is current and keep using it (for example while
+// sending it to a client) without ever blocking the writer or each other.
+// The old value is freed once its last reader drops it.
+
+#include <atomic>
+#include <memory>
+#include <utility>
+
+template <typename T>
+class AtomicSnapshot {
+public:
+    std::shared_ptr<const T> load() const {
+#if defined(__cpp_lib_atomic_shared_ptr)
+        return ptr_.load(std::memory_order_acquire);
+#else
+        return std::atomic_load_explicit(&ptr_, std::memory_order_acquire);
+#endif
+    }
+
+    void store(std::shared_ptr<const T> value) {
+#if defined(__cpp_lib_atomic_shared_ptr)
+        ptr_.store(std::move(value), std::memory_order_release);
+#else
+        std::atomic_store_explicit(&ptr_, std::move(value), std::memory_order_release);
+#endif
+    }
+
+private:
+#if defined(__cpp_lib_atomic_shared_ptr)
+    std::atomic<std::shared_ptr<const T>> ptr_;
+#else
+    std::shared_ptr<const T> ptr_;
+#endif
+};
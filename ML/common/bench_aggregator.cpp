@@ -0,0 +1,113 @@
+
+#include <atomic>
+#include <cmath>
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <Eigen/Dense>
+#include "sharded_aggregator.hpp"
+
+using namespace Eigen;
+// g++ -O3 -march=native -std=c++17 bench_aggregator.cpp -o bench_aggregator -I /usr/include/eigen3 -lpthread
+// ./bench_aggregator [parameters] [threads] [updates_per_thread]
+
+// The previous server pattern: one mutex around the whole-vector add
+struct MutexAccumulator {
+    std::mutex mutex;
+    VectorXd sum;
+    double total = 0.0;
+
+    void add(const VectorXd& update, double weight) {
+        std::lock_guard<std::mutex> lock(mutex);
+        sum.noalias() += weight * update;
+        total += weight;
+    }
+};
+
+template <typename Fn>
+double seconds(Fn&& fn) {
+    auto start = std::chrono::steady_clock::now();
+    fn();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+template <typename AddFn>
+void run_threads(int threads, int updates, const std::vector<VectorXd>& inputs, AddFn&& add) {
+    std::vector<std::thread> pool;
+    for (int t = 0; t < threads; ++t) {
+        pool.emplace_back([&, t]() {
+            for (int u = 0; u < updates; ++u) add(inputs[t], 1.0 + t);
+        });
+    }
+    for (auto& thread : pool) thread.join();
+}
+
+// mean() while other threads add(): every update is all ones, so every shard
+// of any mean taken in between must be exactly 1 (or 0 before its first add)
+double concurrent_mean_error(Index parameters, int threads, int updates) {
+    ShardedAccumulator accumulator(1024);
+    accumulator.resize(parameters);
+    VectorXd ones = VectorXd::Ones(parameters);
+    std::atomic<bool> adding{true};
+    double worst = 0.0;
+
+    std::thread reader([&]() {
+        VectorXd mean(parameters);
+        do {
+            accumulator.mean(mean.data());
+            for (Index i = 0; i < parameters; ++i) {
+                if (mean(i) != 0.0) worst = std::max(worst, std::abs(mean(i) - 1.0));
+            }
+        } while (adding.load(std::memory_order_acquire));
+    });
+    run_threads(threads, updates, std::vector<VectorXd>(threads, ones),
+                [&](const VectorXd& u, double w) { accumulator.add(u.data(), w); });
+    adding.store(false, std::memory_order_release);
+    reader.join();
+    return worst;
+}
+
+int main(int argc, char** argv) {
+    int parameters = argc > 1 ? std::stoi(argv[1]) : 1 << 20;
+    int threads = argc > 2 ? std::stoi(argv[2]) : 8;
+    int updates = argc > 3 ? std::stoi(argv[3]) : 50;
+
+    std::vector<VectorXd> inputs;
+    for (int t = 0; t < threads; ++t) inputs.push_back(VectorXd::Random(parameters));
+
+    MutexAccumulator locked;
+    locked.sum = VectorXd::Zero(parameters);
+    double t_mutex = seconds([&]() {
+        run_threads(threads, updates, inputs, [&](const VectorXd& u, double w) { locked.add(u, w); });
+    });
+
+    ShardedAccumulator sharded;
+    sharded.resize(parameters);
+    double t_sharded = seconds([&]() {
+        run_threads(threads, updates, inputs, [&](const VectorXd& u, double w) { sharded.add(u.data(), w); });
+    });
+
+    VectorXd mean(parameters);
+    sharded.mean(mean.data());
+    double gb = double(parameters) * sizeof(double) * threads * updates / 1e9;
+
+    std::cout << "[INFO] " << parameters << " parameters, " << threads << " threads x " << updates << " updates ("
+              << std::thread::hardware_concurrency() << " hardware threads)" << std::endl;
+    std::cout << std::setprecision(4);
+    std::cout << "single mutex        : " << t_mutex * 1e3 << " ms, " << gb / t_mutex << " GB/s" << std::endl;
+    std::cout << "sharded (" << sharded.shards() << " shards): " << t_sharded * 1e3 << " ms, " << gb / t_sharded
+              << " GB/s, " << t_mutex / t_sharded << "x" << std::endl;
+    std::cout << "max |mean difference| = "
+              << (mean - locked.sum / locked.total).cwiseAbs().maxCoeff() << std::endl;
+
+    double torn = concurrent_mean_error(std::min(parameters, 1 << 18), threads, updates);
+    std::cout << "max |mean - 1| during concurrent adds = " << torn << std::endl;
+    if (torn > 1e-12) {
+        std::cerr << "[ERROR] mean() observed a partially applied update" << std::endl;
+        return 1;
+    }
+    return 0;
+}
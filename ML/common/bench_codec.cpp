@@ -0,0 +1,168 @@
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+#include <Eigen/Dense>
+#include "update_codec.hpp"
+
+using namespace Eigen;
+// g++ -O3 -march=native -std=c++17 bench_codec.cpp -o bench_codec -I /usr/include/eigen3
+// ./bench_codec [parameters] [rounds]
+//
+// Part 1 encodes one model delta of `parameters` values with every codec and
+// reports bytes on the wire, encode / decode throughput and the relative
+// reconstruction error. Part 2 runs federated linear-SVM training where every
+// client sends its codec-encoded delta to the global model each round, and
+// reports the test accuracy each codec reaches and the bytes it sent.
+
+struct CodecCase {
+    std::string name;
+    CodecOptions options;
+};
+
+std::vector<CodecCase> codec_cases() {
+    auto make = [](UpdateCodec codec, double ratio, bool feedback) {
+        CodecOptions options;
+        options.codec = codec;
+        options.topk_ratio = ratio;
+        options.error_feedback = feedback;
+        return options;
+    };
+    return {
+        {"none", make(UpdateCodec::None, 1.0, false)},
+        {"fp16", make(UpdateCodec::Float16, 1.0, false)},
+        {"int8", make(UpdateCodec::Int8, 1.0, false)},
+        {"topk 10% + EF", make(UpdateCodec::TopK, 0.10, true)},
+        {"topk 1% + EF", make(UpdateCodec::TopK, 0.01, true)},
+        {"topk 1%", make(UpdateCodec::TopK, 0.01, false)},
+    };
+}
+
+template <typename Fn>
+double milliseconds(Fn&& fn, int repeats) {
+    auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r < repeats; ++r) fn();
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / repeats;
+}
+
+void bench_single_delta(Index n) {
+    // Heavy-tailed delta: most coordinates move a little, a few move a lot
+    std::mt19937_64 gen(7);
+    std::normal_distribution<double> normal(0.0, 1e-3);
+    std::student_t_distribution<double> tail(2.0);
+    VectorXd delta(n);
+    for (Index i = 0; i < n; ++i) delta(i) = normal(gen) + 1e-4 * tail(gen);
+
+    std::cout << "[INFO] One delta of " << n << " values (" << n * sizeof(double) / 1024.0 << " KiB raw)" << std::endl;
+    std::cout << std::left << std::setw(16) << "codec" << std::right << std::setw(12) << "bytes" << std::setw(9) << "ratio"
+              << std::setw(14) << "encode MB/s" << std::setw(14) << "decode MB/s" << std::setw(12) << "rel error" << std::endl;
+    for (const auto& c : codec_cases()) {
+        CodecOptions options = c.options;
+        options.error_feedback = false;  // Single shot: show the raw codec error
+        UpdateEncoder encoder(options);
+        asio::const_buffer encoded;
+        double encode_ms = milliseconds([&]() { encoded = encoder.encode(delta); }, 10);
+        std::vector<uint8_t> bytes(static_cast<const uint8_t*>(encoded.data()),
+                                   static_cast<const uint8_t*>(encoded.data()) + encoded.size());
+
+        VectorXd decoded(n);
+        double decode_ms = milliseconds([&]() {
+            decoded.setZero();
+            decode_update_add(options.codec, bytes.data(), bytes.size(), decoded);
+        }, 10);
+
+        double raw_mb = n * sizeof(double) / 1e6;
+        std::string encode_rate = encoded.data() == delta.data() ? "zero-copy" : std::to_string(int(raw_mb / (encode_ms / 1e3)));
+        std::cout << std::left << std::setw(16) << c.name << std::right << std::setw(12) << bytes.size() << std::setw(8)
+                  << std::fixed << std::setprecision(1) << double(n * sizeof(double)) / bytes.size() << "x" << std::setw(14)
+                  << encode_rate << std::setprecision(0) << std::setw(14) << raw_mb / (decode_ms / 1e3)
+                  << std::setw(12) << std::scientific << std::setprecision(2) << (decoded - delta).norm() / delta.norm()
+                  << std::defaultfloat << std::endl;
+    }
+}
+
+struct Shard {
+    MatrixXd X;
+    VectorXd y;
+};
+
+Shard make_shard(const VectorXd& w_true, int rows, std::mt19937_64& gen) {
+    std::normal_distribution<double> normal(0.0, 1.0);
+    Shard shard;
+    shard.X = MatrixXd::NullaryExpr(rows, w_true.size(), [&]() { return normal(gen); });
+    VectorXd margin = shard.X * w_true + 0.5 * VectorXd::NullaryExpr(rows, [&]() { return normal(gen); });
+    shard.y = margin.unaryExpr([](double m) { return m >= 0 ? 1.0 : -1.0; });
+    return shard;
+}
+
+// One local epoch of mini-batch hinge-loss SGD
+void local_epoch(const Shard& shard, VectorXd& w, double learning_rate, double lambda) {
+    const int batch = 50;
+    for (Index first = 0; first < shard.X.rows(); first += batch) {
+        Index rows = std::min<Index>(batch, shard.X.rows() - first);
+        auto X = shard.X.middleRows(first, rows);
+        auto y = shard.y.segment(first, rows);
+        VectorXd coefficients = (y.cwiseProduct(X * w).array() < 1).select(-y, 0.0);
+        w -= learning_rate * (X.transpose() * coefficients / double(rows) + lambda * w);
+    }
+}
+
+double accuracy(const Shard& test, const VectorXd& w) {
+    VectorXd margin = test.y.cwiseProduct(test.X * w);
+    return double((margin.array() > 0).count()) / test.X.rows();
+}
+
+void bench_federated(Index d, int rounds) {
+    const int clients = 8, rows = 1000;
+    std::mt19937_64 gen(11);
+    std::normal_distribution<double> normal(0.0, 1.0);
+    VectorXd w_true = VectorXd::NullaryExpr(d, [&]() { return normal(gen); });
+    std::vector<Shard> shards;
+    for (int c = 0; c < clients; ++c) shards.push_back(make_shard(w_true, rows, gen));
+    Shard test = make_shard(w_true, 4000, gen);
+
+    std::cout << "\n[INFO] Federated linear SVM: " << clients << " clients x " << rows << " rows, " << d
+              << " weights, " << rounds << " rounds of one local epoch" << std::endl;
+    std::cout << std::left << std::setw(16) << "codec" << std::right << std::setw(16) << "bytes / round" << std::setw(14)
+              << "test acc" << std::endl;
+    for (const auto& c : codec_cases()) {
+        std::vector<UpdateEncoder> encoders;
+        for (int k = 0; k < clients; ++k) {
+            CodecOptions options = c.options;
+            options.seed += k;
+            encoders.emplace_back(options);
+        }
+
+        VectorXd global = VectorXd::Zero(d);
+        size_t bytes = 0;
+        for (int round = 0; round < rounds; ++round) {
+            // Server side: global + mean of the decoded deltas
+            VectorXd next = global;
+            for (int k = 0; k < clients; ++k) {
+                VectorXd w = global;
+                local_epoch(shards[k], w, 0.05, 1e-4);
+                VectorXd delta = w - global;
+                asio::const_buffer encoded = encoders[k].encode(delta);
+                bytes += encoded.size() + sizeof(FrameHeader);
+                decode_update_add(c.options.codec, static_cast<const uint8_t*>(encoded.data()), encoded.size(), next,
+                                  1.0 / clients);
+            }
+            global = next;
+        }
+        std::cout << std::left << std::setw(16) << c.name << std::right << std::setw(16) << bytes / rounds
+                  << std::setw(13) << std::fixed << std::setprecision(2) << 100.0 * accuracy(test, global) << "%"
+                  << std::defaultfloat << std::endl;
+    }
+}
+
+int main(int argc, char** argv) {
+    Index parameters = argc > 1 ? std::stol(argv[1]) : 200000;
+    int rounds = argc > 2 ? std::stoi(argv[2]) : 30;
+
+    bench_single_delta(parameters);
+    bench_federated(500, rounds);
+    return 0;
+}
@@ -0,0 +1,123 @@
+
+#include <iostream>
+#include <iomanip>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <new>
+#include <random>
+#include <thread>
+#include <Eigen/Dense>
+#include "linear_core.hpp"
+
+using namespace Eigen;
+// g++ -O3 -march=native -std=c++17 bench_linear.cpp -o bench_linear -I /usr/include/eigen3 -lpthread
+// ./bench_linear [rows] [features] [passes]
+//
+// Computes full-pass gradients of the three linear losses with the original
+// per-row loops (copied row, scalar dot product) and with LinearCore in float64
+// and float32, streamed and resident, on one thread and on a pool. Reports time
+// per pass, the relative difference to the original gradient, and heap
+// allocations per pass after the first.
+
+std::atomic<size_t> allocations{0};
+
+void* operator new(size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+
+// The original client loops
+VectorXd row_loop_gradient(LinearLoss loss, DataSource& source, const VectorXd& weights) {
+    VectorXd gradient = VectorXd::Zero(source.cols());
+    Batch batch;
+    source.reset();
+    while (source.next_batch(batch)) {
+        for (int i = 0; i < batch.rows; ++i) {
+            VectorXd xi = batch.features.row(i);
+            double yi = batch.labels(i);
+            switch (loss) {
+            case LinearLoss::Squared:
+                gradient += -2 * xi * (yi - xi.dot(weights));
+                break;
+            case LinearLoss::Logistic:
+                gradient += xi * (1.0 / (1.0 + std::exp(-xi.dot(weights))) - yi);
+                break;
+            case LinearLoss::Hinge:
+                if (yi * (xi.dot(weights)) < 1) gradient += -yi * xi;
+                break;
+            }
+        }
+    }
+    return gradient;
+}
+
+template <typename Fn>
+double seconds(Fn&& fn) {
+    auto start = std::chrono::steady_clock::now();
+    fn();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char** argv) {
+    Index rows = argc > 1 ? std::stol(argv[1]) : 500000;
+    Index features = argc > 2 ? std::stol(argv[2]) : 64;
+    int passes = argc > 3 ? std::stoi(argv[3]) : 5;
+
+    std::mt19937_64 rng(21);
+    std::normal_distribution<double> normal(0.0, 1.0);
+    MatrixXd X = MatrixXd::NullaryExpr(rows, features, [&]() { return normal(rng); });
+    VectorXd w_true = VectorXd::NullaryExpr(features, [&]() { return normal(rng); });
+    VectorXd z = X * w_true;
+    VectorXd weights = VectorXd::NullaryExpr(features, [&]() { return 0.1 * normal(rng); });
+    ThreadPool pool;
+
+    std::cout << "[INFO] " << rows << " rows x " << features << " features, " << passes << " passes ("
+              << std::thread::hardware_concurrency() << " hardware threads)" << std::endl;
+    std::cout << std::fixed;
+    for (LinearLoss loss : {LinearLoss::Squared, LinearLoss::Logistic, LinearLoss::Hinge}) {
+        VectorXd y(rows);
+        for (Index i = 0; i < rows; ++i) {
+            double noisy = z(i) + normal(rng);
+            y(i) = loss == LinearLoss::Squared ? noisy : loss == LinearLoss::Logistic ? (noisy > 0) : (noisy > 0 ? 1 : -1);
+        }
+        MatrixDataSource source(X, y, 4096);
+        const char* name = loss == LinearLoss::Squared ? "squared" : loss == LinearLoss::Logistic ? "logistic" : "hinge";
+
+        VectorXd expected;
+        double loop = seconds([&]() { expected = row_loop_gradient(loss, source, weights); });
+        std::cout << "\n  " << name << "\n" << std::setw(28) << "per-row loop" << std::setprecision(4) << std::setw(10)
+                  << loop << " s/pass" << std::endl;
+
+        for (Precision precision : {Precision::Float64, Precision::Float32}) {
+            for (bool resident : {false, true}) {
+                for (ThreadPool* threads : {(ThreadPool*)nullptr, &pool}) {
+                    LinearCoreOptions options;
+                    options.precision = precision;
+                    options.pool = threads;
+                    options.cache_bytes = resident ? options.cache_bytes : 0;
+                    std::unique_ptr<LinearCore> core = make_linear_core(loss, source, options);
+                    VectorXd gradient = core->gradient(weights);  // Sizes buffers, loads a resident shard
+
+                    size_t before = allocations.load();
+                    double t = seconds([&]() {
+                        for (int p = 0; p < passes; ++p) core->gradient(weights);
+                    }) / passes;
+                    double allocs = double(allocations.load() - before) / passes;
+
+                    std::cout << std::setw(8) << (precision == Precision::Float64 ? "f64" : "f32") << std::setw(10)
+                              << (resident ? "resident" : "streamed") << std::setw(10) << (threads ? "pool" : "1 thread")
+                              << std::setw(10) << t << " s/pass   speedup " << std::setprecision(1) << std::setw(6)
+                              << loop / t << "x   rel diff " << std::scientific << std::setprecision(1)
+                              << (gradient - expected).norm() / expected.norm() << std::fixed << "   allocs/pass "
+                              << allocs << std::setprecision(4) << std::endl;
+                }
+            }
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,275 @@
+#pragma once
+
+// Binary columnar dataset cache.
+//
+// Layout (all little-endian, blocks 64-byte aligned):
+//   BinaryDatasetHeader
+//   features : rows x cols, column-major, float32 or float64
+//   labels   : rows x int8
+//
+// The CSV loader writes this file once; later runs mmap it and hand the
+// feature block to Eigen as a Map, so start-up costs page faults instead of
+// parsing.
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <sys/stat.h>
+#include <Eigen/Dense>
+#include "csv_loader.hpp"
+
+enum class DatasetDtype : uint8_t { Float32 = 1, Float64 = 2 };
+
+template <typename Scalar> struct DatasetDtypeOf;
+template <> struct DatasetDtypeOf<float> { static constexpr DatasetDtype value = DatasetDtype::Float32; };
+template <> struct DatasetDtypeOf<double> { static constexpr DatasetDtype value = DatasetDtype::Float64; };
+
+struct BinaryDatasetHeader {
+    char magic[8];             // "FEDCOLS\0"
+    uint32_t version;
+    uint8_t dtype;             // DatasetDtype of the feature block
+    uint8_t label_dtype;       // Always 1 (int8) for now
+    uint16_t reserved;
+    int32_t label_column;      // Column the labels came from in the source CSV
+    uint32_t header_size;
+    uint64_t rows;
+    uint64_t cols;
+    uint64_t features_offset;
+    uint64_t labels_offset;
+    uint64_t source_size;      // Size and mtime of the CSV the cache was built from
+    int64_t source_mtime;
+    uint64_t checksum;         // Hash of the feature and label blocks
+};
+
+constexpr char BINARY_DATASET_MAGIC[8] = {'F', 'E', 'D', 'C', 'O', 'L', 'S', '\0'};
+constexpr uint32_t BINARY_DATASET_VERSION = 1;
+
+namespace binary_dataset_detail {
+
+inline uint64_t align64(uint64_t offset) { return (offset + 63) & ~uint64_t(63); }
+
+// FNV-1a style hash over 8-byte words, continued from seed
+inline uint64_t hash_bytes(const void* data, size_t size, uint64_t seed = 0xcbf29ce484222325ULL) {
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    uint64_t h = seed;
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        uint64_t word;
+        std::memcpy(&word, p + i, 8);
+        h = (h ^ word) * 0x100000001b3ULL;
+    }
+    for (; i < size; ++i) {
+        h = (h ^ p[i]) * 0x100000001b3ULL;
+    }
+    return h;
+}
+
+inline void write_all(std::FILE* file, const void* data, size_t size, const std::string& path) {
+    if (size && std::fwrite(data, 1, size, file) != size) {
+        std::fclose(file);
+        std::remove(path.c_str());
+        throw std::runtime_error("Short write to " + path);
+    }
+}
+
+inline void pad_to(std::FILE* file, uint64_t& position, uint64_t target, const std::string& path) {
+    static const char zeros[64] = {};
+    write_all(file, zeros, target - position, path);
+    position = target;
+}
+
+}  // namespace binary_dataset_detail
+
+// Function to write features and labels as a binary columnar cache file
+template <typename Scalar>
+void write_binary_dataset(const std::string& path,
+                          const Eigen::Ref<const Eigen::Matrix<Scalar, Eigen::Dynamic, Eigen::Dynamic>>& features,
+                          const Eigen::Ref<const Eigen::Matrix<Scalar, Eigen::Dynamic, 1>>& labels,
+                          int label_column = 1, uint64_t source_size = 0, int64_t source_mtime = 0) {
+    using namespace binary_dataset_detail;
+
+    if (labels.size() != features.rows()) {
+        throw std::runtime_error("Label count does not match feature rows");
+    }
+
+    std::vector<int8_t> label_block(labels.size());
+    for (Eigen::Index i = 0; i < labels.size(); ++i) {
+        if (labels(i) < -128 || labels(i) > 127 || labels(i) != static_cast<int8_t>(labels(i))) {
+            throw std::runtime_error("Label at row " + std::to_string(i) + " does not fit in int8");
+        }
+        label_block[i] = static_cast<int8_t>(labels(i));
+    }
+
+    BinaryDatasetHeader header = {};
+    std::memcpy(header.magic, BINARY_DATASET_MAGIC, sizeof(header.magic));
+    header.version = BINARY_DATASET_VERSION;
+    header.dtype = static_cast<uint8_t>(DatasetDtypeOf<Scalar>::value);
+    header.label_dtype = 1;
+    header.label_column = label_column;
+    header.header_size = sizeof(BinaryDatasetHeader);
+    header.rows = features.rows();
+    header.cols = features.cols();
+    header.features_offset = align64(sizeof(BinaryDatasetHeader));
+    header.labels_offset = align64(header.features_offset + header.rows * header.cols * sizeof(Scalar));
+    header.source_size = source_size;
+    header.source_mtime = source_mtime;
+
+    // Ref may carry an outer stride, so hash and write column by column
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (Eigen::Index c = 0; c < features.cols(); ++c) {
+        h = hash_bytes(features.col(c).data(), features.rows() * sizeof(Scalar), h);
+    }
+    header.checksum = hash_bytes(label_block.data(), label_block.size(), h);
+
+    // Write to a temporary file and rename, so a crash never leaves a torn cache
+    std::string tmp_path = path + ".tmp";
+    std::FILE* file = std::fopen(tmp_path.c_str(), "wb");
+    if (!file) {
+        throw std::runtime_error("Could not create file: " + tmp_path);
+    }
+
+    uint64_t position = 0;
+    write_all(file, &header, sizeof(header), tmp_path);
+    position += sizeof(header);
+    pad_to(file, position, header.features_offset, tmp_path);
+    for (Eigen::Index c = 0; c < features.cols(); ++c) {
+        write_all(file, features.col(c).data(), features.rows() * sizeof(Scalar), tmp_path);
+        position += features.rows() * sizeof(Scalar);
+    }
+    pad_to(file, position, header.labels_offset, tmp_path);
+    write_all(file, label_block.data(), label_block.size(), tmp_path);
+
+    if (std::fclose(file) != 0 || std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+        std::remove(tmp_path.c_str());
+        throw std::runtime_error("Could not finalise file: " + path);
+    }
+}
+
+inline size_t dataset_element_size(const BinaryDatasetHeader& header) {
+    return header.dtype == static_cast<uint8_t>(DatasetDtype::Float32) ? sizeof(float) : sizeof(double);
+}
+
+// Function to validate a header against the size of the file it was read from
+inline void check_dataset_header(const BinaryDatasetHeader& header, uint64_t file_size, const std::string& path) {
+    if (std::memcmp(header.magic, BINARY_DATASET_MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != BINARY_DATASET_VERSION ||
+        header.header_size != sizeof(BinaryDatasetHeader)) {
+        throw std::runtime_error("Not a version " + std::to_string(BINARY_DATASET_VERSION) +
+                                 " dataset file: " + path);
+    }
+    if (header.dtype != static_cast<uint8_t>(DatasetDtype::Float32) &&
+        header.dtype != static_cast<uint8_t>(DatasetDtype::Float64)) {
+        throw std::runtime_error("Unknown feature dtype in " + path);
+    }
+
+    // Every field is untrusted: a product or sum that wraps around could
+    // otherwise pass the bounds checks and map past the end of the file
+    uint64_t feature_values, feature_bytes, features_end, labels_end;
+    if (__builtin_mul_overflow(header.rows, header.cols, &feature_values) ||
+        __builtin_mul_overflow(feature_values, uint64_t(dataset_element_size(header)), &feature_bytes) ||
+        __builtin_add_overflow(header.features_offset, feature_bytes, &features_end) ||
+        __builtin_add_overflow(header.labels_offset, header.rows, &labels_end) ||
+        header.cols > uint64_t(std::numeric_limits<Eigen::Index>::max())) {
+        throw std::runtime_error("Corrupt dataset header (sizes overflow): " + path);
+    }
+    if (header.features_offset % 64 != 0 ||
+        features_end > header.labels_offset ||
+        labels_end > file_size) {
+        throw std::runtime_error("Truncated or corrupt dataset file: " + path);
+    }
+}
+
+// A binary dataset file mapped into memory
+class MappedDataset {
+public:
+    using LabelVector = Eigen::Matrix<int8_t, Eigen::Dynamic, 1>;
+
+    explicit MappedDataset(const std::string& path, bool verify_checksum = false)
+        : file_(std::make_unique<MappedFile>(path)) {
+        if (file_->size() < sizeof(BinaryDatasetHeader)) {
+            throw std::runtime_error("File too small for a dataset header: " + path);
+        }
+        std::memcpy(&header_, file_->data(), sizeof(header_));
+
+        check_dataset_header(header_, file_->size(), path);
+
+        if (verify_checksum && compute_checksum() != header_.checksum) {
+            throw std::runtime_error("Checksum mismatch in dataset file: " + path);
+        }
+    }
+
+    const BinaryDatasetHeader& header() const { return header_; }
+    Eigen::Index rows() const { return static_cast<Eigen::Index>(header_.rows); }
+    Eigen::Index cols() const { return static_cast<Eigen::Index>(header_.cols); }
+    DatasetDtype dtype() const { return static_cast<DatasetDtype>(header_.dtype); }
+
+    // Zero-copy view of the feature block; Scalar must match the stored dtype
+    template <typename Scalar>
+    Eigen::Map<const Eigen::Matrix<Scalar, Eigen::Dynamic, Eigen::Dynamic>> features() const {
+        if (dtype() != DatasetDtypeOf<Scalar>::value) {
+            throw std::runtime_error("Requested feature dtype does not match the dataset file");
+        }
+        return {reinterpret_cast<const Scalar*>(file_->data() + header_.features_offset), rows(), cols()};
+    }
+
+    Eigen::Map<const LabelVector> labels() const {
+        return {reinterpret_cast<const int8_t*>(file_->data() + header_.labels_offset), rows()};
+    }
+
+    uint64_t compute_checksum() const {
+        using binary_dataset_detail::hash_bytes;
+        uint64_t h = hash_bytes(file_->data() + header_.features_offset,
+                                header_.rows * header_.cols * element_size());
+        return hash_bytes(file_->data() + header_.labels_offset, header_.rows, h);
+    }
+
+private:
+    size_t element_size() const { return dataset_element_size(header_); }
+
+    std::unique_ptr<MappedFile> file_;
+    BinaryDatasetHeader header_;
+};
+
+// Map cache_path if it was built from the current csv_path with the requested
+// dtype; otherwise parse the CSV, (re)write the cache and map that instead
+template <typename Scalar>
+MappedDataset load_or_build_cache(const std::string& csv_path, const std::string& cache_path,
+                                  const CsvOptions& options = {}) {
+    struct stat csv_stat;
+    bool have_csv = ::stat(csv_path.c_str(), &csv_stat) == 0;
+    uint64_t source_size = have_csv ? static_cast<uint64_t>(csv_stat.st_size) : 0;
+    int64_t source_mtime = have_csv ? static_cast<int64_t>(csv_stat.st_mtime) : 0;
+
+    struct stat cache_stat;
+    if (::stat(cache_path.c_str(), &cache_stat) == 0) {
+        try {
+            MappedDataset cached(cache_path);
+            const BinaryDatasetHeader& h = cached.header();
+            bool fresh = !have_csv || (h.source_size == source_size && h.source_mtime == source_mtime);
+            if (fresh && cached.dtype() == DatasetDtypeOf<Scalar>::value &&
+                h.label_column == options.label_column) {
+                std::cout << "[INFO] Mapped cached dataset " << cache_path << " (" << cached.rows()
+                          << " x " << cached.cols() << ")" << std::endl;
+                return cached;
+            }
+            std::cout << "[INFO] Dataset cache " << cache_path << " is stale, rebuilding." << std::endl;
+        } catch (const std::exception& e) {
+            std::cerr << "[ERROR] Ignoring unreadable dataset cache: " << e.what() << std::endl;
+        }
+    }
+
+    if (!have_csv) {
+        throw std::runtime_error("Neither " + csv_path + " nor a usable " + cache_path + " exists");
+    }
+
+    CsvDataset<Scalar> dataset = load_csv_mmap<Scalar>(csv_path, options);
+    write_binary_dataset<Scalar>(cache_path, dataset.matrix(), dataset.label_vector(),
+                                 options.label_column, source_size, source_mtime);
+    std::cout << "[INFO] Wrote dataset cache " << cache_path << std::endl;
+    return MappedDataset(cache_path);
+}
@@ -0,0 +1,251 @@
+#pragma once
+
+// Memory-mapped, multithreaded CSV loader.
+//
+// The file is mapped read-only, the body is cut into newline-aligned chunks
+// and every chunk is parsed on its own thread with std::from_chars. Values are
+// written straight into one contiguous column-major buffer, so the result can
+// be handed to Eigen through a Map without a second copy.
+
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <exception>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <Eigen/Dense>
+#include "perf_counters.hpp"
+#include "trace.hpp"
+
+// Read-only memory mapping of a whole file (RAII)
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& filename) {
+        int fd = ::open(filename.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw std::runtime_error("Could not open file: " + filename);
+        }
+
+        struct stat st;
+        if (::fstat(fd, &st) != 0) {
+            ::close(fd);
+            throw std::runtime_error("Could not stat file: " + filename);
+        }
+        size_ = static_cast<size_t>(st.st_size);
+
+        if (size_ > 0) {
+            void* addr = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (addr == MAP_FAILED) {
+                ::close(fd);
+                throw std::runtime_error("Could not mmap file: " + filename);
+            }
+            data_ = static_cast<const char*>(addr);
+            // Advice values are not flags; each needs its own call
+            ::madvise(addr, size_, MADV_SEQUENTIAL);
+            ::madvise(addr, size_, MADV_WILLNEED);
+        }
+        ::close(fd);  // The mapping stays valid after the descriptor is closed
+    }
+
+    ~MappedFile() {
+        if (data_) ::munmap(const_cast<char*>(data_), size_);
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const char* data() const { return data_; }
+    size_t size() const { return size_; }
+
+private:
+    const char* data_ = nullptr;
+    size_t size_ = 0;
+};
+
+// Column layout of the input file
+struct CsvOptions {
+    int label_column = 1;          // 'target' in train.csv
+    int first_feature_column = 2;  // var_0 .. var_N follow the label
+    unsigned num_threads = 0;      // 0 = std::thread::hardware_concurrency()
+};
+
+// Parsed dataset: features are column-major (rows x cols), labels one per row
+template <typename Scalar>
+struct CsvDataset {
+    using Matrix = Eigen::Matrix<Scalar, Eigen::Dynamic, Eigen::Dynamic>;
+    using Vector = Eigen::Matrix<Scalar, Eigen::Dynamic, 1>;
+
+    Eigen::Index rows = 0;
+    Eigen::Index cols = 0;
+    std::unique_ptr<Scalar[]> features;
+    std::unique_ptr<Scalar[]> labels;
+
+    Eigen::Map<const Matrix> matrix() const { return {features.get(), rows, cols}; }
+    Eigen::Map<const Vector> label_vector() const { return {labels.get(), rows}; }
+};
+
+namespace csv_detail {
+
+// End of the line starting at p (position of '\n' or end of buffer)
+inline const char* line_end(const char* p, const char* end) {
+    const void* nl = std::memchr(p, '\n', end - p);
+    return nl ? static_cast<const char*>(nl) : end;
+}
+
+// Strip a trailing '\r' so files written on Windows parse the same way
+inline const char* trim_cr(const char* begin, const char* end) {
+    return (end > begin && end[-1] == '\r') ? end - 1 : end;
+}
+
+// Count the non-empty lines in [begin, end)
+inline size_t count_rows(const char* begin, const char* end) {
+    size_t count = 0;
+    for (const char* p = begin; p < end;) {
+        const char* eol = line_end(p, end);
+        if (trim_cr(p, eol) != p) count++;
+        p = eol + 1;
+    }
+    return count;
+}
+
+template <typename T>
+inline const char* parse_field(const char* p, const char* end, T& value, size_t row, int column) {
+    while (p < end && *p == ' ') ++p;
+    if (p < end && *p == '+') ++p;  // std::from_chars rejects a leading '+'
+    auto result = std::from_chars(p, end, value);
+    if (result.ec != std::errc()) {
+        throw std::runtime_error("Malformed value at data row " + std::to_string(row) +
+                                 ", column " + std::to_string(column));
+    }
+    return result.ptr;
+}
+
+// Parse one data line [p, stop). The label goes to `label` and feature k to
+// features[k * stride], which lets callers fill a column-major block in place
+template <typename Scalar>
+inline void parse_row(const char* p, const char* stop, int total_columns, const CsvOptions& options,
+                      size_t row, Scalar& label, Scalar* features, size_t stride) {
+    int column = 0;
+    for (const char* field = p; column < total_columns; ++column) {
+        if (column == options.label_column) {
+            field = parse_field(field, stop, label, row, column);
+        } else if (column >= options.first_feature_column) {
+            Scalar value;
+            field = parse_field(field, stop, value, row, column);
+            features[(column - options.first_feature_column) * stride] = value;
+        } else {
+            const void* comma = std::memchr(field, ',', stop - field);
+            field = comma ? static_cast<const char*>(comma) : stop;
+        }
+
+        if (column + 1 < total_columns) {
+            if (field >= stop || *field != ',') {
+                throw std::runtime_error("Expected " + std::to_string(total_columns) +
+                                         " columns at data row " + std::to_string(row));
+            }
+            ++field;
+        }
+    }
+}
+
+}  // namespace csv_detail
+
+// Function to load features and labels from a CSV file via mmap
+template <typename Scalar>
+CsvDataset<Scalar> load_csv_mmap(const std::string& filename, const CsvOptions& options = {}) {
+    using namespace csv_detail;
+    TRACE_SCOPE("load_csv");
+    PERF_SCOPE("load_csv");
+
+    MappedFile file(filename);
+    const char* begin = file.data();
+    const char* end = begin + file.size();
+    if (file.size() == 0) {
+        throw std::runtime_error("Empty file: " + filename);
+    }
+
+    // The header line tells us how many columns each row has
+    const char* header_end = line_end(begin, end);
+    int total_columns = 1 + static_cast<int>(std::count(begin, trim_cr(begin, header_end), ','));
+    if (options.first_feature_column >= total_columns || options.label_column >= total_columns) {
+        throw std::runtime_error("Header of " + filename + " has too few columns");
+    }
+
+    CsvDataset<Scalar> dataset;
+    dataset.cols = total_columns - options.first_feature_column;
+    const char* body = std::min(header_end + 1, end);
+
+    // Cut the body into newline-aligned chunks, a few per thread to balance load
+    unsigned num_threads = options.num_threads ? options.num_threads
+                                               : std::max(1u, std::thread::hardware_concurrency());
+    size_t num_chunks = std::max<size_t>(1, std::min<size_t>(num_threads * 4, (end - body) / (1 << 16) + 1));
+    std::vector<const char*> bounds(num_chunks + 1, end);
+    bounds[0] = body;
+    for (size_t c = 1; c < num_chunks; ++c) {
+        const char* guess = body + (end - body) * c / num_chunks;
+        guess = std::max(guess, bounds[c - 1]);
+        bounds[c] = std::min(line_end(guess, end) + 1, end);
+    }
+
+    // Runs fn(chunk) for every chunk on num_threads workers, rethrowing the first error
+    auto parallel_chunks = [&](auto&& fn) {
+        std::vector<std::exception_ptr> errors(num_threads);
+        std::vector<std::thread> workers;
+        for (unsigned t = 0; t < num_threads; ++t) {
+            workers.emplace_back([&, t]() {
+                try {
+                    for (size_t c = t; c < num_chunks; c += num_threads) fn(c);
+                } catch (...) {
+                    errors[t] = std::current_exception();
+                }
+            });
+        }
+        for (auto& worker : workers) worker.join();
+        for (auto& error : errors) {
+            if (error) std::rethrow_exception(error);
+        }
+    };
+
+    // Pass 1: count rows per chunk so every chunk knows its first output row
+    std::vector<size_t> first_row(num_chunks + 1, 0);
+    parallel_chunks([&](size_t c) { first_row[c + 1] = count_rows(bounds[c], bounds[c + 1]); });
+    for (size_t c = 0; c < num_chunks; ++c) first_row[c + 1] += first_row[c];
+
+    dataset.rows = static_cast<Eigen::Index>(first_row[num_chunks]);
+    if (dataset.rows == 0) {
+        throw std::runtime_error("No data rows in file: " + filename);
+    }
+    // Left uninitialised on purpose: every element is written exactly once below
+    dataset.features.reset(new Scalar[dataset.rows * dataset.cols]);
+    dataset.labels.reset(new Scalar[dataset.rows]);
+
+    // Pass 2: parse each chunk straight into the column-major buffer
+    const size_t n_rows = dataset.rows;
+    Scalar* features = dataset.features.get();
+    Scalar* labels = dataset.labels.get();
+
+    parallel_chunks([&](size_t c) {
+        size_t row = first_row[c];
+        for (const char* p = bounds[c]; p < bounds[c + 1];) {
+            const char* eol = line_end(p, bounds[c + 1]);
+            const char* stop = trim_cr(p, eol);
+            if (stop == p) {
+                p = eol + 1;
+                continue;
+            }
+
+            parse_row(p, stop, total_columns, options, row, labels[row], features + row, n_rows);
+            row++;
+            p = eol + 1;
+        }
+    });
+
+    return dataset;
+}
@@ -0,0 +1,440 @@
+#pragma once
+
+// Streaming data sources.
+//
+// A DataSource hands out fixed-size row batches so trainers never need the
+// whole shard in memory. Peak memory is O(batch_size * cols) per buffered
+// batch, whether the rows come from an in-memory matrix, a CSV file read
+// through a fixed buffer, or a binary dataset file read with pread().
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <Eigen/Dense>
+#include "binary_dataset.hpp"
+#include "trace.hpp"
+
+// A batch of rows. Buffers keep their capacity between batches; only the
+// first `rows` rows are valid
+struct Batch {
+    Eigen::MatrixXd features;
+    Eigen::VectorXd labels;
+    Eigen::Index rows = 0;
+    Eigen::Index first_row = 0;  // Index of the first row within the source
+
+    auto X() const { return features.topRows(rows); }
+    auto y() const { return labels.head(rows); }
+
+    void reserve(Eigen::Index capacity, Eigen::Index cols) {
+        if (features.rows() != capacity || features.cols() != cols) features.resize(capacity, cols);
+        if (labels.size() != capacity) labels.resize(capacity);
+    }
+};
+
+class DataSource {
+public:
+    virtual ~DataSource() = default;
+
+    virtual Eigen::Index rows() const = 0;
+    virtual Eigen::Index cols() const = 0;
+    virtual Eigen::Index batch_size() const = 0;
+
+    // Position the source so the next batch starts at `row`
+    virtual void seek(Eigen::Index row) = 0;
+    void reset() { seek(0); }
+
+    // Fill `batch` with up to batch_size() rows; false once the data is exhausted
+    virtual bool next_batch(Batch& batch) = 0;
+};
+
+// Rows of a matrix that is already resident (e.g. the toy data or an mmap'd cache)
+class MatrixDataSource : public DataSource {
+public:
+    MatrixDataSource(const Eigen::Ref<const Eigen::MatrixXd>& data, const Eigen::Ref<const Eigen::VectorXd>& labels,
+                     Eigen::Index batch_size)
+        : data_(data), labels_(labels), batch_size_(std::max<Eigen::Index>(1, batch_size)) {
+        if (data_.rows() != labels_.size()) {
+            throw std::runtime_error("Label count does not match feature rows");
+        }
+    }
+
+    Eigen::Index rows() const override { return data_.rows(); }
+    Eigen::Index cols() const override { return data_.cols(); }
+    Eigen::Index batch_size() const override { return batch_size_; }
+    void seek(Eigen::Index row) override { position_ = std::min(row, rows()); }
+
+    bool next_batch(Batch& batch) override {
+        if (position_ >= rows()) return false;
+        Eigen::Index n = std::min(batch_size_, rows() - position_);
+        batch.reserve(batch_size_, cols());
+        batch.features.topRows(n) = data_.middleRows(position_, n);
+        batch.labels.head(n) = labels_.segment(position_, n);
+        batch.rows = n;
+        batch.first_row = position_;
+        position_ += n;
+        return true;
+    }
+
+private:
+    Eigen::Ref<const Eigen::MatrixXd> data_;
+    Eigen::Ref<const Eigen::VectorXd> labels_;
+    Eigen::Index batch_size_;
+    Eigen::Index position_ = 0;
+};
+
+// Rows parsed from a CSV file through a fixed-size read buffer
+class CsvDataSource : public DataSource {
+public:
+    CsvDataSource(const std::string& filename, Eigen::Index batch_size, const CsvOptions& options = {},
+                  size_t buffer_size = 1 << 20)
+        : filename_(filename), options_(options), batch_size_(std::max<Eigen::Index>(1, batch_size)),
+          buffer_(std::max<size_t>(buffer_size, 4096)) {
+        fd_ = ::open(filename.c_str(), O_RDONLY);
+        if (fd_ < 0) {
+            throw std::runtime_error("Could not open file: " + filename);
+        }
+        ::posix_fadvise(fd_, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+        try {
+            // The header fixes the column count; one counting pass fixes the row count
+            const char* line;
+            const char* stop;
+            if (!read_line(line, stop)) {
+                throw std::runtime_error("Empty file: " + filename);
+            }
+            total_columns_ = 1 + static_cast<int>(std::count(line, stop, ','));
+            if (options_.first_feature_column >= total_columns_ || options_.label_column >= total_columns_) {
+                throw std::runtime_error("Header of " + filename + " has too few columns");
+            }
+            data_offset_ = file_offset_ - (end_ - cursor_);
+
+            while (read_line(line, stop)) rows_++;
+            seek(0);
+        } catch (...) {
+            ::close(fd_);
+            throw;
+        }
+    }
+
+    ~CsvDataSource() override {
+        if (fd_ >= 0) ::close(fd_);
+    }
+
+    CsvDataSource(const CsvDataSource&) = delete;
+    CsvDataSource& operator=(const CsvDataSource&) = delete;
+
+    Eigen::Index rows() const override { return rows_; }
+    Eigen::Index cols() const override { return total_columns_ - options_.first_feature_column; }
+    Eigen::Index batch_size() const override { return batch_size_; }
+
+    void seek(Eigen::Index row) override {
+        row = std::min(row, rows_);
+        if (row < position_ || position_ < 0) {
+            rewind();
+        }
+        const char* line;
+        const char* stop;
+        while (position_ < row && read_line(line, stop)) position_++;
+    }
+
+    bool next_batch(Batch& batch) override {
+        if (position_ >= rows_) return false;
+        TRACE_SCOPE("parse_batch");
+        batch.reserve(batch_size_, cols());
+
+        Eigen::Index n = 0;
+        const char* line;
+        const char* stop;
+        while (n < batch_size_ && read_line(line, stop)) {
+            csv_detail::parse_row(line, stop, total_columns_, options_, position_ + n, batch.labels(n),
+                                  batch.features.data() + n, static_cast<size_t>(batch_size_));
+            n++;
+        }
+        batch.rows = n;
+        batch.first_row = position_;
+        position_ += n;
+        return n > 0;
+    }
+
+private:
+    void rewind() {
+        cursor_ = end_ = buffer_.data();
+        file_offset_ = data_offset_;
+        position_ = 0;
+    }
+
+    // Next non-empty line as [line, stop), refilling the buffer as needed
+    bool read_line(const char*& line, const char*& stop) {
+        while (true) {
+            const char* nl = static_cast<const char*>(std::memchr(cursor_, '\n', end_ - cursor_));
+            if (!nl && !eof_at_end()) {
+                refill();
+                continue;
+            }
+            const char* eol = nl ? nl : end_;
+            if (eol == cursor_ && !nl) return false;  // Nothing left at all
+
+            line = cursor_;
+            stop = csv_detail::trim_cr(cursor_, eol);
+            cursor_ = nl ? nl + 1 : end_;
+            if (stop != line) return true;
+        }
+    }
+
+    bool eof_at_end() const { return at_eof_ && file_offset_ >= file_size_; }
+
+    // Move the partial line to the front and read more bytes behind it
+    void refill() {
+        size_t start = cursor_ - buffer_.data();
+        size_t carry = end_ - cursor_;
+        if (carry == buffer_.size()) {
+            buffer_.resize(buffer_.size() * 2);  // A single line longer than the buffer
+        }
+        std::memmove(buffer_.data(), buffer_.data() + start, carry);
+        ssize_t got = ::pread(fd_, buffer_.data() + carry, buffer_.size() - carry, file_offset_);
+        if (got < 0) {
+            throw std::runtime_error("Read error on " + filename_);
+        }
+        file_offset_ += got;
+        cursor_ = buffer_.data();
+        end_ = buffer_.data() + carry + got;
+        if (got == 0) {
+            at_eof_ = true;
+            file_size_ = file_offset_;
+        }
+    }
+
+    std::string filename_;
+    CsvOptions options_;
+    Eigen::Index batch_size_;
+    std::vector<char> buffer_;
+    const char* cursor_ = buffer_.data();
+    const char* end_ = buffer_.data();
+    int fd_ = -1;
+    int total_columns_ = 0;
+    off_t data_offset_ = 0;
+    off_t file_offset_ = 0;
+    off_t file_size_ = 0;
+    bool at_eof_ = false;
+    Eigen::Index rows_ = 0;
+    Eigen::Index position_ = -1;
+};
+
+// Rows read with pread() from a binary columnar dataset file
+class BinaryDataSource : public DataSource {
+public:
+    BinaryDataSource(const std::string& filename, Eigen::Index batch_size)
+        : filename_(filename), batch_size_(std::max<Eigen::Index>(1, batch_size)) {
+        fd_ = ::open(filename.c_str(), O_RDONLY);
+        if (fd_ < 0) {
+            throw std::runtime_error("Could not open file: " + filename);
+        }
+        off_t file_size = ::lseek(fd_, 0, SEEK_END);
+        if (::pread(fd_, &header_, sizeof(header_), 0) != static_cast<ssize_t>(sizeof(header_))) {
+            ::close(fd_);
+            throw std::runtime_error("File too small for a dataset header: " + filename);
+        }
+        try {
+            check_dataset_header(header_, static_cast<uint64_t>(file_size), filename);
+        } catch (...) {
+            ::close(fd_);
+            throw;
+        }
+        element_size_ = dataset_element_size(header_);
+        scratch_.resize(batch_size_ * element_size_);
+    }
+
+    ~BinaryDataSource() override {
+        if (fd_ >= 0) ::close(fd_);
+    }
+
+    BinaryDataSource(const BinaryDataSource&) = delete;
+    BinaryDataSource& operator=(const BinaryDataSource&) = delete;
+
+    Eigen::Index rows() const override { return static_cast<Eigen::Index>(header_.rows); }
+    Eigen::Index cols() const override { return static_cast<Eigen::Index>(header_.cols); }
+    Eigen::Index batch_size() const override { return batch_size_; }
+    void seek(Eigen::Index row) override { position_ = std::min(row, rows()); }
+
+    bool next_batch(Batch& batch) override {
+        if (position_ >= rows()) return false;
+        TRACE_SCOPE("read_batch");
+        Eigen::Index n = std::min(batch_size_, rows() - position_);
+        batch.reserve(batch_size_, cols());
+
+        // One contiguous read per column of the batch
+        for (Eigen::Index c = 0; c < cols(); ++c) {
+            uint64_t offset = header_.features_offset + (c * header_.rows + position_) * element_size_;
+            if (header_.dtype == static_cast<uint8_t>(DatasetDtype::Float64)) {
+                read_exact(batch.features.col(c).data(), n * sizeof(double), offset);
+            } else {
+                read_exact(scratch_.data(), n * sizeof(float), offset);
+                batch.features.col(c).head(n) =
+                    Eigen::Map<const Eigen::VectorXf>(reinterpret_cast<const float*>(scratch_.data()), n).cast<double>();
+            }
+        }
+        read_exact(scratch_.data(), n, header_.labels_offset + position_);
+        batch.labels.head(n) =
+            Eigen::Map<const MappedDataset::LabelVector>(reinterpret_cast<const int8_t*>(scratch_.data()), n).cast<double>();
+
+        batch.rows = n;
+        batch.first_row = position_;
+        position_ += n;
+        return true;
+    }
+
+private:
+    void read_exact(void* dst, size_t size, uint64_t offset) {
+        char* p = static_cast<char*>(dst);
+        while (size > 0) {
+            ssize_t got = ::pread(fd_, p, size, static_cast<off_t>(offset));
+            if (got <= 0) {
+                throw std::runtime_error("Read error on " + filename_);
+            }
+            p += got;
+            size -= got;
+            offset += got;
+        }
+    }
+
+    std::string filename_;
+    Eigen::Index batch_size_;
+    BinaryDatasetHeader header_;
+    size_t element_size_ = sizeof(double);
+    std::vector<char> scratch_;
+    int fd_ = -1;
+    Eigen::Index position_ = 0;
+};
+
+// Wraps another source and reads up to `depth` batches ahead on a background thread
+class PrefetchingDataSource : public DataSource {
+public:
+    PrefetchingDataSource(std::unique_ptr<DataSource> inner, size_t depth = 2)
+        : inner_(std::move(inner)), free_(std::max<size_t>(depth, 1)) {
+        start();
+    }
+
+    ~PrefetchingDataSource() override { stop(); }
+
+    Eigen::Index rows() const override { return inner_->rows(); }
+    Eigen::Index cols() const override { return inner_->cols(); }
+    Eigen::Index batch_size() const override { return inner_->batch_size(); }
+
+    void seek(Eigen::Index row) override {
+        stop();
+        inner_->seek(row);
+        start();
+    }
+
+    bool next_batch(Batch& batch) override {
+        TRACE_SCOPE("wait_batch");
+        std::unique_lock<std::mutex> lock(mutex_);
+        ready_cv_.wait(lock, [&]() { return !ready_.empty() || finished_; });
+        if (ready_.empty()) {
+            if (error_) std::rethrow_exception(error_);
+            return false;
+        }
+        // Hand over the filled buffers and recycle the caller's old ones
+        std::swap(batch, ready_.front());
+        free_.push_back(std::move(ready_.front()));
+        ready_.pop_front();
+        free_cv_.notify_one();
+        return true;
+    }
+
+private:
+    void start() {
+        stopping_ = false;
+        finished_ = false;
+        error_ = nullptr;
+        worker_ = std::thread([this]() { run(); });
+    }
+
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        free_cv_.notify_all();
+        if (worker_.joinable()) worker_.join();
+        while (!ready_.empty()) {
+            free_.push_back(std::move(ready_.front()));
+            ready_.pop_front();
+        }
+    }
+
+    void run() {
+        try {
+            while (true) {
+                Batch batch;
+                {
+                    std::unique_lock<std::mutex> lock(mutex_);
+                    free_cv_.wait(lock, [&]() { return !free_.empty() || stopping_; });
+                    if (stopping_) return;
+                    batch = std::move(free_.back());
+                    free_.pop_back();
+                }
+
+                bool more = inner_->next_batch(batch);
+
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (!more) {
+                    free_.push_back(std::move(batch));
+                    finished_ = true;
+                    ready_cv_.notify_all();
+                    return;
+                }
+                ready_.push_back(std::move(batch));
+                ready_cv_.notify_one();
+            }
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            error_ = std::current_exception();
+            finished_ = true;
+            ready_cv_.notify_all();
+        }
+    }
+
+    std::unique_ptr<DataSource> inner_;
+    std::deque<Batch> ready_;
+    std::deque<Batch> free_;
+    std::mutex mutex_;
+    std::condition_variable ready_cv_;
+    std::condition_variable free_cv_;
+    std::thread worker_;
+    std::exception_ptr error_;
+    bool stopping_ = false;
+    bool finished_ = false;
+};
+
+// Function to open a CSV or binary dataset file as a (prefetching) data source
+inline std::unique_ptr<DataSource> open_data_source(const std::string& filename, Eigen::Index batch_size,
+                                                    size_t prefetch_depth = 2, const CsvOptions& options = {}) {
+    char magic[sizeof(BINARY_DATASET_MAGIC)] = {};
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("Could not open file: " + filename);
+    }
+    bool is_binary = ::pread(fd, magic, sizeof(magic), 0) == static_cast<ssize_t>(sizeof(magic)) &&
+                     std::memcmp(magic, BINARY_DATASET_MAGIC, sizeof(magic)) == 0;
+    ::close(fd);
+
+    std::unique_ptr<DataSource> source;
+    if (is_binary) {
+        source = std::make_unique<BinaryDataSource>(filename, batch_size);
+    } else {
+        source = std::make_unique<CsvDataSource>(filename, batch_size, options);
+    }
+    if (prefetch_depth == 0) return source;
+    return std::make_unique<PrefetchingDataSource>(std::move(source), prefetch_depth);
+}
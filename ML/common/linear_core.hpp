@@ -0,0 +1,194 @@
+#pragma once
+
+// Batched gradient computation for the linear models (linear regression,
+// logistic regression, linear SVM).
+//
+// The gradient of a linear model's summed loss is X^T r, where r is a
+// per-row residual of z = X w:
+//
+//     squared   r = 2 (z - y)                 (loss (y - x.w)^2)
+//     logistic  r = sigmoid(z) - y            (labels 0 / 1)
+//     hinge     r = -y where y z < 1, else 0  (labels -1 / +1)
+//
+// so a block of rows costs two matrix-vector products and one elementwise
+// kernel, instead of a copied row and a dot product per row. Rows are
+// processed in chunks of a fixed size; each chunk writes its own partial
+// gradient, chunks run on a ThreadPool when one is given, and the partials are
+// summed in chunk order, so the gradient does not depend on the thread count.
+//
+// Storage can be float32, which halves the memory and bandwidth of the GEMVs;
+// residuals and partial gradients are then float32 too, and the total is
+// accumulated in double. A shard that fits in cache_bytes is read from the
+// source once and kept resident in the chosen precision for all later passes.
+// Otherwise every pass streams the source's batches, converting each into a
+// reused buffer.
+//
+// All buffers are sized on the first pass; later passes allocate nothing on
+// the calling thread (the ThreadPool still allocates for each task it runs).
+//
+//     auto core = make_linear_core(LinearLoss::Logistic, source, options);
+//     weights -= learning_rate * core->gradient(weights) / source.rows();
+
+#include <algorithm>
+#include <memory>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+#include <Eigen/Dense>
+#include "data_source.hpp"
+#include "thread_pool.hpp"
+#include "perf_counters.hpp"
+#include "trace.hpp"
+
+enum class LinearLoss { Squared, Logistic, Hinge };
+
+enum class Precision { Float64, Float32 };
+
+struct LinearCoreOptions {
+    Precision precision = Precision::Float64;
+    ThreadPool* pool = nullptr;            // Run the chunks of a pass in parallel on this pool
+    Eigen::Index chunk_rows = 8192;        // Rows per GEMV; also the unit of parallel work
+    size_t cache_bytes = size_t(1) << 30;  // Keep shards up to this size resident (0 never does)
+};
+
+class LinearCore {
+public:
+    virtual ~LinearCore() = default;
+
+    // Gradient of the loss summed over every row of the source, at `weights`
+    virtual const Eigen::VectorXd& gradient(const Eigen::VectorXd& weights) = 0;
+
+    // Whether the shard is held in memory rather than streamed from the source
+    virtual bool resident() const = 0;
+};
+
+template <typename Scalar>
+class LinearCoreImpl : public LinearCore {
+public:
+    using Matrix = Eigen::Matrix<Scalar, Eigen::Dynamic, Eigen::Dynamic>;
+    using Vector = Eigen::Matrix<Scalar, Eigen::Dynamic, 1>;
+
+    // The source must outlive the core
+    LinearCoreImpl(LinearLoss loss, DataSource& source, const LinearCoreOptions& options)
+        : loss_(loss), source_(source), options_(options), gradient_(Eigen::VectorXd::Zero(source.cols())) {
+        if (options_.chunk_rows < 1) throw std::invalid_argument("chunk_rows must be positive");
+        size_t bytes = size_t(source.rows()) * (size_t(source.cols()) + 1) * sizeof(Scalar);
+        resident_ = options_.cache_bytes > 0 && bytes <= options_.cache_bytes;
+    }
+
+    bool resident() const override { return resident_; }
+
+    const Eigen::VectorXd& gradient(const Eigen::VectorXd& weights) override {
+        if (weights.size() != source_.cols()) throw std::invalid_argument("Weights do not match the data");
+        TRACE_SCOPE("gradient");
+        PERF_SCOPE("gradient");
+        weights_ = weights.template cast<Scalar>();
+        gradient_.setZero();
+
+        if (resident_) {
+            if (!loaded_) load();
+            accumulate(data_, labels_, data_.rows());
+            return gradient_;
+        }
+
+        source_.reset();
+        while (source_.next_batch(batch_)) {
+            if constexpr (std::is_same<Scalar, double>::value) {
+                accumulate(batch_.features, batch_.labels, batch_.rows);
+            } else {
+                data_.resize(batch_.features.rows(), batch_.features.cols());  // No-op after the first batch
+                labels_.resize(batch_.labels.size());
+                data_.topRows(batch_.rows) = batch_.X().template cast<Scalar>();
+                labels_.head(batch_.rows) = batch_.y().template cast<Scalar>();
+                accumulate(data_, labels_, batch_.rows);
+            }
+        }
+        return gradient_;
+    }
+
+private:
+    struct Chunk {
+        Vector z;         // X w, then the residual, of the chunk's rows
+        Vector gradient;  // X^T r of the chunk's rows
+    };
+
+    // Read the whole source once into data_ / labels_
+    void load() {
+        data_.resize(source_.rows(), source_.cols());
+        labels_.resize(source_.rows());
+        source_.reset();
+        while (source_.next_batch(batch_)) {
+            data_.middleRows(batch_.first_row, batch_.rows) = batch_.X().template cast<Scalar>();
+            labels_.segment(batch_.first_row, batch_.rows) = batch_.y().template cast<Scalar>();
+        }
+        loaded_ = true;
+    }
+
+    // Add the gradient of the first `rows` rows of X to gradient_
+    template <typename MatrixType, typename VectorType>
+    void accumulate(const MatrixType& X, const VectorType& y, Eigen::Index rows) {
+        const Eigen::Index chunk_rows = options_.chunk_rows;
+        const size_t count = size_t((rows + chunk_rows - 1) / chunk_rows);
+        if (chunks_.size() < count) chunks_.resize(count);
+
+        auto run = [&](size_t c) {
+            Eigen::Index begin = Eigen::Index(c) * chunk_rows;
+            Eigen::Index n = std::min(chunk_rows, rows - begin);
+            chunk_gradient(X.middleRows(begin, n), y.segment(begin, n), chunks_[c]);
+        };
+        if (options_.pool && count > 1) {
+            TaskGroup group(*options_.pool);
+            for (size_t c = 1; c < count; ++c) group.run([&run, c]() { run(c); });
+            run(0);
+            group.wait();
+        } else {
+            for (size_t c = 0; c < count; ++c) run(c);
+        }
+        for (size_t c = 0; c < count; ++c) gradient_ += chunks_[c].gradient.template cast<double>();
+    }
+
+    template <typename Rows, typename Labels>
+    void chunk_gradient(const Rows& X, const Labels& y, Chunk& chunk) const {
+        const Eigen::Index n = X.rows();
+        if (chunk.z.size() < n) chunk.z.resize(options_.chunk_rows);
+        auto z = chunk.z.head(n);
+        z.noalias() = X * weights_;
+
+        auto yv = y.array();
+        auto zv = z.array();
+        switch (loss_) {
+        case LinearLoss::Squared:
+            zv = Scalar(2) * (zv - yv);
+            break;
+        case LinearLoss::Logistic:
+            zv = Scalar(1) / (Scalar(1) + (-zv).exp()) - yv;
+            break;
+        case LinearLoss::Hinge:
+            zv = (yv * zv < Scalar(1)).select(-yv, Scalar(0));
+            break;
+        }
+
+        chunk.gradient.resize(X.cols());
+        chunk.gradient.noalias() = X.transpose() * z;
+    }
+
+    LinearLoss loss_;
+    DataSource& source_;
+    LinearCoreOptions options_;
+    bool resident_ = false;
+    bool loaded_ = false;
+
+    Matrix data_;   // The resident shard, or the current batch converted to Scalar
+    Vector labels_;
+    Batch batch_;
+    Vector weights_;
+    std::vector<Chunk> chunks_;
+    Eigen::VectorXd gradient_;
+};
+
+// Function to create a gradient core over a data source in the chosen precision
+inline std::unique_ptr<LinearCore> make_linear_core(LinearLoss loss, DataSource& source,
+                                                    const LinearCoreOptions& options = {}) {
+    if (options.precision == Precision::Float32) return std::make_unique<LinearCoreImpl<float>>(loss, source, options);
+    return std::make_unique<LinearCoreImpl<double>>(loss, source, options);
+}
@@ -0,0 +1,312 @@
+
+#include <utility>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include <boost/asio.hpp>
+#include <boost/asio/co_spawn.hpp>
+#include <boost/asio/detached.hpp>
+#include <boost/asio/use_awaitable.hpp>
+#include <Eigen/Dense>
+#include "wire_protocol.hpp"
+#include "update_codec.hpp"
+
+namespace asio = boost::asio;
+using asio::awaitable;
+using asio::use_awaitable;
+using boost::asio::ip::tcp;
+using Clock = std::chrono::steady_clock;
+
+// g++ -O2 -march=native -std=c++20 load_generator.cpp -o load_generator -I /usr/include/eigen3 -lpthread
+// ./load_generator [--mode round|stream] [--clients N] [--threads T] [--model-size D] [--updates U]
+//                  [--codec none|fp16|int8|topk] [--topk R] [--think-ms M] [--think fixed|exp]
+//                  [--arrival burst|uniform|poisson] [--ramp-ms W] [--stragglers F] [--straggler-factor S]
+//                  [--host H] [--port P] [--seed S]
+//
+// Simulates many federated clients from one process to load-test an
+// aggregation server, instead of one client binary per connection. Every
+// virtual client is a coroutine; all of them share an io_context run by a few
+// threads. A client arrives, connects, then repeats: think (local training),
+// upload an update, wait for the server's model. It sends its next update
+// only after the model for the previous one has arrived (closed loop).
+//
+//   round   the round-based servers (LSVM, Linear_Regression,
+//           Logistic_Regression): raw float64 updates, one global model per
+//           round. Start the server with N expected clients, e.g.
+//           ./server 10 1000 1 500 for 1000 virtual clients.
+//   stream  the streaming KernelSVM server: delta updates against the last
+//           model received, encoded with --codec, one model back per update
+//
+// Think times are fixed or exponential with mean --think-ms. A fraction
+// --stragglers of the clients thinks --straggler-factor times longer.
+// Clients arrive all at once (burst), evenly over --ramp-ms (uniform), or with
+// exponential gaps averaging --ramp-ms / N (poisson).
+//
+// Update payloads are encoded once and shared by every client. Models are
+// received in fixed-size chunks and checksummed on the fly, so memory is
+// O(clients x 64 KB) for any model size. Every client needs a socket;
+// raise `ulimit -n` above N first.
+//
+// Reports updates/s and upload / download GB/s over the whole run, and the
+// p50 / p99 / p999 latency from starting an upload to receiving the model
+// it produced. In round mode that includes waiting for the round to close.
+
+struct LoadOptions {
+    std::string mode = "round";
+    std::string host = "127.0.0.1";
+    unsigned short port = 8080;
+    int clients = 1000;
+    unsigned threads = 4;
+    Eigen::Index model_size = 1000;
+    int updates = 10;                 // Per client; round mode also stops at the final model
+    CodecOptions codec;
+    double think_ms = 10.0;
+    bool exponential_think = false;
+    std::string arrival = "uniform";
+    double ramp_ms = 1000.0;
+    double straggler_ratio = 0.0;
+    double straggler_factor = 10.0;
+    uint64_t seed = 1;
+};
+
+LoadOptions parse_load_options(int argc, char** argv) {
+    LoadOptions options;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) throw std::runtime_error("Missing value for " + arg);
+        std::string value = argv[++i];
+        if (arg == "--mode") options.mode = value;
+        else if (arg == "--host") options.host = value;
+        else if (arg == "--port") options.port = static_cast<unsigned short>(std::stoi(value));
+        else if (arg == "--clients") options.clients = std::stoi(value);
+        else if (arg == "--threads") options.threads = static_cast<unsigned>(std::stoul(value));
+        else if (arg == "--model-size") options.model_size = std::stol(value);
+        else if (arg == "--updates") options.updates = std::stoi(value);
+        else if (arg == "--codec") {
+            options.codec.codec = parse_update_codec(value);
+            options.codec.error_feedback = options.codec.codec == UpdateCodec::TopK;
+        } else if (arg == "--topk") options.codec.topk_ratio = std::stod(value);
+        else if (arg == "--think-ms") options.think_ms = std::stod(value);
+        else if (arg == "--think") options.exponential_think = value == "exp";
+        else if (arg == "--arrival") options.arrival = value;
+        else if (arg == "--ramp-ms") options.ramp_ms = std::stod(value);
+        else if (arg == "--stragglers") options.straggler_ratio = std::stod(value);
+        else if (arg == "--straggler-factor") options.straggler_factor = std::stod(value);
+        else if (arg == "--seed") options.seed = std::stoull(value);
+        else throw std::runtime_error("Unknown argument: " + arg);
+    }
+    if (options.mode != "round" && options.mode != "stream") throw std::runtime_error("Mode must be round or stream");
+    if (options.mode == "round" && options.codec.codec != UpdateCodec::None) {
+        throw std::runtime_error("The round servers only accept raw updates; use --codec with --mode stream");
+    }
+    if (options.arrival != "burst" && options.arrival != "uniform" && options.arrival != "poisson") {
+        throw std::runtime_error("Arrival must be burst, uniform or poisson");
+    }
+    if (options.clients < 1 || options.threads < 1 || options.model_size < 1 || options.updates < 1) {
+        throw std::runtime_error("Need at least one client, thread, model value and update");
+    }
+    return options;
+}
+
+// The update every client uploads, encoded once
+struct SharedUpdate {
+    FrameHeader header;  // Sealed; round and header_crc are set per frame
+    std::vector<uint8_t> payload;
+};
+
+SharedUpdate make_shared_update(const LoadOptions& options) {
+    std::mt19937_64 rng(options.seed);
+    std::normal_distribution<double> normal(0.0, 0.01);
+    Eigen::VectorXd update = Eigen::VectorXd::NullaryExpr(options.model_size, [&]() { return normal(rng); });
+
+    SharedUpdate shared;
+    if (options.mode == "round") {
+        shared.header = frame_header(MessageType::Update, 0, options.model_size, 1, 100.0);
+        auto bytes = static_cast<const uint8_t*>(frame_buffer(update).data());
+        shared.payload.assign(bytes, bytes + update.size() * sizeof(double));
+    } else {
+        UpdateEncoder encoder(options.codec);
+        asio::const_buffer encoded = encoder.encode(update);
+        auto bytes = static_cast<const uint8_t*>(encoded.data());
+        shared.payload.assign(bytes, bytes + encoded.size());
+        shared.header = update_frame_header(0, options.model_size, 100.0, options.codec.codec, true);
+    }
+    seal_frame_header(shared.header, asio::buffer(shared.payload));
+    return shared;
+}
+
+struct LoadStats {
+    std::atomic<long long> connected{0};
+    std::atomic<long long> failures{0};
+    std::atomic<long long> updates{0};
+    std::atomic<long long> bytes_up{0};
+    std::atomic<long long> bytes_down{0};
+    std::mutex mutex;
+    std::vector<float> latencies_ms;  // Merged from every client when it finishes
+};
+
+// Read a frame's payload in chunks and check its checksum, keeping nothing
+awaitable<void> async_discard_payload(tcp::socket& socket, const FrameHeader& header, std::vector<uint8_t>& chunk) {
+    uint64_t left = header.payload_bytes;
+    uint32_t crc = 0;
+    while (left > 0) {
+        size_t n = static_cast<size_t>(std::min<uint64_t>(left, chunk.size()));
+        co_await asio::async_read(socket, asio::buffer(chunk.data(), n), use_awaitable);
+        crc = crc32c(chunk.data(), n, crc);
+        left -= n;
+    }
+    if (crc != header.checksum) throw ProtocolError("Frame payload checksum mismatch");
+}
+
+awaitable<void> sleep_for(double ms) {
+    if (ms <= 0.0) co_return;
+    asio::steady_timer timer(co_await asio::this_coro::executor);
+    timer.expires_after(std::chrono::microseconds(static_cast<long long>(ms * 1e3)));
+    co_await timer.async_wait(use_awaitable);
+}
+
+awaitable<void> virtual_client(const LoadOptions& options, const SharedUpdate& update, tcp::endpoint server,
+                               double arrival_ms, bool straggler, uint64_t seed, LoadStats& stats) {
+    std::mt19937_64 rng(seed);
+    std::exponential_distribution<double> exponential(1.0);
+    std::vector<float> latencies;
+    latencies.reserve(options.updates);
+    const bool stream = options.mode == "stream";
+
+    try {
+        co_await sleep_for(arrival_ms);
+        tcp::socket socket(co_await asio::this_coro::executor);
+        co_await socket.async_connect(server, use_awaitable);
+        socket.set_option(tcp::no_delay(true));
+        stats.connected++;
+
+        std::vector<uint8_t> chunk(size_t(64) << 10);
+        int round = 0;  // Round to train for, or in stream mode the model version the delta refers to
+        for (int u = 0; u < options.updates; ++u) {
+            double think = options.exponential_think ? options.think_ms * exponential(rng) : options.think_ms;
+            co_await sleep_for(straggler ? think * options.straggler_factor : think);
+
+            FrameHeader header = update.header;
+            header.round = round;
+            header.header_crc = header_checksum(header);
+            std::array<asio::const_buffer, 2> frame{asio::buffer(&header, sizeof(header)), asio::buffer(update.payload)};
+            Clock::time_point sent = Clock::now();
+            co_await asio::async_write(socket, frame, use_awaitable);
+            stats.bytes_up += sizeof(header) + update.payload.size();
+
+            std::optional<FrameHeader> reply = co_await async_read_frame_header(socket);
+            if (!reply) throw std::runtime_error("Server closed the connection");
+            expect_frame(*reply, MessageType::GlobalModel);
+            co_await async_discard_payload(socket, *reply, chunk);
+            latencies.push_back(std::chrono::duration<float, std::milli>(Clock::now() - sent).count());
+            stats.bytes_down += sizeof(*reply) + reply->payload_bytes;
+            stats.updates++;
+
+            round = reply->round;
+            if (!stream && reply->is_final()) break;
+        }
+
+        if (stream) {
+            // End the stream and drain models still in flight until the server's end of stream
+            FrameHeader end = frame_header(MessageType::EndOfStream, 0, 0, 0);
+            seal_frame_header(end, asio::const_buffer());
+            co_await asio::async_write(socket, asio::buffer(&end, sizeof(end)), use_awaitable);
+            while (std::optional<FrameHeader> header = co_await async_read_frame_header(socket)) {
+                if (header->message_type() == MessageType::EndOfStream) break;
+                co_await async_discard_payload(socket, *header, chunk);
+            }
+        }
+    } catch (const std::exception& e) {
+        if (stats.failures++ < 5) std::cerr << "[ERROR] Virtual client failed: " << e.what() << std::endl;
+    }
+
+    std::lock_guard<std::mutex> lock(stats.mutex);
+    stats.latencies_ms.insert(stats.latencies_ms.end(), latencies.begin(), latencies.end());
+}
+
+// Arrival offsets of every client in ms
+std::vector<double> arrival_times(const LoadOptions& options) {
+    std::mt19937_64 rng(options.seed ^ 0xA5A5A5A5u);
+    std::exponential_distribution<double> gap(options.clients / std::max(options.ramp_ms, 1e-9));
+    std::vector<double> times(options.clients, 0.0);
+    double t = 0.0;
+    for (int c = 0; c < options.clients; ++c) {
+        if (options.arrival == "uniform") times[c] = options.ramp_ms * c / options.clients;
+        else if (options.arrival == "poisson") times[c] = (t += gap(rng));
+    }
+    return times;
+}
+
+double percentile(const std::vector<float>& sorted, double p) {
+    if (sorted.empty()) return 0.0;
+    size_t index = static_cast<size_t>(std::ceil(p * sorted.size()));
+    return sorted[std::min(sorted.size() - 1, index > 0 ? index - 1 : 0)];
+}
+
+int main(int argc, char** argv) {
+    try {
+        LoadOptions options = parse_load_options(argc, argv);
+        SharedUpdate update = make_shared_update(options);
+
+        asio::io_context io_context(static_cast<int>(options.threads));
+        tcp::resolver resolver(io_context);
+        tcp::endpoint server = *resolver.resolve(options.host, std::to_string(options.port)).begin();
+
+        // Stragglers are a random subset of the clients
+        std::vector<int> order(options.clients);
+        for (int c = 0; c < options.clients; ++c) order[c] = c;
+        std::shuffle(order.begin(), order.end(), std::mt19937_64(options.seed));
+        std::vector<bool> straggler(options.clients, false);
+        int stragglers = static_cast<int>(std::round(options.straggler_ratio * options.clients));
+        for (int s = 0; s < std::min(stragglers, options.clients); ++s) straggler[order[s]] = true;
+
+        std::cout << "[INFO] " << options.clients << " " << options.mode << " clients on " << options.threads
+                  << " threads -> " << server << ": model " << options.model_size << " values, "
+                  << update.payload.size() << " B updates (" << codec_name(options.codec.codec) << "), "
+                  << options.updates << " updates each, think " << options.think_ms << " ms "
+                  << (options.exponential_think ? "exp" : "fixed") << ", " << stragglers << " stragglers x"
+                  << options.straggler_factor << ", " << options.arrival << " arrival over " << options.ramp_ms
+                  << " ms" << std::endl;
+
+        LoadStats stats;
+        std::vector<double> arrivals = arrival_times(options);
+        for (int c = 0; c < options.clients; ++c) {
+            asio::co_spawn(asio::make_strand(io_context),
+                           virtual_client(options, update, server, arrivals[c], straggler[c], options.seed * 7919 + c, stats),
+                           asio::detached);
+        }
+
+        Clock::time_point start = Clock::now();
+        std::vector<std::thread> threads;
+        for (unsigned t = 1; t < options.threads; ++t) threads.emplace_back([&io_context]() { io_context.run(); });
+        io_context.run();
+        for (auto& thread : threads) thread.join();
+        double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+        std::sort(stats.latencies_ms.begin(), stats.latencies_ms.end());
+        std::printf("[INFO] %lld of %d clients connected, %lld failed, %.2f s\n", stats.connected.load(),
+                    options.clients, stats.failures.load(), seconds);
+        std::printf("  throughput  %.1f updates/s   up %.3f GB/s   down %.3f GB/s\n", stats.updates / seconds,
+                    stats.bytes_up / seconds / 1e9, stats.bytes_down / seconds / 1e9);
+        std::printf("  latency ms  p50 %.2f   p99 %.2f   p999 %.2f   max %.2f   (%zu updates)\n",
+                    percentile(stats.latencies_ms, 0.50), percentile(stats.latencies_ms, 0.99),
+                    percentile(stats.latencies_ms, 0.999), stats.latencies_ms.empty() ? 0.0 : stats.latencies_ms.back(),
+                    stats.latencies_ms.size());
+        return stats.failures > 0 ? 1 : 0;
+    } catch (const std::exception& e) {
+        std::cerr << "[ERROR] " << e.what() << std::endl;
+        return 1;
+    }
+}
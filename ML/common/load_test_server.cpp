@@ -0,0 +1,214 @@
+
+#include <utility>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <boost/asio.hpp>
+#include <boost/asio/redirect_error.hpp>
+#include "async_server.hpp"
+
+// g++ -O2 -std=c++20 load_test_server.cpp -o load_test_server -I /usr/include/eigen3 -lpthread
+// ./load_test_server [async|threaded] [connections] [server_threads] [hold_seconds] [ping_interval_ms]
+//
+// Holds `connections` client connections open against an echo server and
+// reports the server process's resident memory and thread count per
+// connection. Clients run in a forked child process so only the server side
+// is measured. "threaded" is the old blocking accept + std::thread per
+// connection model, for comparison.
+
+struct ClientStats {
+    long long connected = 0;
+    long long pings = 0;
+    long long failures = 0;
+};
+
+// Value of a "Key:   123 kB" line in /proc/self/status
+long long proc_status(const std::string& key) {
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line)) {
+        if (line.compare(0, key.size() + 1, key + ":") == 0) return std::stoll(line.substr(key.size() + 1));
+    }
+    return 0;
+}
+
+// Echo 8-byte pings until the client disconnects
+awaitable<void> echo_session(tcp::socket socket) {
+    uint64_t value;
+    boost::system::error_code error;
+    while (true) {
+        co_await asio::async_read(socket, asio::buffer(&value, sizeof(value)), asio::redirect_error(use_awaitable, error));
+        if (error) break;
+        co_await asio::async_write(socket, asio::buffer(&value, sizeof(value)), asio::redirect_error(use_awaitable, error));
+        if (error) break;
+    }
+}
+
+// The previous server model: one blocking OS thread per connection
+class ThreadedEchoServer {
+public:
+    ThreadedEchoServer() : acceptor_(io_context_, tcp::endpoint(tcp::v4(), 0)) {
+        std::thread([this]() {
+            while (true) {
+                tcp::socket socket(io_context_);
+                acceptor_.accept(socket);
+                active_++;
+                std::thread([this](tcp::socket s) {
+                    uint64_t value;
+                    boost::system::error_code error;
+                    while (!error) {
+                        asio::read(s, asio::buffer(&value, sizeof(value)), error);
+                        if (!error) asio::write(s, asio::buffer(&value, sizeof(value)), error);
+                    }
+                    active_--;
+                }, std::move(socket)).detach();
+            }
+        }).detach();
+    }
+
+    unsigned short port() const { return acceptor_.local_endpoint().port(); }
+    size_t active_sessions() const { return active_.load(); }
+
+private:
+    asio::io_context io_context_;
+    tcp::acceptor acceptor_;
+    std::atomic<size_t> active_{0};
+};
+
+awaitable<void> ping_client(tcp::endpoint endpoint, ClientStats& stats, std::chrono::steady_clock::time_point until,
+                            std::chrono::milliseconds interval) {
+    try {
+        tcp::socket socket(co_await asio::this_coro::executor);
+        co_await socket.async_connect(endpoint, use_awaitable);
+        stats.connected++;
+        asio::steady_timer timer(socket.get_executor());
+        uint64_t value = 0;
+        while (std::chrono::steady_clock::now() < until) {
+            co_await asio::async_write(socket, asio::buffer(&value, sizeof(value)), use_awaitable);
+            co_await asio::async_read(socket, asio::buffer(&value, sizeof(value)), use_awaitable);
+            stats.pings++;
+            value++;
+            timer.expires_after(interval);
+            co_await timer.async_wait(use_awaitable);
+        }
+    } catch (const std::exception&) {
+        stats.failures++;
+    }
+}
+
+// Child process: open all connections from one thread and ping until the hold time ends
+void run_clients(int port_pipe, int stats_pipe, int connections, int hold_seconds, int interval_ms) {
+    unsigned short port = 0;
+    if (read(port_pipe, &port, sizeof(port)) != sizeof(port)) _exit(1);
+
+    asio::io_context io_context(1);
+    ClientStats stats;
+    tcp::endpoint endpoint(asio::ip::address_v4::loopback(), port);
+    auto until = std::chrono::steady_clock::now() + std::chrono::seconds(hold_seconds);
+    for (int i = 0; i < connections; ++i) {
+        asio::co_spawn(io_context, ping_client(endpoint, stats, until, std::chrono::milliseconds(interval_ms)),
+                       asio::detached);
+    }
+    io_context.run();
+    if (write(stats_pipe, &stats, sizeof(stats)) != sizeof(stats)) _exit(1);
+    _exit(0);
+}
+
+int main(int argc, char** argv) {
+    std::string mode = argc > 1 ? argv[1] : "async";
+    int connections = argc > 2 ? std::stoi(argv[2]) : 2000;
+    unsigned threads = argc > 3 ? std::stoi(argv[3]) : 0;
+    int hold_seconds = argc > 4 ? std::stoi(argv[4]) : 5;
+    int interval_ms = argc > 5 ? std::stoi(argv[5]) : 100;
+    if (mode != "async" && mode != "threaded") {
+        std::cerr << "[ERROR] Mode must be async or threaded" << std::endl;
+        return 1;
+    }
+
+    // Both processes need one descriptor per connection plus slack
+    rlimit limit;
+    getrlimit(RLIMIT_NOFILE, &limit);
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+    if (rlim_t(connections) + 64 > limit.rlim_cur) {
+        std::cerr << "[ERROR] Descriptor limit " << limit.rlim_cur << " is too low for " << connections
+                  << " connections" << std::endl;
+        return 1;
+    }
+
+    // Fork before any threads exist
+    int port_pipe[2], stats_pipe[2];
+    if (pipe(port_pipe) != 0 || pipe(stats_pipe) != 0) {
+        std::perror("pipe");
+        return 1;
+    }
+    pid_t child = fork();
+    if (child == 0) run_clients(port_pipe[0], stats_pipe[1], connections, hold_seconds, interval_ms);
+
+    long long rss_before = proc_status("VmRSS");
+    std::unique_ptr<AsyncServer> async_server;
+    std::unique_ptr<ThreadedEchoServer> threaded_server;
+    std::thread server_thread;
+    unsigned short port;
+    if (mode == "async") {
+        async_server = std::make_unique<AsyncServer>(0, echo_session, threads);
+        port = async_server->port();
+        server_thread = std::thread([&]() { async_server->run(); });
+    } else {
+        threaded_server = std::make_unique<ThreadedEchoServer>();
+        port = threaded_server->port();
+    }
+    auto active = [&]() { return async_server ? async_server->active_sessions() : threaded_server->active_sessions(); };
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    long long rss_idle = proc_status("VmRSS");
+    long long threads_idle = proc_status("Threads");
+    if (write(port_pipe[1], &port, sizeof(port)) != sizeof(port)) return 1;
+
+    // Sample while the connections are held
+    auto start = std::chrono::steady_clock::now();
+    long long rss_peak = rss_idle, vm_peak = 0, threads_peak = 0;
+    size_t sessions_peak = 0;
+    while (std::chrono::steady_clock::now() - start < std::chrono::seconds(hold_seconds)) {
+        rss_peak = std::max(rss_peak, proc_status("VmRSS"));
+        vm_peak = std::max(vm_peak, proc_status("VmSize"));
+        threads_peak = std::max(threads_peak, proc_status("Threads"));
+        sessions_peak = std::max(sessions_peak, active());
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+
+    ClientStats stats;
+    if (read(stats_pipe[0], &stats, sizeof(stats)) != sizeof(stats)) std::cerr << "[ERROR] No client statistics" << std::endl;
+    waitpid(child, nullptr, 0);
+
+    double per_connection_kb = sessions_peak ? double(rss_peak - rss_idle) / sessions_peak : 0.0;
+    std::cout << std::fixed << std::setprecision(1);
+    std::cout << "[INFO] mode " << mode << ", " << connections << " connections, " << hold_seconds << " s hold, ping every "
+              << interval_ms << " ms" << std::endl;
+    std::cout << "connected (client side)   : " << stats.connected << " (" << stats.failures << " failed)" << std::endl;
+    std::cout << "peak server sessions      : " << sessions_peak << std::endl;
+    std::cout << "server threads            : " << threads_idle << " idle, " << threads_peak << " peak" << std::endl;
+    std::cout << "server RSS                : " << rss_before << " kB start, " << rss_idle << " kB idle, " << rss_peak
+              << " kB peak" << std::endl;
+    std::cout << "server virtual size peak  : " << vm_peak << " kB" << std::endl;
+    std::cout << "RSS per connection        : " << per_connection_kb << " kB" << std::endl;
+    std::cout << "echo round trips          : " << stats.pings << " (" << stats.pings / double(hold_seconds) << " /s)"
+              << std::endl;
+
+    if (async_server) {
+        async_server->stop();
+        server_thread.join();
+    }
+    std::fflush(stdout);
+    _exit(0);  // Threaded mode leaves detached per-connection threads behind
+}
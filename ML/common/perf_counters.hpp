@@ -0,0 +1,278 @@
+#pragma once
+
+// Hardware performance counters per named phase, via perf_event_open.
+//
+// Build with -DFEDML_PERF to enable; otherwise the macros below expand to
+// nothing, like the tracing macros in trace.hpp.
+//
+//     { PERF_SCOPE("rbf_kernel"); ... }   // Count this thread until end of scope
+//     PERF_REPORT(std::cout);             // Print the summary now (also done at exit)
+//
+// Each thread opens one counter group on its first phase: cycles (leader),
+// instructions, last-level cache misses and branch misses, user space only.
+// A phase reads the group when it starts and ends and adds the difference to
+// its totals, so it counts the thread that runs it; work handed to a pool is
+// counted only by phases scoped inside the tasks, and a phase must not span a
+// co_await. Nested phases each count inclusively. Every phase costs two
+// read() calls, so phases should be tens of microseconds or longer.
+//
+// When the kernel multiplexes the group, values are scaled by
+// time_enabled / time_running. When perf_event_open fails (no PMU in a VM,
+// seccomp in a container, perf_event_paranoid > 2), the missing counters are
+// reported as "-" and the wall time is still recorded, so the same binary runs
+// everywhere.
+//
+// At exit the process prints one row per phase, merged over threads:
+//
+//     phase          samples   total ms   Gcycles   IPC   LLC miss/sample   br miss/sample
+
+#if defined(FEDML_PERF)
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <array>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace perf_detail {
+
+enum Counter { Cycles, Instructions, LlcMisses, BranchMisses, NUM_COUNTERS };
+
+inline const char* counter_name(int counter) {
+    static const char* names[NUM_COUNTERS] = {"cycles", "instructions", "LLC misses", "branch misses"};
+    return names[counter];
+}
+
+struct Sample {
+    std::array<uint64_t, NUM_COUNTERS> values{};
+    int64_t ns = 0;
+};
+
+struct PhaseStats {
+    uint64_t samples = 0;
+    int64_t ns = 0;
+    std::array<uint64_t, NUM_COUNTERS> values{};
+    std::array<bool, NUM_COUNTERS> counted{};  // Counter was open for every sample
+};
+
+inline int64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+// Counter group of the calling thread; counters that fail to open are left out
+class CounterGroup {
+public:
+    CounterGroup() {
+        fds_.fill(-1);
+        const uint32_t types[NUM_COUNTERS] = {PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE,
+                                              PERF_TYPE_HARDWARE};
+        const uint64_t configs[NUM_COUNTERS] = {
+            PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+            PERF_COUNT_HW_CACHE_LL | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+            PERF_COUNT_HW_BRANCH_MISSES};
+
+        for (int c = 0; c < NUM_COUNTERS; ++c) {
+            perf_event_attr attr;
+            std::memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = types[c];
+            attr.config = configs[c];
+            attr.disabled = leader_ < 0 ? 1 : 0;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_ID | PERF_FORMAT_TOTAL_TIME_ENABLED |
+                               PERF_FORMAT_TOTAL_TIME_RUNNING;
+            int fd = int(syscall(SYS_perf_event_open, &attr, 0, -1, leader_, 0));
+            if (fd < 0) {
+                errors_[c] = errno;
+                continue;
+            }
+            fds_[c] = fd;
+            ioctl(fd, PERF_EVENT_IOC_ID, &ids_[c]);
+            if (leader_ < 0) leader_ = fd;
+        }
+        if (leader_ >= 0) ioctl(leader_, PERF_EVENT_IOC_ENABLE, 0);
+    }
+
+    ~CounterGroup() {
+        for (int fd : fds_) {
+            if (fd >= 0) close(fd);
+        }
+    }
+
+    CounterGroup(const CounterGroup&) = delete;
+    CounterGroup& operator=(const CounterGroup&) = delete;
+
+    bool open(int counter) const { return fds_[counter] >= 0; }
+    int error(int counter) const { return errors_[counter]; }
+
+    // Current counts, scaled for multiplexing, and the wall clock
+    void read_into(Sample& sample) const {
+        sample.ns = now_ns();
+        if (leader_ < 0) return;
+        // nr, time_enabled, time_running, then (value, id) per counter
+        uint64_t buffer[3 + 2 * NUM_COUNTERS];
+        if (::read(leader_, buffer, sizeof(buffer)) < ssize_t(3 * sizeof(uint64_t))) return;
+        uint64_t nr = buffer[0], enabled = buffer[1], running = buffer[2];
+        double scale = running > 0 ? double(enabled) / double(running) : 0.0;
+        for (uint64_t i = 0; i < nr && i < NUM_COUNTERS; ++i) {
+            uint64_t value = buffer[3 + 2 * i], id = buffer[4 + 2 * i];
+            for (int c = 0; c < NUM_COUNTERS; ++c) {
+                if (fds_[c] >= 0 && ids_[c] == id) sample.values[c] = uint64_t(double(value) * scale);
+            }
+        }
+    }
+
+private:
+    std::array<int, NUM_COUNTERS> fds_;
+    std::array<uint64_t, NUM_COUNTERS> ids_{};
+    std::array<int, NUM_COUNTERS> errors_{};
+    int leader_ = -1;
+};
+
+// One thread's counters and phase totals. The mutex is only contended while
+// the summary is printed.
+struct ThreadCounters {
+    CounterGroup group;
+    std::mutex mutex;
+    std::unordered_map<const char*, PhaseStats> phases;  // Keyed by string literal
+
+    void add(const char* name, const Sample& begin, const Sample& end) {
+        std::lock_guard<std::mutex> lock(mutex);
+        PhaseStats& stats = phases[name];
+        if (stats.samples == 0) {
+            for (int c = 0; c < NUM_COUNTERS; ++c) stats.counted[c] = group.open(c);
+        }
+        stats.samples++;
+        stats.ns += end.ns - begin.ns;
+        for (int c = 0; c < NUM_COUNTERS; ++c) stats.values[c] += end.values[c] - begin.values[c];
+    }
+};
+
+// Registry of all threads' counters; prints the summary when the process exits
+class Registry {
+public:
+    ~Registry() { report(std::cout); }
+
+    std::shared_ptr<ThreadCounters> register_thread() {
+        auto counters = std::make_shared<ThreadCounters>();
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (threads_.empty()) warn_unavailable(counters->group);
+        threads_.push_back(counters);
+        return counters;
+    }
+
+    void report(std::ostream& out) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::map<std::string, PhaseStats> merged;
+        for (const auto& thread : threads_) {
+            std::lock_guard<std::mutex> thread_lock(thread->mutex);
+            for (const auto& [name, stats] : thread->phases) {
+                auto [it, inserted] = merged.try_emplace(name, stats);
+                if (inserted) continue;
+                PhaseStats& total = it->second;
+                total.samples += stats.samples;
+                total.ns += stats.ns;
+                for (int c = 0; c < NUM_COUNTERS; ++c) {
+                    total.values[c] += stats.values[c];
+                    total.counted[c] = total.counted[c] && stats.counted[c];
+                }
+            }
+        }
+        if (merged.empty()) return;
+
+        char line[256];
+        std::snprintf(line, sizeof(line), "%-22s %9s %11s %10s %6s %16s %16s\n", "phase", "samples", "total ms",
+                      "Gcycles", "IPC", "LLC miss/sample", "br miss/sample");
+        out << "[INFO] Hardware counters per phase\n" << line;
+        for (const auto& [name, stats] : merged) {
+            auto per_sample = [&](int c, char* buffer, size_t size) {
+                if (stats.counted[c]) std::snprintf(buffer, size, "%.1f", double(stats.values[c]) / stats.samples);
+                else std::snprintf(buffer, size, "-");
+            };
+            char cycles[32], ipc[32], llc[32], branch[32];
+            if (stats.counted[Cycles]) std::snprintf(cycles, sizeof(cycles), "%.3f", stats.values[Cycles] / 1e9);
+            else std::snprintf(cycles, sizeof(cycles), "-");
+            if (stats.counted[Cycles] && stats.counted[Instructions] && stats.values[Cycles] > 0) {
+                std::snprintf(ipc, sizeof(ipc), "%.2f", double(stats.values[Instructions]) / stats.values[Cycles]);
+            } else {
+                std::snprintf(ipc, sizeof(ipc), "-");
+            }
+            per_sample(LlcMisses, llc, sizeof(llc));
+            per_sample(BranchMisses, branch, sizeof(branch));
+            std::snprintf(line, sizeof(line), "%-22s %9llu %11.3f %10s %6s %16s %16s\n", name.c_str(),
+                          (unsigned long long)stats.samples, stats.ns / 1e6, cycles, ipc, llc, branch);
+            out << line;
+        }
+        out << std::flush;
+    }
+
+private:
+    // Say once which counters are missing and why
+    static void warn_unavailable(const CounterGroup& group) {
+        for (int c = 0; c < NUM_COUNTERS; ++c) {
+            if (!group.open(c)) {
+                std::cerr << "[WARN] Hardware counter '" << counter_name(c)
+                          << "' unavailable: " << std::strerror(group.error(c)) << std::endl;
+            }
+        }
+    }
+
+    std::mutex mutex_;
+    std::vector<std::shared_ptr<ThreadCounters>> threads_;
+};
+
+inline Registry& registry() {
+    static Registry instance;
+    return instance;
+}
+
+inline ThreadCounters& thread_counters() {
+    thread_local std::shared_ptr<ThreadCounters> counters = registry().register_thread();
+    return *counters;
+}
+
+class Phase {
+public:
+    explicit Phase(const char* name) : name_(name), counters_(thread_counters()) { counters_.group.read_into(begin_); }
+    ~Phase() {
+        Sample end;
+        counters_.group.read_into(end);
+        counters_.add(name_, begin_, end);
+    }
+
+    Phase(const Phase&) = delete;
+    Phase& operator=(const Phase&) = delete;
+
+private:
+    const char* name_;
+    ThreadCounters& counters_;
+    Sample begin_;
+};
+
+}  // namespace perf_detail
+
+#define PERF_CONCAT_INNER(a, b) a##b
+#define PERF_CONCAT(a, b) PERF_CONCAT_INNER(a, b)
+#define PERF_SCOPE(name) perf_detail::Phase PERF_CONCAT(perf_phase_, __LINE__)(name)
+#define PERF_REPORT(out) perf_detail::registry().report(out)
+
+#else
+
+#define PERF_SCOPE(name) ((void)0)
+#define PERF_REPORT(out) ((void)0)
+
+#endif
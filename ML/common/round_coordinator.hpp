@@ -0,0 +1,250 @@
+#pragma once
+
+// Synchronous federated rounds.
+//
+// The coordinator runs `rounds` rounds. A round opens with the first update
+// submitted for it and closes as soon as `expected_clients` updates are in,
+// or once `deadline` has passed since it opened and at least `min_clients`
+// updates are in. On close the aggregator turns the round's updates into one
+// global model, and every participant of the round is handed that same model
+// together with the id of the next round.
+//
+// Updates are tagged with the round they were trained for. An update for a
+// round that already closed (a straggler) is not aggregated; its sender gets
+// the latest global model back so it can rejoin the current round.
+//
+// submit() is callback based so both thread-per-connection and asynchronous
+// servers can use it; contribute() is the blocking form. A watchdog thread
+// enforces the deadline when no further client arrives to close the round.
+// Aggregators that report concurrent() receive add() calls outside the
+// coordinator's lock; a round only closes once no add() is in flight.
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <Eigen/Dense>
+#include "atomic_snapshot.hpp"
+#include "perf_counters.hpp"
+#include "trace.hpp"
+
+struct RoundOptions {
+    int rounds = 10;
+    int expected_clients = 2;  // N: close the round as soon as this many updates are in
+    int min_clients = 1;       // K: after the deadline, close with at least this many
+    std::chrono::milliseconds deadline{5000};
+};
+
+// Usage: ./server [rounds] [expected_clients] [min_clients] [deadline_ms]
+inline RoundOptions parse_round_options(int argc, char** argv) {
+    RoundOptions options;
+    if (argc > 1) options.rounds = std::stoi(argv[1]);
+    if (argc > 2) options.expected_clients = std::stoi(argv[2]);
+    if (argc > 3) options.min_clients = std::stoi(argv[3]);
+    if (argc > 4) options.deadline = std::chrono::milliseconds(std::stol(argv[4]));
+    if (options.rounds < 1 || options.min_clients < 1 || options.expected_clients < options.min_clients) {
+        throw std::runtime_error("Invalid round options: need rounds >= 1 and 1 <= min_clients <= expected_clients");
+    }
+    return options;
+}
+
+struct RoundReply {
+    int round = 0;          // Round the client should train for next
+    bool finished = false;  // Training is over and model is final
+    bool accepted = false;  // The update went into an aggregate
+    std::shared_ptr<const Eigen::MatrixXd> model;
+};
+
+// Turns one round's updates into the global model
+class RoundAggregator {
+public:
+    virtual ~RoundAggregator() = default;
+    // Add one client's update trained on `samples` rows; throw to reject it
+    virtual void add(const Eigen::MatrixXd& update, double samples) = 0;
+    // Whether add() may be called from several threads at once
+    virtual bool concurrent() const { return false; }
+    // Global model from the updates added since the last call; resets the state
+    virtual Eigen::MatrixXd finish() = 0;
+};
+
+// FedAvg: sample-count weighted mean of the client models
+class WeightedAverageAggregator : public RoundAggregator {
+public:
+    void add(const Eigen::MatrixXd& update, double samples) override {
+        if (sum_.size() == 0) {
+            sum_ = Eigen::MatrixXd::Zero(update.rows(), update.cols());
+        } else if (update.rows() != sum_.rows() || update.cols() != sum_.cols()) {
+            throw std::runtime_error("Update of size " + std::to_string(update.size()) + " does not match model size " +
+                                     std::to_string(sum_.size()));
+        }
+        sum_.noalias() += samples * update;
+        total_ += samples;
+    }
+
+    Eigen::MatrixXd finish() override {
+        Eigen::MatrixXd model = sum_ / total_;
+        sum_.setZero();
+        total_ = 0.0;
+        return model;
+    }
+
+private:
+    Eigen::MatrixXd sum_;
+    double total_ = 0.0;
+};
+
+class RoundCoordinator {
+public:
+    using Callback = std::function<void(const RoundReply&)>;
+
+    RoundCoordinator(std::unique_ptr<RoundAggregator> aggregator, const RoundOptions& options)
+        : aggregator_(std::move(aggregator)), options_(options), watchdog_(&RoundCoordinator::watchdog, this) {}
+
+    ~RoundCoordinator() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        cv_.notify_all();
+        watchdog_.join();
+    }
+
+    RoundCoordinator(const RoundCoordinator&) = delete;
+    RoundCoordinator& operator=(const RoundCoordinator&) = delete;
+
+    // Submit an update trained for `round`. `done` runs once the round closes
+    // (on whichever thread closes it), or immediately for stale updates.
+    void submit(int round, const Eigen::MatrixXd& update, double samples, Callback done) {
+        if (!(samples > 0)) throw std::runtime_error("Update must cover a positive number of samples");
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (finished_ || round != round_) {
+            auto model = model_.load();
+            if (!model) {
+                throw std::runtime_error("Update for round " + std::to_string(round) + " but round " +
+                                         std::to_string(round_) + " is open");
+            }
+            RoundReply reply{round_, finished_, false, model};
+            lock.unlock();
+            done(reply);
+            return;
+        }
+
+        if (aggregator_->concurrent()) {
+            // The round cannot close while this add is in flight
+            in_flight_++;
+            lock.unlock();
+            try {
+                TRACE_SCOPE_ROUND("aggregate", round);
+                PERF_SCOPE("aggregate");
+                aggregator_->add(update, samples);
+            } catch (...) {
+                lock.lock();
+                in_flight_--;
+                if (!waiting_.empty() && ready(std::chrono::steady_clock::now())) close_round(lock);
+                throw;
+            }
+            lock.lock();
+            in_flight_--;
+        } else {
+            TRACE_SCOPE_ROUND("aggregate", round);
+            PERF_SCOPE("aggregate");
+            aggregator_->add(update, samples);
+        }
+        waiting_.push_back(std::move(done));
+        if (waiting_.size() == 1) {
+            deadline_ = std::chrono::steady_clock::now() + options_.deadline;
+            cv_.notify_all();
+        }
+
+        if (ready(std::chrono::steady_clock::now())) close_round(lock);
+    }
+
+    // Blocking form of submit()
+    RoundReply contribute(int round, const Eigen::MatrixXd& update, double samples) {
+        std::promise<RoundReply> reply;
+        auto future = reply.get_future();
+        submit(round, update, samples, [&reply](const RoundReply& r) { reply.set_value(r); });
+        return future.get();
+    }
+
+    const RoundOptions& options() const { return options_; }
+
+    // Latest global model (null before the first round closes); never blocks
+    std::shared_ptr<const Eigen::MatrixXd> model() const { return model_.load(); }
+
+private:
+    bool ready(std::chrono::steady_clock::time_point now) const {
+        int count = static_cast<int>(waiting_.size());
+        if (in_flight_ > 0) return false;
+        return count >= options_.expected_clients || (count >= options_.min_clients && now >= deadline_);
+    }
+
+    // Aggregate, publish the model, move to the next round and hand the reply
+    // to every participant. Called with the lock held; returns with it released.
+    void close_round(std::unique_lock<std::mutex>& lock) {
+        int participants = static_cast<int>(waiting_.size());
+        TRACE_ROUND(round_);
+        std::shared_ptr<const Eigen::MatrixXd> model;
+        {
+            TRACE_SCOPE("finish_aggregate");
+            PERF_SCOPE("finish_aggregate");
+            model = std::make_shared<const Eigen::MatrixXd>(aggregator_->finish());
+        }
+        model_.store(model);
+        round_++;
+        finished_ = round_ >= options_.rounds;
+        RoundReply reply{round_, finished_, true, model};
+        std::vector<Callback> callbacks;
+        callbacks.swap(waiting_);
+        lock.unlock();
+
+        std::cout << "[INFO] Round " << reply.round - 1 << " closed with " << participants << " clients"
+                  << (reply.finished ? ", training finished" : "") << std::endl;
+        TRACE_ROUND(reply.round);
+        TRACE_SCOPE("broadcast");
+        for (auto& callback : callbacks) callback(reply);
+    }
+
+    // Closes rounds whose deadline passes with enough updates and no new arrival
+    void watchdog() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (!stopping_) {
+            if (waiting_.empty()) {
+                cv_.wait(lock);
+                continue;
+            }
+            if (ready(std::chrono::steady_clock::now())) {
+                close_round(lock);
+                lock.lock();
+                continue;
+            }
+            if (std::chrono::steady_clock::now() < deadline_) {
+                cv_.wait_until(lock, deadline_);
+            } else {
+                // Deadline passed with fewer than min_clients; the next submit closes the round
+                cv_.wait(lock);
+            }
+        }
+    }
+
+    std::unique_ptr<RoundAggregator> aggregator_;
+    RoundOptions options_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    int round_ = 0;
+    bool finished_ = false;
+    bool stopping_ = false;
+    std::chrono::steady_clock::time_point deadline_;
+    int in_flight_ = 0;              // Concurrent add() calls not yet finished
+    std::vector<Callback> waiting_;  // Participants of the open round
+    AtomicSnapshot<Eigen::MatrixXd> model_;
+    std::thread watchdog_;  // Declared last so it starts after the state above
+};
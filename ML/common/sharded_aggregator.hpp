@@ -0,0 +1,199 @@
+#pragma once
+
+// Sharded accumulation of client updates.
+//
+// The running sum of the parameter vector is split into fixed-size shards,
+// each starting on its own cache line and guarded by its own spinlock. A
+// client update is added shard by shard, starting at a per-thread offset and
+// skipping shards that are busy until a second pass, so concurrent uploads
+// work on different parts of the vector instead of queueing on one mutex.
+// Nothing is printed or divided while a shard is held.
+//
+// Each shard also keeps the weight of the updates it has summed, changed
+// under the same lock. mean() divides every shard by its own weight, so a
+// mean taken while another add() is halfway through the shards is still an
+// exact weighted mean in every shard, never a sum divided by a stale total.
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <Eigen/Dense>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+#include "round_coordinator.hpp"
+
+// Test-and-test-and-set spinlock padded to a cache line
+struct alignas(64) ShardLock {
+    static constexpr int SPIN_LIMIT = 64;
+    std::atomic<bool> locked{false};
+    double weight = 0.0;  // Weight summed into the guarded shard; ShardedAccumulator only
+
+    bool try_lock() {
+        return !locked.load(std::memory_order_relaxed) && !locked.exchange(true, std::memory_order_acquire);
+    }
+
+    // Spins briefly, then yields so a preempted holder can run (oversubscribed cores)
+    void lock() {
+        int spins = 0;
+        while (!try_lock()) {
+            while (locked.load(std::memory_order_relaxed)) {
+                if (++spins < SPIN_LIMIT) {
+#if defined(__x86_64__) || defined(__i386__)
+                    _mm_pause();
+#endif
+                } else {
+                    std::this_thread::yield();
+                }
+            }
+        }
+    }
+
+    void unlock() { locked.store(false, std::memory_order_release); }
+};
+
+class ShardedAccumulator {
+public:
+    // shard_values is rounded up to a whole number of cache lines
+    explicit ShardedAccumulator(Eigen::Index shard_values = 4096)
+        : shard_size_((std::max<Eigen::Index>(1, shard_values) + VALUES_PER_LINE - 1) / VALUES_PER_LINE *
+                      VALUES_PER_LINE) {}
+
+    // Allocate and zero storage for n parameters; not safe concurrently with add()
+    void resize(Eigen::Index n) {
+        n_ = n;
+        shards_ = (n + shard_size_ - 1) / shard_size_;
+        size_t bytes = size_t(shards_ * shard_size_) * sizeof(double);
+        sum_.reset(static_cast<double*>(std::aligned_alloc(64, std::max<size_t>(bytes, 64))));
+        if (!sum_) throw std::bad_alloc();
+        locks_.reset(new ShardLock[shards_]);
+        reset();
+    }
+
+    Eigen::Index size() const { return n_; }
+    Eigen::Index shards() const { return shards_; }
+    double total_weight() const { return total_.load(std::memory_order_acquire); }
+    long contributions() const { return count_.load(std::memory_order_acquire); }
+
+    // sum += weight * update, shard by shard
+    void add(const double* update, double weight) {
+        thread_local std::vector<char> pending;
+        pending.assign(shards_, 1);
+        const Eigen::Index start = Eigen::Index(std::hash<std::thread::id>()(std::this_thread::get_id()) %
+                                                size_t(std::max<Eigen::Index>(1, shards_)));
+
+        // First pass takes whatever shards are free; second pass waits for the rest
+        for (int pass = 0; pass < 2; ++pass) {
+            for (Eigen::Index i = 0; i < shards_; ++i) {
+                Eigen::Index s = (start + i) % shards_;
+                if (!pending[s]) continue;
+                if (pass == 0) {
+                    if (!locks_[s].try_lock()) continue;
+                } else {
+                    locks_[s].lock();
+                }
+                accumulate_shard(s, update, weight);
+                locks_[s].unlock();
+                pending[s] = 0;
+            }
+        }
+
+        double current = total_.load(std::memory_order_relaxed);
+        while (!total_.compare_exchange_weak(current, current + weight, std::memory_order_acq_rel)) {
+        }
+        count_.fetch_add(1, std::memory_order_acq_rel);
+    }
+
+    // out = sum / weight, shard by shard, each read with its own weight under
+    // its lock; shards that have seen no update yet are zero
+    void mean(double* out) const {
+        for (Eigen::Index s = 0; s < shards_; ++s) {
+            Eigen::Index first = s * shard_size_;
+            Eigen::Index count = std::min(shard_size_, n_ - first);
+            locks_[s].lock();
+            const double weight = locks_[s].weight;
+            if (weight > 0.0) {
+                Eigen::Map<Eigen::VectorXd>(out + first, count) =
+                    Eigen::Map<const Eigen::VectorXd>(sum_.get() + first, count) / weight;
+            } else {
+                Eigen::Map<Eigen::VectorXd>(out + first, count).setZero();
+            }
+            locks_[s].unlock();
+        }
+    }
+
+    // Zero the sums; not safe concurrently with add()
+    void reset() {
+        std::fill(sum_.get(), sum_.get() + shards_ * shard_size_, 0.0);
+        for (Eigen::Index s = 0; s < shards_; ++s) locks_[s].weight = 0.0;
+        total_.store(0.0, std::memory_order_release);
+        count_.store(0, std::memory_order_release);
+    }
+
+private:
+    static constexpr Eigen::Index VALUES_PER_LINE = 64 / sizeof(double);
+
+    struct FreeDeleter {
+        void operator()(double* p) const { std::free(p); }
+    };
+
+    void accumulate_shard(Eigen::Index s, const double* update, double weight) {
+        Eigen::Index first = s * shard_size_;
+        Eigen::Index count = std::min(shard_size_, n_ - first);
+        Eigen::Map<Eigen::VectorXd, Eigen::Aligned64>(sum_.get() + first, count).noalias() +=
+            weight * Eigen::Map<const Eigen::VectorXd>(update + first, count);
+        locks_[s].weight += weight;
+    }
+
+    Eigen::Index shard_size_;
+    Eigen::Index n_ = 0;
+    Eigen::Index shards_ = 0;
+    std::unique_ptr<double[], FreeDeleter> sum_;
+    mutable std::unique_ptr<ShardLock[]> locks_;
+    std::atomic<double> total_{0.0};
+    std::atomic<long> count_{0};
+};
+
+// FedAvg over a ShardedAccumulator: the coordinator may call add() from many
+// sessions at once, outside its own lock
+class ShardedAggregator : public RoundAggregator {
+public:
+    explicit ShardedAggregator(Eigen::Index shard_values = 4096) : sum_(shard_values) {}
+
+    bool concurrent() const override { return true; }
+
+    void add(const Eigen::MatrixXd& update, double samples) override {
+        // The first update fixes the model shape
+        std::call_once(shape_once_, [&]() {
+            rows_ = update.rows();
+            cols_ = update.cols();
+            sum_.resize(update.size());
+        });
+        if (update.rows() != rows_ || update.cols() != cols_) {
+            throw std::runtime_error("Update of size " + std::to_string(update.size()) + " does not match model size " +
+                                     std::to_string(rows_ * cols_));
+        }
+        sum_.add(update.data(), samples);
+    }
+
+    Eigen::MatrixXd finish() override {
+        Eigen::MatrixXd model(rows_, cols_);
+        sum_.mean(model.data());
+        sum_.reset();
+        return model;
+    }
+
+private:
+    ShardedAccumulator sum_;
+    std::once_flag shape_once_;
+    Eigen::Index rows_ = 0;
+    Eigen::Index cols_ = 0;
+};
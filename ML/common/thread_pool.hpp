@@ -0,0 +1,188 @@
+#pragma once
+
+// Work-stealing thread pool for fork/join parallelism.
+//
+// Each worker owns a deque of tasks. A worker pushes the tasks it spawns onto
+// its own deque and pops them from the back (most recent first, which keeps
+// recursive work depth-first and cache-warm); an idle worker steals from the
+// front of another worker's deque, taking the oldest and usually largest piece
+// of work. Tasks submitted from outside the pool are spread round-robin.
+//
+// TaskGroup is the fork/join handle: run() forks a task, wait() joins them.
+// A waiting thread keeps executing queued tasks instead of blocking, so tasks
+// may themselves fork and wait (e.g. recursive tree construction) without
+// tying up the pool:
+//
+//     ThreadPool pool;
+//     TaskGroup group(pool);
+//     for (int t = 0; t < trees; ++t) group.run([&, t]() { build(t); });
+//     group.wait();  // Rethrows the first exception of any task
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+class ThreadPool {
+public:
+    using Task = std::function<void()>;
+
+    // threads = 0 uses one thread per hardware thread
+    explicit ThreadPool(unsigned threads = 0) {
+        unsigned count = threads ? threads : std::max(1u, std::thread::hardware_concurrency());
+        for (unsigned i = 0; i < count; ++i) queues_.push_back(std::make_unique<Queue>());
+        for (unsigned i = 0; i < count; ++i) workers_.emplace_back([this, i]() { work(i); });
+    }
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(sleep_mutex_);
+            stopping_ = true;
+        }
+        wake_.notify_all();
+        for (auto& worker : workers_) worker.join();
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    unsigned size() const { return unsigned(workers_.size()); }
+
+    void submit(Task task) {
+        int self = worker_index();
+        size_t q = self >= 0 ? size_t(self) : next_queue_.fetch_add(1, std::memory_order_relaxed) % queues_.size();
+        // Counted before it is visible, so the count never drops below zero
+        pending_.fetch_add(1, std::memory_order_release);
+        {
+            std::lock_guard<std::mutex> lock(queues_[q]->mutex);
+            queues_[q]->tasks.push_back(std::move(task));
+        }
+        {
+            std::lock_guard<std::mutex> lock(sleep_mutex_);  // Orders against a worker about to sleep
+        }
+        wake_.notify_one();
+    }
+
+    // Run one queued task on the calling thread; false if there was none
+    bool run_pending_task() {
+        Task task;
+        if (!take(task)) return false;
+        task();
+        return true;
+    }
+
+private:
+    struct Queue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    // Index of the calling thread in this pool, or -1 for outside threads
+    int worker_index() const { return current_pool() == this ? current_index() : -1; }
+    static const ThreadPool*& current_pool() {
+        static thread_local const ThreadPool* pool = nullptr;
+        return pool;
+    }
+    static int& current_index() {
+        static thread_local int index = -1;
+        return index;
+    }
+
+    // Own deque from the back, then steal from the front of the others
+    bool take(Task& task) {
+        if (pending_.load(std::memory_order_acquire) == 0) return false;
+        const int self = worker_index();
+        const size_t n = queues_.size();
+        const size_t start = self >= 0 ? size_t(self) : next_queue_.load(std::memory_order_relaxed) % n;
+        for (size_t i = 0; i < n; ++i) {
+            Queue& queue = *queues_[(start + i) % n];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            if (queue.tasks.empty()) continue;
+            if (i == 0 && self >= 0) {
+                task = std::move(queue.tasks.back());
+                queue.tasks.pop_back();
+            } else {
+                task = std::move(queue.tasks.front());
+                queue.tasks.pop_front();
+            }
+            pending_.fetch_sub(1, std::memory_order_relaxed);
+            return true;
+        }
+        return false;
+    }
+
+    void work(unsigned index) {
+        current_pool() = this;
+        current_index() = int(index);
+        while (true) {
+            Task task;
+            if (take(task)) {
+                task();
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(sleep_mutex_);
+            wake_.wait(lock, [this]() { return stopping_ || pending_.load(std::memory_order_acquire) > 0; });
+            if (stopping_ && pending_.load(std::memory_order_acquire) == 0) return;
+        }
+    }
+
+    std::vector<std::unique_ptr<Queue>> queues_;
+    std::atomic<size_t> pending_{0};      // Queued, not yet taken
+    std::atomic<size_t> next_queue_{0};   // Round-robin target for outside submissions
+    std::mutex sleep_mutex_;
+    std::condition_variable wake_;
+    bool stopping_ = false;
+    std::vector<std::thread> workers_;    // Declared last so they start after the state above
+};
+
+// A set of forked tasks that is joined with wait()
+class TaskGroup {
+public:
+    explicit TaskGroup(ThreadPool& pool) : pool_(pool) {}
+
+    // Tasks reference the group, so it must not go away before they finish
+    ~TaskGroup() {
+        while (outstanding_.load(std::memory_order_acquire) > 0) help();
+    }
+
+    TaskGroup(const TaskGroup&) = delete;
+    TaskGroup& operator=(const TaskGroup&) = delete;
+
+    template <typename F>
+    void run(F&& f) {
+        outstanding_.fetch_add(1, std::memory_order_relaxed);
+        pool_.submit([this, f = std::forward<F>(f)]() mutable {
+            try {
+                f();
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(error_mutex_);
+                if (!error_) error_ = std::current_exception();
+            }
+            outstanding_.fetch_sub(1, std::memory_order_release);
+        });
+    }
+
+    // Execute queued tasks until every task of the group has finished
+    void wait() {
+        while (outstanding_.load(std::memory_order_acquire) > 0) help();
+        std::lock_guard<std::mutex> lock(error_mutex_);
+        if (error_) std::rethrow_exception(std::exchange(error_, nullptr));
+    }
+
+private:
+    void help() {
+        if (!pool_.run_pending_task()) std::this_thread::yield();
+    }
+
+    ThreadPool& pool_;
+    std::atomic<size_t> outstanding_{0};
+    std::mutex error_mutex_;
+    std::exception_ptr error_;
+};
@@ -0,0 +1,275 @@
+#pragma once
+
+// Phase-level tracing with Chrome / Perfetto trace output.
+//
+// Build with -DFEDML_TRACE to enable; otherwise every macro below expands to
+// nothing and the binary carries no tracing code at all.
+//
+//     TRACE_PROCESS("LSVM client", client_id);  // Name the process, tag its spans
+//     TRACE_ROUND(round);                       // Round tag for later spans
+//     { TRACE_SCOPE("local_training"); ... }    // Time a phase until end of scope
+//     TRACE_SCOPE_ROUND("write_frame", header.round);
+//     TRACE_CLIENT(client, socket.remote_endpoint());  // Declares `client` for a session
+//     TRACE_SCOPE_TAGGED("aggregate", round, client);
+//     TRACE_ASYNC_SCOPE_TAGGED("wait_round", round, client);  // Scope contains a co_await
+//
+// A span records its name (which must be a string literal), start, duration,
+// round and client id into a ring buffer owned by the thread that ends it.
+// Each ring has a single producer: recording is two clock reads and a store,
+// with no lock and no allocation. A thread registers its ring once, on its
+// first span; rings outlive their threads. When a ring is full the oldest
+// spans are overwritten.
+//
+// At exit the process writes trace_<name>_<pid>.json (or the path given to
+// trace_dump()) with one complete ("X") event per span and args
+// {round, client}. A coroutine suspended inside an X span lets other sessions
+// run spans on the same thread, which would overlap on its track, so scopes
+// that contain a co_await use the TRACE_ASYNC_* macros instead: they are
+// written as a begin/end ("b"/"e") pair with their own process-local id and
+// drawn on async tracks, one row per overlapping span. Timestamps come from the
+// monotonic clock, so the files of a server and its clients on one host line up
+// and can be merged:
+//
+//     jq -s '{traceEvents: map(.traceEvents) | add}' trace_*.json > all.json
+//
+// Clients use their local TCP port as client id, and servers tag session spans
+// with the peer's port (trace_client_id), so both ends of a connection agree.
+
+#include <cstdint>
+
+// Client id of a TCP endpoint: the peer of a session, or a client's own end
+template <typename Endpoint>
+int64_t trace_client_id(const Endpoint& endpoint) {
+    return endpoint.port();
+}
+
+#if defined(FEDML_TRACE)
+
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+namespace trace_detail {
+
+const size_t RING_EVENTS = size_t(1) << 16;  // Spans kept per thread; a power of two
+
+struct Event {
+    const char* name;
+    int64_t begin_ns;
+    int64_t duration_ns;
+    int64_t round;
+    int64_t client;
+    uint64_t async_id;  // 0 for a complete span
+};
+
+// One thread's spans; written only by that thread
+class Ring {
+public:
+    explicit Ring(int tid) : tid(tid), events_(RING_EVENTS) {}
+
+    void record(const Event& event) {
+        uint64_t n = head_.load(std::memory_order_relaxed);
+        events_[n & (RING_EVENTS - 1)] = event;
+        head_.store(n + 1, std::memory_order_release);
+    }
+
+    // Call f on every span still held, oldest first
+    template <typename F>
+    void for_each(F&& f) const {
+        uint64_t n = head_.load(std::memory_order_acquire);
+        for (uint64_t i = n > RING_EVENTS ? n - RING_EVENTS : 0; i < n; ++i) f(events_[i & (RING_EVENTS - 1)]);
+    }
+
+    const int tid;
+
+private:
+    std::atomic<uint64_t> head_{0};
+    std::vector<Event> events_;
+};
+
+// Process-wide tags; plain atomics so spans ending during static destruction stay safe
+inline std::atomic<int64_t> current_round{-1};
+inline std::atomic<int64_t> process_client{-1};
+inline std::atomic<uint64_t> next_async_id{1};
+
+inline int64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+// Registry of all rings; dumps them when the process exits
+class Tracer {
+public:
+    ~Tracer() { dump(path_.empty() ? "trace_" + file_label() + "_" + std::to_string(getpid()) + ".json" : path_); }
+
+    std::shared_ptr<Ring> register_thread() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        rings_.push_back(std::make_shared<Ring>(static_cast<int>(rings_.size())));
+        return rings_.back();
+    }
+
+    void set_process(const std::string& name) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        name_ = name;
+    }
+
+    void set_path(const std::string& path) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        path_ = path;
+    }
+
+    // Write every recorded span as Chrome trace JSON; spans still being
+    // recorded by other threads during the dump may be torn
+    void dump(const std::string& path) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::ofstream out(path);
+        if (!out) {
+            std::cerr << "[ERROR] Cannot write trace to " << path << std::endl;
+            return;
+        }
+        const int pid = getpid();
+        out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+        out << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":" << pid << ",\"tid\":0,\"args\":{\"name\":\""
+            << name_ << "\"}}";
+        size_t spans = 0;
+        char line[768];
+        for (const auto& ring : rings_) {
+            out << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" << pid << ",\"tid\":" << ring->tid
+                << ",\"args\":{\"name\":\"thread " << ring->tid << "\"}}";
+            ring->for_each([&](const Event& e) {
+                if (e.async_id == 0) {
+                    std::snprintf(line, sizeof(line),
+                                  ",\n{\"name\":\"%s\",\"cat\":\"fedml\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,"
+                                  "\"pid\":%d,\"tid\":%d,\"args\":{\"round\":%lld,\"client\":%lld}}",
+                                  e.name, e.begin_ns / 1e3, e.duration_ns / 1e3, pid, ring->tid, (long long)e.round,
+                                  (long long)e.client);
+                } else {
+                    // The end event repeats name, cat and id so the pair matches
+                    std::snprintf(line, sizeof(line),
+                                  ",\n{\"name\":\"%s\",\"cat\":\"fedml\",\"ph\":\"b\",\"ts\":%.3f,\"pid\":%d,"
+                                  "\"tid\":%d,\"id2\":{\"local\":\"0x%llx\"},\"args\":{\"round\":%lld,\"client\":%lld}}"
+                                  ",\n{\"name\":\"%s\",\"cat\":\"fedml\",\"ph\":\"e\",\"ts\":%.3f,\"pid\":%d,"
+                                  "\"tid\":%d,\"id2\":{\"local\":\"0x%llx\"}}",
+                                  e.name, e.begin_ns / 1e3, pid, ring->tid, (unsigned long long)e.async_id,
+                                  (long long)e.round, (long long)e.client, e.name, (e.begin_ns + e.duration_ns) / 1e3,
+                                  pid, ring->tid, (unsigned long long)e.async_id);
+                }
+                out << line;
+                spans++;
+            });
+        }
+        out << "\n]}\n";
+        std::cout << "[INFO] Wrote " << spans << " trace spans to " << path << std::endl;
+    }
+
+private:
+    // Process name reduced to a file name component
+    std::string file_label() const {
+        std::string label = name_;
+        for (char& c : label) {
+            if (!std::isalnum(static_cast<unsigned char>(c))) c = '_';
+        }
+        return label;
+    }
+
+    std::mutex mutex_;
+    std::vector<std::shared_ptr<Ring>> rings_;
+    std::string name_ = "process";
+    std::string path_;
+};
+
+inline Tracer& tracer() {
+    static Tracer instance;
+    return instance;
+}
+
+inline Ring& thread_ring() {
+    thread_local std::shared_ptr<Ring> ring = tracer().register_thread();
+    return *ring;
+}
+
+class Span {
+public:
+    Span(const char* name, int64_t round, int64_t client)
+        : name_(name), round_(round), client_(client), begin_ns_(now_ns()) {}
+    explicit Span(const char* name)
+        : Span(name, current_round.load(std::memory_order_relaxed), process_client.load(std::memory_order_relaxed)) {}
+    ~Span() { thread_ring().record({name_, begin_ns_, now_ns() - begin_ns_, round_, client_, 0}); }
+
+    Span(const Span&) = delete;
+    Span& operator=(const Span&) = delete;
+
+private:
+    const char* name_;
+    int64_t round_;
+    int64_t client_;
+    int64_t begin_ns_;
+};
+
+// Span that may be suspended and resumed on another thread; recorded by the
+// thread that ends it
+class AsyncSpan {
+public:
+    AsyncSpan(const char* name, int64_t round, int64_t client)
+        : name_(name), round_(round), client_(client), id_(next_async_id.fetch_add(1, std::memory_order_relaxed)),
+          begin_ns_(now_ns()) {}
+    ~AsyncSpan() { thread_ring().record({name_, begin_ns_, now_ns() - begin_ns_, round_, client_, id_}); }
+
+    AsyncSpan(const AsyncSpan&) = delete;
+    AsyncSpan& operator=(const AsyncSpan&) = delete;
+
+private:
+    const char* name_;
+    int64_t round_;
+    int64_t client_;
+    uint64_t id_;
+    int64_t begin_ns_;
+};
+
+}  // namespace trace_detail
+
+// Name this process in the trace and tag its spans with a client id (-1 for none)
+inline void trace_process(const std::string& name, int64_t client = -1) {
+    trace_detail::tracer().set_process(name);
+    trace_detail::process_client.store(client, std::memory_order_relaxed);
+}
+
+// Write the trace to `path` at exit instead of trace_<name>_<pid>.json
+inline void trace_output(const std::string& path) { trace_detail::tracer().set_path(path); }
+
+// Write the trace now, in addition to the dump at exit
+inline void trace_dump(const std::string& path) { trace_detail::tracer().dump(path); }
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+#define TRACE_PROCESS(name, client) trace_process(name, client)
+#define TRACE_OUTPUT(path) trace_output(path)
+#define TRACE_ROUND(round) trace_detail::current_round.store((round), std::memory_order_relaxed)
+#define TRACE_CLIENT(var, endpoint) const int64_t var = trace_client_id(endpoint)
+#define TRACE_SCOPE(name) trace_detail::Span TRACE_CONCAT(trace_span_, __LINE__)(name)
+#define TRACE_SCOPE_ROUND(name, round) \
+    trace_detail::Span TRACE_CONCAT(trace_span_, __LINE__)(name, round, trace_detail::process_client.load())
+#define TRACE_SCOPE_TAGGED(name, round, client) trace_detail::Span TRACE_CONCAT(trace_span_, __LINE__)(name, round, client)
+#define TRACE_ASYNC_SCOPE_TAGGED(name, round, client) \
+    trace_detail::AsyncSpan TRACE_CONCAT(trace_span_, __LINE__)(name, round, client)
+
+#else
+
+#define TRACE_PROCESS(name, client) ((void)0)
+#define TRACE_OUTPUT(path) ((void)0)
+#define TRACE_ROUND(round) ((void)0)
+#define TRACE_CLIENT(var, endpoint)
+#define TRACE_SCOPE(name) ((void)0)
+#define TRACE_SCOPE_ROUND(name, round) ((void)0)
+#define TRACE_SCOPE_TAGGED(name, round, client) ((void)0)
+#define TRACE_ASYNC_SCOPE_TAGGED(name, round, client) ((void)0)
+
+#endif
@@ -0,0 +1,413 @@
+#pragma once
+
+// Compression of model updates on the wire.
+//
+// A client sends the difference between its weights and the last global model
+// it received (FRAME_DELTA), naming that model's version in the header round,
+// and can encode it with a lossy codec; the server adds the decoded delta to
+// the model it sent under that version. Naming the reference lets updates and
+// model replies cross on the wire.
+//
+//   none     raw float64 values, sent straight from the vector
+//   fp16     IEEE half precision, 4x smaller; values saturate at +-65504
+//   int8     stochastic rounding to int8 with one float scale per block of
+//            values; unbiased, ~8x smaller
+//   topk     only the k largest-magnitude values as (uint32 index, float value)
+//            pairs; 1 / (8 * ratio) x smaller
+//
+// Payload layouts (little-endian):
+//   fp16  uint16 half[n]
+//   int8  uint32 block | float scale[ceil(n / block)] | int8 q[n]
+//   topk  uint32 k | uint32 index[k] (ascending) | float value[k]
+//
+// With error feedback the encoder carries what the codec dropped over to the
+// next update, so top-k eventually transmits every coordinate. Decoding adds
+// into an existing vector (out += scale * decoded) using F16C / AVX when the
+// build enables them.
+
+#include <utility>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <Eigen/Dense>
+#if defined(__AVX__) || defined(__F16C__) || defined(__SSE4_1__)
+#include <immintrin.h>
+#endif
+#include "perf_counters.hpp"
+#include "wire_protocol.hpp"
+
+enum class UpdateCodec : uint16_t {
+    None = 0,
+    Float16 = 1,
+    Int8 = 2,
+    TopK = 3,
+};
+
+struct CodecOptions {
+    UpdateCodec codec = UpdateCodec::None;
+    uint32_t int8_block = 256;    // Values sharing one int8 scale
+    double topk_ratio = 0.01;     // Fraction of values top-k keeps
+    bool error_feedback = false;  // Carry the encoding error into the next update
+    uint64_t seed = 0x9E3779B97F4A7C15ull;  // Stochastic rounding
+};
+
+inline UpdateCodec parse_update_codec(const std::string& name) {
+    if (name == "none") return UpdateCodec::None;
+    if (name == "fp16") return UpdateCodec::Float16;
+    if (name == "int8") return UpdateCodec::Int8;
+    if (name == "topk") return UpdateCodec::TopK;
+    throw std::runtime_error("Unknown update codec: " + name + " (none|fp16|int8|topk)");
+}
+
+inline const char* codec_name(UpdateCodec codec) {
+    switch (codec) {
+        case UpdateCodec::None: return "none";
+        case UpdateCodec::Float16: return "fp16";
+        case UpdateCodec::Int8: return "int8";
+        case UpdateCodec::TopK: return "topk";
+    }
+    return "unknown";
+}
+
+namespace codec_detail {
+
+inline uint16_t float_to_half(float f) {
+    uint32_t x;
+    std::memcpy(&x, &f, 4);
+    uint32_t sign = (x >> 16) & 0x8000;
+    uint32_t abs = x & 0x7FFFFFFF;
+    if (abs >= 0x7F800000) return sign | (abs > 0x7F800000 ? 0x7E00 : 0x7C00);  // NaN, inf
+    if (abs >= 0x477FF000) return sign | 0x7C00;                                // Rounds past 65504
+    if (abs < 0x38800000) {
+        // Subnormal half: multiples of 2^-24, rounded to nearest even
+        float magnitude;
+        std::memcpy(&magnitude, &abs, 4);
+        return sign | uint16_t(std::nearbyint(magnitude * 16777216.0f));
+    }
+    // Rebias the exponent and round the mantissa to nearest even
+    abs += 0xC8000FFF + ((abs >> 13) & 1);
+    return sign | uint16_t(abs >> 13);
+}
+
+inline float half_to_float(uint16_t h) {
+    uint32_t sign = uint32_t(h & 0x8000) << 16;
+    uint32_t exponent = (h >> 10) & 0x1F;
+    uint32_t mantissa = h & 0x3FF;
+    if (exponent == 0) {
+        float magnitude = mantissa * (1.0f / 16777216.0f);
+        return sign ? -magnitude : magnitude;
+    }
+    uint32_t bits = exponent == 31 ? (sign | 0x7F800000 | (mantissa << 13))
+                                   : (sign | ((exponent + 112) << 23) | (mantissa << 13));
+    float f;
+    std::memcpy(&f, &bits, 4);
+    return f;
+}
+
+// splitmix64: cheap, statistically sound stream for stochastic rounding
+inline uint64_t next_random(uint64_t& state) {
+    uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+template <typename T>
+void put(std::vector<uint8_t>& bytes, size_t offset, const T* values, size_t count) {
+    std::memcpy(bytes.data() + offset, values, count * sizeof(T));
+}
+
+inline uint32_t get_u32(const uint8_t* data) {
+    uint32_t value;
+    std::memcpy(&value, data, 4);
+    return value;
+}
+
+inline void encode_fp16(const double* x, Eigen::Index n, uint8_t* out) {
+    const double limit = 65504.0;
+    Eigen::Index i = 0;
+#if defined(__F16C__) && defined(__AVX__)
+    const __m256d hi = _mm256_set1_pd(limit), lo = _mm256_set1_pd(-limit);
+    for (; i + 8 <= n; i += 8) {
+        __m128 a = _mm256_cvtpd_ps(_mm256_max_pd(lo, _mm256_min_pd(hi, _mm256_loadu_pd(x + i))));
+        __m128 b = _mm256_cvtpd_ps(_mm256_max_pd(lo, _mm256_min_pd(hi, _mm256_loadu_pd(x + i + 4))));
+        __m256 f = _mm256_insertf128_ps(_mm256_castps128_ps256(a), b, 1);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 2 * i), _mm256_cvtps_ph(f, _MM_FROUND_TO_NEAREST_INT));
+    }
+#endif
+    for (; i < n; ++i) {
+        uint16_t h = float_to_half(float(std::clamp(x[i], -limit, limit)));
+        std::memcpy(out + 2 * i, &h, 2);
+    }
+}
+
+// out += scale * half[n]
+inline void add_fp16(const uint8_t* h, Eigen::Index n, double scale, double* out) {
+    Eigen::Index i = 0;
+#if defined(__F16C__) && defined(__AVX__)
+    const __m256d s = _mm256_set1_pd(scale);
+    for (; i + 8 <= n; i += 8) {
+        __m256 f = _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(h + 2 * i)));
+        __m256d a = _mm256_cvtps_pd(_mm256_castps256_ps128(f));
+        __m256d b = _mm256_cvtps_pd(_mm256_extractf128_ps(f, 1));
+        _mm256_storeu_pd(out + i, _mm256_add_pd(_mm256_loadu_pd(out + i), _mm256_mul_pd(s, a)));
+        _mm256_storeu_pd(out + i + 4, _mm256_add_pd(_mm256_loadu_pd(out + i + 4), _mm256_mul_pd(s, b)));
+    }
+#endif
+    for (; i < n; ++i) {
+        uint16_t half;
+        std::memcpy(&half, h + 2 * i, 2);
+        out[i] += scale * half_to_float(half);
+    }
+}
+
+// out += scale * q[n]
+inline void add_int8(const int8_t* q, Eigen::Index n, double scale, double* out) {
+    Eigen::Index i = 0;
+#if defined(__AVX__) && defined(__SSE4_1__)
+    const __m256d s = _mm256_set1_pd(scale);
+    for (; i + 4 <= n; i += 4) {
+        int32_t packed;
+        std::memcpy(&packed, q + i, 4);
+        __m256d v = _mm256_cvtepi32_pd(_mm_cvtepi8_epi32(_mm_cvtsi32_si128(packed)));
+        _mm256_storeu_pd(out + i, _mm256_add_pd(_mm256_loadu_pd(out + i), _mm256_mul_pd(s, v)));
+    }
+#endif
+    for (; i < n; ++i) out[i] += scale * q[i];
+}
+
+}  // namespace codec_detail
+
+// Bytes `codec` produces for n values (top-k: for its k)
+inline size_t encoded_size(UpdateCodec codec, Eigen::Index n, const CodecOptions& options = CodecOptions()) {
+    switch (codec) {
+        case UpdateCodec::None: return size_t(n) * sizeof(double);
+        case UpdateCodec::Float16: return size_t(n) * sizeof(uint16_t);
+        case UpdateCodec::Int8: {
+            size_t blocks = (size_t(n) + options.int8_block - 1) / options.int8_block;
+            return 4 + blocks * sizeof(float) + size_t(n);
+        }
+        case UpdateCodec::TopK: {
+            size_t k = std::min<size_t>(n, size_t(std::ceil(options.topk_ratio * n)));
+            return 4 + k * (sizeof(uint32_t) + sizeof(float));
+        }
+    }
+    throw ProtocolError("Unknown update codec " + std::to_string(int(codec)));
+}
+
+// out += scale * decode(payload); out.size() is the number of encoded values.
+// Throws ProtocolError on payloads that do not match their codec.
+inline void decode_update_add(UpdateCodec codec, const uint8_t* data, size_t bytes, Eigen::VectorXd& out,
+                              double scale = 1.0) {
+    TRACE_SCOPE("decode_update");
+    PERF_SCOPE("decode_update");
+    const Eigen::Index n = out.size();
+    switch (codec) {
+        case UpdateCodec::None: {
+            if (bytes != size_t(n) * sizeof(double)) throw ProtocolError("Raw update has the wrong size");
+            for (Eigen::Index i = 0; i < n; ++i) {
+                double value;
+                std::memcpy(&value, data + i * sizeof(double), sizeof(double));
+                out(i) += scale * value;
+            }
+            return;
+        }
+        case UpdateCodec::Float16: {
+            if (bytes != size_t(n) * sizeof(uint16_t)) throw ProtocolError("fp16 update has the wrong size");
+            codec_detail::add_fp16(data, n, scale, out.data());
+            return;
+        }
+        case UpdateCodec::Int8: {
+            if (bytes < 4) throw ProtocolError("int8 update is truncated");
+            uint32_t block = codec_detail::get_u32(data);
+            if (block == 0) throw ProtocolError("int8 update has a zero block size");
+            size_t blocks = (size_t(n) + block - 1) / block;
+            if (bytes != 4 + blocks * sizeof(float) + size_t(n)) throw ProtocolError("int8 update has the wrong size");
+            const uint8_t* scales = data + 4;
+            const int8_t* q = reinterpret_cast<const int8_t*>(scales + blocks * sizeof(float));
+            for (size_t b = 0; b < blocks; ++b) {
+                float block_scale;
+                std::memcpy(&block_scale, scales + b * sizeof(float), sizeof(float));
+                Eigen::Index first = Eigen::Index(b) * block;
+                Eigen::Index count = std::min<Eigen::Index>(block, n - first);
+                codec_detail::add_int8(q + first, count, scale * block_scale, out.data() + first);
+            }
+            return;
+        }
+        case UpdateCodec::TopK: {
+            if (bytes < 4) throw ProtocolError("top-k update is truncated");
+            size_t k = codec_detail::get_u32(data);
+            if (k > size_t(n) || bytes != 4 + k * (sizeof(uint32_t) + sizeof(float))) {
+                throw ProtocolError("top-k update has the wrong size");
+            }
+            const uint8_t* indices = data + 4;
+            const uint8_t* values = indices + k * sizeof(uint32_t);
+            int64_t previous = -1;
+            for (size_t j = 0; j < k; ++j) {
+                uint32_t index = codec_detail::get_u32(indices + j * sizeof(uint32_t));
+                float value;
+                std::memcpy(&value, values + j * sizeof(float), sizeof(float));
+                if (int64_t(index) <= previous || index >= uint32_t(n)) throw ProtocolError("top-k update has bad indices");
+                previous = index;
+                out(index) += scale * value;
+            }
+            return;
+        }
+    }
+    throw ProtocolError("Unknown update codec " + std::to_string(int(codec)));
+}
+
+// Client side: encodes successive updates, keeping the error-feedback residual
+class UpdateEncoder {
+public:
+    explicit UpdateEncoder(const CodecOptions& options = CodecOptions())
+        : options_(options), rng_(options.seed) {
+        if (options_.int8_block == 0) throw std::runtime_error("int8 block size must be positive");
+        if (!(options_.topk_ratio > 0 && options_.topk_ratio <= 1)) throw std::runtime_error("top-k ratio must be in (0, 1]");
+    }
+
+    UpdateCodec codec() const { return options_.codec; }
+    const CodecOptions& options() const { return options_; }
+
+    // Encoding error not yet sent (zero without error feedback)
+    const Eigen::VectorXd& residual() const { return residual_; }
+
+    // Encode `update`; the returned buffer stays valid until the next call.
+    // Raw updates without error feedback are not copied: the buffer then points
+    // into `update`, which must outlive it.
+    asio::const_buffer encode(const Eigen::VectorXd& update) {
+        const Eigen::VectorXd* input = &update;
+        if (options_.error_feedback) {
+            if (residual_.size() != update.size()) residual_ = Eigen::VectorXd::Zero(update.size());
+            residual_ += update;  // residual_ now holds the value to send
+            input = &residual_;
+        }
+
+        asio::const_buffer encoded;
+        switch (options_.codec) {
+            case UpdateCodec::None:
+                if (!options_.error_feedback) return frame_buffer(update);
+                bytes_.resize(encoded_size(UpdateCodec::None, input->size()));
+                codec_detail::put(bytes_, 0, input->data(), input->size());
+                break;
+            case UpdateCodec::Float16: encode_fp16(*input); break;
+            case UpdateCodec::Int8: encode_int8(*input); break;
+            case UpdateCodec::TopK: encode_topk(*input); break;
+        }
+
+        // What the server will not see is carried into the next update
+        if (options_.error_feedback) decode_update_add(options_.codec, bytes_.data(), bytes_.size(), residual_, -1.0);
+        return asio::buffer(bytes_);
+    }
+
+private:
+    void encode_fp16(const Eigen::VectorXd& x) {
+        bytes_.resize(encoded_size(UpdateCodec::Float16, x.size()));
+        codec_detail::encode_fp16(x.data(), x.size(), bytes_.data());
+    }
+
+    void encode_int8(const Eigen::VectorXd& x) {
+        const Eigen::Index n = x.size();
+        const uint32_t block = options_.int8_block;
+        const size_t blocks = (size_t(n) + block - 1) / block;
+        bytes_.resize(encoded_size(UpdateCodec::Int8, n, options_));
+        codec_detail::put(bytes_, 0, &block, 1);
+        int8_t* q = reinterpret_cast<int8_t*>(bytes_.data() + 4 + blocks * sizeof(float));
+
+        for (size_t b = 0; b < blocks; ++b) {
+            Eigen::Index first = Eigen::Index(b) * block;
+            Eigen::Index count = std::min<Eigen::Index>(block, n - first);
+            float scale = float(x.segment(first, count).cwiseAbs().maxCoeff() / 127.0);
+            codec_detail::put(bytes_, 4 + b * sizeof(float), &scale, 1);
+            if (scale == 0.0f) {
+                std::fill(q + first, q + first + count, int8_t(0));
+                continue;
+            }
+            // floor(x / scale + u) with u ~ U[0, 1): unbiased rounding to the grid
+            const double inverse = 1.0 / scale;
+            for (Eigen::Index i = 0; i < count; i += 2) {
+                uint64_t r = codec_detail::next_random(rng_);
+                for (Eigen::Index j = i; j < std::min(i + 2, count); ++j, r >>= 32) {
+                    double u = double(uint32_t(r)) * (1.0 / 4294967296.0);
+                    double level = std::floor(x(first + j) * inverse + u);
+                    q[first + j] = int8_t(std::clamp(level, -127.0, 127.0));
+                }
+            }
+        }
+    }
+
+    void encode_topk(const Eigen::VectorXd& x) {
+        const Eigen::Index n = x.size();
+        const size_t k = std::min<size_t>(n, size_t(std::ceil(options_.topk_ratio * n)));
+        order_.resize(n);
+        std::iota(order_.begin(), order_.end(), 0u);
+        // O(n) selection of the k largest magnitudes, then ascending index order
+        std::nth_element(order_.begin(), order_.begin() + k, order_.end(),
+                         [&x](uint32_t a, uint32_t b) { return std::abs(x(a)) > std::abs(x(b)); });
+        std::sort(order_.begin(), order_.begin() + k);
+
+        bytes_.resize(encoded_size(UpdateCodec::TopK, n, options_));
+        uint32_t count = uint32_t(k);
+        codec_detail::put(bytes_, 0, &count, 1);
+        codec_detail::put(bytes_, 4, order_.data(), k);
+        for (size_t j = 0; j < k; ++j) {
+            float value = float(x(order_[j]));
+            codec_detail::put(bytes_, 4 + k * sizeof(uint32_t) + j * sizeof(float), &value, 1);
+        }
+    }
+
+    CodecOptions options_;
+    uint64_t rng_;
+    std::vector<uint8_t> bytes_;
+    std::vector<uint32_t> order_;
+    Eigen::VectorXd residual_;
+};
+
+// Header of an update frame carrying `codec`-encoded values; delta updates are
+// relative to the global model the receiver sent as version `round` (version 0
+// is the all-zero model)
+inline FrameHeader update_frame_header(int round, Eigen::Index n, double samples, UpdateCodec codec, bool delta) {
+    FrameHeader header = frame_header(MessageType::Update, round, n, 1, samples,
+                                      codec == UpdateCodec::None ? DType::Float64 : DType::Bytes,
+                                      delta ? FRAME_DELTA : 0);
+    header.codec = static_cast<uint16_t>(codec);
+    return header;
+}
+
+#if defined(__cpp_impl_coroutine)
+
+// Check an update frame, read its payload and reconstruct the full update of
+// header.rows values: reference + delta for delta frames (a missing reference
+// counts as zero), the decoded values otherwise
+template <typename AsyncReadStream>
+asio::awaitable<void> async_read_update(AsyncReadStream& stream, const FrameHeader& header,
+                                        const Eigen::VectorXd* reference, Eigen::VectorXd& update) {
+    const Eigen::Index n = header.rows;
+    const bool delta = header.flags & FRAME_DELTA;
+    const UpdateCodec codec = static_cast<UpdateCodec>(header.codec);
+    expect_frame(header, MessageType::Update, codec == UpdateCodec::None ? DType::Float64 : DType::Bytes);
+    if (header.cols != 1) throw ProtocolError("Update must be a single column");
+    if (delta && reference && reference->size() != n) throw ProtocolError("Delta does not match the reference model size");
+
+    if (codec == UpdateCodec::None && header.element_type() == DType::Float64 && !delta) {
+        // Plain weights go straight into the vector
+        update.resize(n);
+        co_await async_read_frame_payload(stream, header, frame_buffer(update));
+        co_return;
+    }
+    std::vector<uint8_t> payload(header.payload_bytes);
+    co_await async_read_frame_payload(stream, header, asio::buffer(payload));
+    if (delta && reference) {
+        update = *reference;
+    } else {
+        update = Eigen::VectorXd::Zero(n);
+    }
+    decode_update_add(codec, payload.data(), payload.size(), update);
+}
+
+#endif
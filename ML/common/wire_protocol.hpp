@@ -0,0 +1,339 @@
+#pragma once
+
+// Framed client/server wire protocol shared by all algorithms.
+//
+// Every message is one frame: a fixed 48-byte FrameHeader followed by
+// payload_bytes of payload. The header names the message type, the element
+// type of the payload, the round it belongs to, its shape (rows x cols
+// elements) and the sample count behind it, and carries a CRC-32C of the
+// payload plus a CRC of the header itself, so a mismatched peer or a corrupted
+// size is rejected before anything is allocated or aggregated. Several frames
+// may follow each other on one connection.
+//
+// Payloads are sent as buffer sequences (scatter/gather), so a frame goes out
+// straight from Eigen storage in one write, e.g. sums and counts of a k-means
+// update as two buffers, without first copying them into one vector:
+//
+//     write_frame(socket, frame_header(MessageType::Update, round, weights.size(), 1, samples),
+//                 frame_buffer(weights));
+//     std::array<asio::const_buffer, 2> stats{frame_buffer(sums), frame_buffer(counts)};
+//     write_frame(socket, frame_header(MessageType::Update, round, k, d + 1, samples), stats);
+//
+// A streaming peer ends its side of a connection with an EndOfStream frame
+// (no payload) instead of just closing the socket. The other side then knows
+// no further frames will arrive, flushes what it still has queued, answers
+// with its own EndOfStream and closes; frames already in flight in either
+// direction are never cut off.
+//
+// Integers and doubles are sent in host byte order; only little-endian hosts
+// are supported. The blocking functions work on any SyncRead/WriteStream; the
+// async_ variants are C++20 coroutines for the servers.
+
+#include <utility>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <boost/asio.hpp>
+#include <Eigen/Dense>
+#include "trace.hpp"
+#if defined(__SSE4_2__)
+#include <nmmintrin.h>
+#endif
+#if defined(__cpp_impl_coroutine)
+#include <boost/asio/awaitable.hpp>
+#include <boost/asio/redirect_error.hpp>
+#include <boost/asio/use_awaitable.hpp>
+#endif
+
+#if defined(__BYTE_ORDER__)
+static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__, "The wire protocol assumes a little-endian host");
+#endif
+
+namespace asio = boost::asio;
+
+const uint32_t FRAME_MAGIC = 0x4C4D4546;            // "FEML" on the wire
+const uint16_t FRAME_VERSION = 1;
+const uint64_t MAX_FRAME_PAYLOAD = uint64_t(1) << 31;  // 2 GiB
+
+// Header flags
+const uint8_t FRAME_FINAL = 1;  // Global model: training is finished, no further rounds
+const uint8_t FRAME_DELTA = 2;  // Update: difference to the global model whose version is in `round`
+
+enum class MessageType : uint16_t {
+    Update = 1,       // Client -> server: local model or statistics for one round
+    GlobalModel = 2,  // Server -> client: aggregated model and the next round id
+    Forest = 3,       // Client -> server: serialized random forest
+    Ensemble = 4,     // Client -> server: serialized boosting ensemble
+    EndOfStream = 5,  // Either direction: the sender will send no further frames
+};
+
+enum class DType : uint8_t {
+    Bytes = 0,  // Opaque payload; rows x cols is not checked against its size
+    Float64 = 1,
+    Float32 = 2,
+    Int32 = 3,
+    UInt8 = 4,
+};
+
+struct FrameHeader {
+    uint32_t magic = FRAME_MAGIC;
+    uint16_t version = FRAME_VERSION;
+    uint16_t type = 0;       // MessageType
+    uint8_t dtype = 0;       // DType of the payload elements
+    uint8_t flags = 0;       // FRAME_FINAL, FRAME_DELTA
+    uint16_t codec = 0;      // UpdateCodec of a Bytes payload (update_codec.hpp); 0 = plain elements
+    int32_t round = 0;       // Round the update was trained for / the client trains next;
+                             // model version for streamed models and delta updates
+    uint32_t rows = 0;       // Payload shape in elements, column-major like Eigen
+    uint32_t cols = 0;
+    uint32_t checksum = 0;   // CRC-32C of the payload
+    uint32_t header_crc = 0; // CRC-32C of this header with header_crc = 0
+    uint64_t payload_bytes = 0;
+    double samples = 0.0;    // Training samples behind the payload (aggregation weight)
+
+    MessageType message_type() const { return static_cast<MessageType>(type); }
+    DType element_type() const { return static_cast<DType>(dtype); }
+    bool is_final() const { return flags & FRAME_FINAL; }
+};
+static_assert(sizeof(FrameHeader) == 48, "FrameHeader must have no padding");
+
+class ProtocolError : public std::runtime_error {
+public:
+    using std::runtime_error::runtime_error;
+};
+
+inline size_t dtype_size(DType dtype) {
+    switch (dtype) {
+        case DType::Float64: return 8;
+        case DType::Float32:
+        case DType::Int32: return 4;
+        case DType::UInt8:
+        case DType::Bytes: return 1;
+    }
+    throw ProtocolError("Unknown payload dtype " + std::to_string(int(dtype)));
+}
+
+template <typename T> constexpr DType dtype_of() {
+    if constexpr (std::is_same_v<T, double>) return DType::Float64;
+    else if constexpr (std::is_same_v<T, float>) return DType::Float32;
+    else if constexpr (std::is_same_v<T, int32_t>) return DType::Int32;
+    else if constexpr (std::is_same_v<T, uint8_t>) return DType::UInt8;
+    else return DType::Bytes;
+}
+
+// CRC-32C (Castagnoli); crc32c(b, crc32c(a)) is the CRC of a followed by b
+inline uint32_t crc32c(const void* data, size_t bytes, uint32_t crc = 0) {
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    crc = ~crc;
+#if defined(__SSE4_2__)
+    uint64_t crc64 = crc;
+    for (; bytes >= 8; bytes -= 8, p += 8) {
+        uint64_t word;
+        std::memcpy(&word, p, 8);
+        crc64 = _mm_crc32_u64(crc64, word);
+    }
+    crc = static_cast<uint32_t>(crc64);
+    for (; bytes > 0; --bytes) crc = _mm_crc32_u8(crc, *p++);
+#else
+    static const std::array<uint32_t, 256> table = []() {
+        std::array<uint32_t, 256> t{};
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; ++k) c = (c >> 1) ^ (0x82F63B78u & (0u - (c & 1u)));
+            t[i] = c;
+        }
+        return t;
+    }();
+    for (; bytes > 0; --bytes) crc = table[(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+#endif
+    return ~crc;
+}
+
+template <typename BufferSequence>
+uint32_t crc32c_buffers(const BufferSequence& buffers) {
+    uint32_t crc = 0;
+    for (auto it = asio::buffer_sequence_begin(buffers); it != asio::buffer_sequence_end(buffers); ++it) {
+        asio::const_buffer buffer(*it);
+        crc = crc32c(buffer.data(), buffer.size(), crc);
+    }
+    return crc;
+}
+
+// Buffer over the storage of a dense Eigen object
+template <typename Derived>
+asio::const_buffer frame_buffer(const Eigen::PlainObjectBase<Derived>& m) {
+    return asio::buffer(m.data(), size_t(m.size()) * sizeof(typename Derived::Scalar));
+}
+
+template <typename Derived>
+asio::mutable_buffer frame_buffer(Eigen::PlainObjectBase<Derived>& m) {
+    return asio::buffer(m.data(), size_t(m.size()) * sizeof(typename Derived::Scalar));
+}
+
+// Header for a message; sizes and checksums are filled in when it is written
+inline FrameHeader frame_header(MessageType type, int round, Eigen::Index rows, Eigen::Index cols, double samples = 0.0,
+                                DType dtype = DType::Float64, uint8_t flags = 0) {
+    if (rows < 0 || cols < 0 || rows > Eigen::Index(UINT32_MAX) || cols > Eigen::Index(UINT32_MAX)) {
+        throw ProtocolError("Frame shape " + std::to_string(rows) + "x" + std::to_string(cols) + " out of range");
+    }
+    FrameHeader header;
+    header.type = static_cast<uint16_t>(type);
+    header.dtype = static_cast<uint8_t>(dtype);
+    header.flags = flags;
+    header.round = round;
+    header.rows = static_cast<uint32_t>(rows);
+    header.cols = static_cast<uint32_t>(cols);
+    header.samples = samples;
+    return header;
+}
+
+inline uint32_t header_checksum(FrameHeader header) {
+    header.header_crc = 0;
+    return crc32c(&header, sizeof(header));
+}
+
+// Size of the payload the header's shape implies; Bytes payloads are not shaped
+inline uint64_t expected_payload_bytes(const FrameHeader& header) {
+    return uint64_t(header.rows) * header.cols * dtype_size(header.element_type());
+}
+
+// Set payload size and checksums for `payload`
+template <typename ConstBufferSequence>
+void seal_frame_header(FrameHeader& header, const ConstBufferSequence& payload) {
+    header.payload_bytes = asio::buffer_size(payload);
+    if (header.element_type() != DType::Bytes && header.payload_bytes != expected_payload_bytes(header)) {
+        throw ProtocolError("Payload of " + std::to_string(header.payload_bytes) + " bytes does not match frame shape " +
+                            std::to_string(header.rows) + "x" + std::to_string(header.cols));
+    }
+    header.checksum = crc32c_buffers(payload);
+    header.header_crc = header_checksum(header);
+}
+
+// Reject headers from other protocols, versions or corrupted streams
+inline void validate_frame_header(const FrameHeader& header) {
+    if (header.magic != FRAME_MAGIC) throw ProtocolError("Bad frame magic; peer does not speak this protocol");
+    if (header.version != FRAME_VERSION) {
+        throw ProtocolError("Unsupported protocol version " + std::to_string(header.version) + " (expected " +
+                            std::to_string(FRAME_VERSION) + ")");
+    }
+    if (header.header_crc != header_checksum(header)) throw ProtocolError("Frame header checksum mismatch");
+    if (header.payload_bytes > MAX_FRAME_PAYLOAD) {
+        throw ProtocolError("Frame payload of " + std::to_string(header.payload_bytes) + " bytes exceeds the limit");
+    }
+    if (header.element_type() != DType::Bytes && header.payload_bytes != expected_payload_bytes(header)) {
+        throw ProtocolError("Frame payload size does not match its shape " + std::to_string(header.rows) + "x" +
+                            std::to_string(header.cols));
+    }
+}
+
+// Check that a received frame is the expected message
+inline void expect_frame(const FrameHeader& header, MessageType type, DType dtype = DType::Float64) {
+    if (header.message_type() != type) {
+        throw ProtocolError("Unexpected message type " + std::to_string(header.type) + " (expected " +
+                            std::to_string(int(type)) + ")");
+    }
+    if (header.element_type() != dtype) {
+        throw ProtocolError("Unexpected payload dtype " + std::to_string(header.dtype) + " (expected " +
+                            std::to_string(int(dtype)) + ")");
+    }
+}
+
+template <typename MutableBufferSequence>
+void check_frame_payload(const FrameHeader& header, const MutableBufferSequence& payload) {
+    if (asio::buffer_size(payload) != header.payload_bytes) {
+        throw ProtocolError("Receive buffer of " + std::to_string(asio::buffer_size(payload)) +
+                            " bytes does not match a payload of " + std::to_string(header.payload_bytes));
+    }
+}
+
+template <typename MutableBufferSequence>
+void verify_frame_payload(const FrameHeader& header, const MutableBufferSequence& payload) {
+    if (crc32c_buffers(payload) != header.checksum) throw ProtocolError("Frame payload checksum mismatch");
+}
+
+// Header and payload buffers for one gathered write
+template <typename ConstBufferSequence>
+std::vector<asio::const_buffer> frame_buffers(const FrameHeader& header, const ConstBufferSequence& payload) {
+    std::vector<asio::const_buffer> buffers{asio::buffer(&header, sizeof(header))};
+    for (auto it = asio::buffer_sequence_begin(payload); it != asio::buffer_sequence_end(payload); ++it) {
+        buffers.emplace_back(*it);
+    }
+    return buffers;
+}
+
+// Blocking I/O
+
+template <typename SyncWriteStream, typename ConstBufferSequence>
+void write_frame(SyncWriteStream& stream, FrameHeader header, const ConstBufferSequence& payload) {
+    TRACE_SCOPE_ROUND("write_frame", header.round);
+    seal_frame_header(header, payload);
+    asio::write(stream, frame_buffers(header, payload));
+}
+
+template <typename SyncReadStream>
+FrameHeader read_frame_header(SyncReadStream& stream) {
+    FrameHeader header;
+    asio::read(stream, asio::buffer(&header, sizeof(header)));
+    validate_frame_header(header);
+    return header;
+}
+
+// Read the payload of `header` directly into `payload`, e.g. Eigen storage
+template <typename SyncReadStream, typename MutableBufferSequence>
+void read_frame_payload(SyncReadStream& stream, const FrameHeader& header, const MutableBufferSequence& payload) {
+    TRACE_SCOPE_ROUND("read_frame", header.round);
+    check_frame_payload(header, payload);
+    asio::read(stream, payload);
+    verify_frame_payload(header, payload);
+}
+
+#if defined(__cpp_impl_coroutine)
+
+// Coroutine I/O
+
+#if defined(FEDML_TRACE)
+// Client tag of a frame span: a client's own id, or the peer's port on a server
+template <typename AsyncStream>
+int64_t frame_trace_client(AsyncStream& stream) {
+    int64_t client = trace_detail::process_client.load(std::memory_order_relaxed);
+    if (client >= 0) return client;
+    boost::system::error_code error;
+    auto peer = stream.remote_endpoint(error);
+    return error ? -1 : trace_client_id(peer);
+}
+#endif
+
+template <typename AsyncWriteStream, typename ConstBufferSequence>
+asio::awaitable<void> async_write_frame(AsyncWriteStream& stream, FrameHeader header, const ConstBufferSequence& payload) {
+    TRACE_ASYNC_SCOPE_TAGGED("write_frame", header.round, frame_trace_client(stream));
+    seal_frame_header(header, payload);
+    co_await asio::async_write(stream, frame_buffers(header, payload), asio::use_awaitable);
+}
+
+// Next frame header, or nothing if the peer closed the connection between frames
+template <typename AsyncReadStream>
+asio::awaitable<std::optional<FrameHeader>> async_read_frame_header(AsyncReadStream& stream) {
+    FrameHeader header;
+    boost::system::error_code error;
+    size_t received = co_await asio::async_read(stream, asio::buffer(&header, sizeof(header)),
+                                                asio::redirect_error(asio::use_awaitable, error));
+    if (error == asio::error::eof && received == 0) co_return std::nullopt;
+    if (error) throw boost::system::system_error(error);
+    validate_frame_header(header);
+    co_return header;
+}
+
+template <typename AsyncReadStream, typename MutableBufferSequence>
+asio::awaitable<void> async_read_frame_payload(AsyncReadStream& stream, const FrameHeader& header,
+                                               const MutableBufferSequence& payload) {
+    TRACE_ASYNC_SCOPE_TAGGED("read_frame", header.round, frame_trace_client(stream));
+    check_frame_payload(header, payload);
+    co_await asio::async_read(stream, payload, asio::use_awaitable);
+    verify_frame_payload(header, payload);
+}
+
+#endif